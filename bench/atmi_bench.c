@@ -0,0 +1,931 @@
+/*
+ * Atonomi Device SDK: Microbenchmarks
+ *
+ * Copyright (C) 2018 Atonomi
+ *
+ * Measures time per operation, cycles per operation (where a cycle counter
+ * is readable from user mode) and operations per second for each public
+ * ATMI entry point. Batch routines are reported per element. Results are
+ * written to stdout as text, CSV or JSON for tracking between SDK releases.
+ * Built with make TRACE=1, text output adds a per-phase breakdown taken
+ * from ATMIstats_get().
+ *
+ * Entropy is taken from a seeded PRNG so that runs are reproducible. The
+ * x86-64 and Cortex-A libraries draw CENTRI's entropy from libsodium rather
+ * than ATMI_memrand(), so libsodium's generator is redirected to the same
+ * source there with ATMIrng_install().
+ *
+ * No private key for the Atonomi servers is available, so genuine responses
+ * cannot be produced offline. Unpack benchmarks instead reflect each packed
+ * request back under the response message type: the envelope is well-formed,
+ * so it is carried through key exchange and decryption before being
+ * rejected, which is representative of the cost of a real response.
+ *
+ * With -j, the pack and unpack benchmarks are instead run on 1, 2, 4, ...
+ * up to the given number of threads at once, each with its own session and
+ * entropy, and total throughput is reported against that of one thread.
+ */
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "atmi.h"
+#include "atmi_keyx.h"
+#include "atmi_mt.h"
+#include "atmi_multi.h"
+#include "atmi_prep.h"
+#include "atmi_queue.h"
+#include "atmi_rng.h"
+#include "atmi_stats.h"
+#include "atmi_vcache.h"
+#include "atmi_priv.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_CYCLES   1
+#define bench_cycles()      ((uint64_t)__rdtsc())
+#else
+#define BENCH_HAVE_CYCLES   0
+#define bench_cycles()      ((uint64_t)0u)
+#endif
+
+
+/*
+ * Deterministic entropy source: xorshift64*. NOT suitable for anything
+ * but benchmarking.
+ */
+static uint64_t bench_rng_state = 0x9e3779b97f4a7c15u;
+
+static uint64_t bench_rng_next(void)
+{
+	uint64_t x = bench_rng_state;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	bench_rng_state = x;
+	return x * 0x2545f4914f6cdd1du;
+}
+
+void ATMI_memrand(void *p, size_t n)
+{
+	uint8_t  *b = p;
+	uint64_t  x;
+
+	for(; n >= sizeof(x); n -= sizeof(x), b += sizeof(x)) {
+		x = bench_rng_next();
+		memcpy(b, &x, sizeof(x));
+	}
+
+	if(n > 0u) {
+		x = bench_rng_next();
+		memcpy(b, &x, n);
+	}
+}
+
+
+
+/* Elements per call of the batch cross-signing benchmarks. */
+#define BENCH_BATCH         (64u)
+
+/* Most threads the scaling benchmarks may be asked for. */
+#define BENCH_MAX_THREADS   (256u)
+
+/*
+ * WARNING: Do not reuse this keypair.
+ */
+static const atmi_context_t context = {
+	.publicKey = {
+		0xa9, 0xb0, 0xa4, 0x1a, 0x10, 0xdd, 0x22, 0x1d,
+		0xba, 0x5c, 0xf4, 0xed, 0x2a, 0x07, 0x9f, 0x0e,
+		0x19, 0x2a, 0x6b, 0x53, 0x17, 0xf0, 0xa6, 0x1e,
+		0x40, 0x0e, 0xe7, 0x6d, 0xa6, 0xb6, 0xb4, 0x6e
+	},
+	.privateKey = {
+		0x9c, 0x27, 0x40, 0x91, 0xda, 0x1c, 0xe4, 0x7b,
+		0xd3, 0x21, 0xf2, 0x72, 0xd6, 0x6b, 0x6e, 0x55,
+		0x14, 0xfb, 0x82, 0x34, 0x6d, 0x79, 0x92, 0xe2,
+		0xd1, 0xa3, 0xee, 0xfd, 0xef, 0xfe, 0xd7, 0x91
+	}
+};
+
+
+/* Inputs and scratch shared by all benchmarks. */
+static atmi_prepared_context_t  pcontext;
+static atmi_session_t           session;
+static atmi_act_request_t       actreq;
+static atmi_val_request_t       valreq;
+static atmi_rep_request_t       repreq;
+static atmi_act_response_t      actresp;
+static atmi_val_response_t      valresp;
+static atmi_rep_response_t      represp;
+static uint8_t                  devid[32];
+static uint8_t                  xsigned[72];
+static uint8_t                  devids[BENCH_BATCH][32];
+static uint8_t                  xsigneds[BENCH_BATCH][72];
+static int                      xstatus[BENCH_BATCH];
+static uint8_t                  respbuf[ATMI_SESSBUF_SIZE];
+static size_t                   nresp;
+static atmi_rep_request_t       repreqs[ATMI_MULTI_MAX];
+static atmi_rep_response_t      represps[ATMI_MULTI_MAX];
+static atmi_ssnstate_t          ssts[ATMI_MULTI_NPKG(ATMI_MULTI_MAX)];
+static uint8_t                  multibuf[
+                                    ATMI_PKTLEN_REP_MULTI_REQ(ATMI_MULTI_MAX)];
+static size_t                   nmulti;
+static atmi_vcache_t            vcache;
+static uint8_t                  peers[BENCH_BATCH][32];
+static uint8_t                  vcachemem[BENCH_BATCH * 2u *
+                                          ATMI_VCACHE_ENTRY_SIZE];
+static atmi_queue_t             queue;
+static atmi_queue_item_t        qitems[ATMI_MULTI_MAX];
+static uint8_t                  qflash[16][4096];
+
+
+typedef struct {
+	const char  *name;
+	int        (*setup)(void);
+	int        (*op)(void);
+	int          expect;        /* 1: op must succeed; 0: must fail.   */
+	unsigned     nelem;         /* Elements handled per op.            */
+} bench_t;
+
+typedef struct {
+	const bench_t *b;
+	uint64_t       iters;
+	double         ns_per_op;
+	double         cycles_per_op;
+	double         ops_per_sec;
+	int            have_stats;    /* Built with make TRACE=1.          */
+	atmi_stats_t   stats;
+} bench_result_t;
+
+
+static int setup_none(void)
+{
+	return 0;
+}
+
+static int setup_keyx(void)
+{
+	return ATMIkeyx_precompute(&context);
+}
+
+static int setup_drbg(void)
+{
+	return ATMIrng_set_source(NULL, NULL, ATMI_RNG_DRBG);
+}
+
+static int setup_prepare(void)
+{
+	return ATMIcontext_prepare(&pcontext, &context);
+}
+
+/* Pack a request, then reflect it back as a response of the given type. */
+static int setup_reflect(int (*pack)(void), uint8_t resptype)
+{
+	int len;
+
+	if( (len = pack()) < 0 )
+		return len;
+
+	memcpy(respbuf, session.packet, (size_t)len);
+	respbuf[3] = resptype;
+	nresp      = (size_t)len;
+	return 0;
+}
+
+
+static int op_pack_act(void)
+{
+	return ATMIpack_act_request(&context, &session, &actreq);
+}
+
+static int op_pack_val(void)
+{
+	return ATMIpack_val_request(&context, &session, &valreq);
+}
+
+static int op_pack_rep(void)
+{
+	return ATMIpack_rep_request(&context, &session, &repreq);
+}
+
+static int setup_unpack_act(void)
+{
+	return setup_reflect(op_pack_act, ATMI_PKT_TYPE_ACT_RESP);
+}
+
+static int setup_unpack_val(void)
+{
+	return setup_reflect(op_pack_val, ATMI_PKT_TYPE_VAL_RESP);
+}
+
+static int setup_unpack_rep(void)
+{
+	return setup_reflect(op_pack_rep, ATMI_PKT_TYPE_REP_RESP);
+}
+
+static int op_unpack_act(void)
+{
+	return ATMIunpack_act_response(&context, &session,
+	                               respbuf, nresp, &actresp);
+}
+
+static int op_unpack_val(void)
+{
+	return ATMIunpack_val_response(&context, &session,
+	                               respbuf, nresp, &valresp);
+}
+
+static int op_unpack_rep(void)
+{
+	return ATMIunpack_rep_response(&context, &session,
+	                               respbuf, nresp, &represp);
+}
+
+static int op_pack_rep_multi(void)
+{
+	return ATMIpack_rep_request_multi(&context, ssts, repreqs,
+	                                  ATMI_MULTI_MAX, multibuf,
+	                                  sizeof(multibuf), 0u);
+}
+
+/* Pack aggregated requests, then reflect each packet as a response. */
+static int setup_unpack_rep_multi(void)
+{
+	size_t off;
+	int    len;
+
+	if( (len = op_pack_rep_multi()) < 0 )
+		return len;
+
+	nmulti = (size_t)len;
+	for(off = 0u; off < nmulti;
+	    off += ATMI_PKT_HDR_SIZE + (multibuf[off + 5] |
+	                                (size_t)multibuf[off + 6] << 8))
+		multibuf[off + 3] = ATMI_PKT_TYPE_REP_MULTI_RESP;
+	return 0;
+}
+
+/* Fails, as does op_unpack_rep(), unless every amendment's result unpacks. */
+static int op_unpack_rep_multi(void)
+{
+	int r;
+
+	r = ATMIunpack_rep_response_multi(&context, ssts, multibuf, nmulti,
+	                                  represps, ATMI_MULTI_MAX);
+	return (r == (int)ATMI_MULTI_MAX) ? 0 : -1;
+}
+
+/* A cache holding results for BENCH_BATCH peers in half its slots. */
+static int setup_vcache(void)
+{
+	size_t  i;
+	int     r;
+
+	ATMI_memrand(peers, sizeof(peers));
+	if( (r = ATMIvcache_init(&vcache, vcachemem, sizeof(vcachemem),
+	                         60u, 5u)) < 0 )
+		return r;
+
+	for(i = 0u; i < BENCH_BATCH; i++)
+		if( (r = ATMIvcache_store(&vcache, peers[i], 0u, &valresp)) < 0 )
+			return r;
+	return 0;
+}
+
+static int op_vcache_lookup(void)
+{
+	return ATMIvcache_lookup(&vcache, peers[BENCH_BATCH / 2u], 1u,
+	                         &valresp);
+}
+
+/* Queue media in RAM, standing in for on-chip flash. */
+static int qflash_read(void *arg, uint32_t page, uint32_t off, void *p,
+                       size_t n)
+{
+	(void)arg;
+	memcpy(p, &qflash[page][off], n);
+	return 0;
+}
+
+static int qflash_prog(void *arg, uint32_t page, uint32_t off, const void *p,
+                       size_t n)
+{
+	(void)arg;
+	memcpy(&qflash[page][off], p, n);
+	return 0;
+}
+
+static int qflash_erase(void *arg, uint32_t page)
+{
+	(void)arg;
+	memset(qflash[page], 0xff, sizeof(qflash[page]));
+	return 0;
+}
+
+static int setup_queue(void)
+{
+	const atmi_queue_media_t m = {
+		.read      = qflash_read,
+		.prog      = qflash_prog,
+		.erase     = qflash_erase,
+		.page_size = sizeof(qflash[0]),
+		.npages    = sizeof(qflash) / sizeof(qflash[0]),
+	};
+
+	memset(qflash, 0xff, sizeof(qflash));
+	return ATMIqueue_open(&queue, &m);
+}
+
+/* Record a batch of amendments, read them back and remove them. */
+static int op_queue_cycle(void)
+{
+	size_t i;
+	int    r;
+
+	for(i = 0u; i < ATMI_MULTI_MAX; i++)
+		if( (r = ATMIqueue_put_rep(&queue, &repreqs[i])) < 0 )
+			return r;
+
+	r = ATMIqueue_peek(&queue, qitems, ATMI_MULTI_MAX);
+	if(r != (int)ATMI_MULTI_MAX)
+		return -1;
+	return ATMIqueue_commit(&queue, ATMI_MULTI_MAX);
+}
+
+static int op_sign(void)
+{
+	return ATMIsign_device_id(&context, &session, xsigned, devid);
+}
+
+static int op_sign_prepared(void)
+{
+	return ATMIsign_device_id_prepared(&pcontext, xsigned, devid);
+}
+
+static int op_sign_batch(void)
+{
+	return ATMIsign_device_id_batch(&pcontext, xsigneds,
+	                                (const uint8_t (*)[32])devids,
+	                                BENCH_BATCH);
+}
+
+static int setup_check_batch(void)
+{
+	int r;
+
+	if( (r = setup_prepare()) < 0 )
+		return r;
+	return op_sign_batch();
+}
+
+static int op_check_batch(void)
+{
+	int r;
+
+	r = ATMIcheck_own_device_id_batch(&pcontext,
+	                                  (const uint8_t (*)[72])xsigneds,
+	                                  (const uint8_t (*)[32])devids,
+	                                  BENCH_BATCH, xstatus);
+	return (r == (int)BENCH_BATCH) ? 0 : -1;
+}
+
+static int op_prepare(void)
+{
+	return ATMIcontext_prepare(&pcontext, &context);
+}
+
+
+static const bench_t benches[] = {
+	{ "ATMIpack_act_request",        setup_none,       op_pack_act,      1, 1 },
+	{ "ATMIpack_val_request",        setup_none,       op_pack_val,      1, 1 },
+	{ "ATMIpack_rep_request",        setup_none,       op_pack_rep,      1, 1 },
+	{ "ATMIpack_act_request/keyx",   setup_keyx,       op_pack_act,      1, 1 },
+	{ "ATMIpack_act_request/drbg",   setup_drbg,       op_pack_act,      1, 1 },
+	{ "ATMIunpack_act_response",     setup_unpack_act, op_unpack_act,    0, 1 },
+	{ "ATMIunpack_val_response",     setup_unpack_val, op_unpack_val,    0, 1 },
+	{ "ATMIunpack_rep_response",     setup_unpack_rep, op_unpack_rep,    0, 1 },
+	{ "ATMIpack_rep_request_multi",  setup_none,       op_pack_rep_multi, 1,
+	  ATMI_MULTI_MAX },
+	{ "ATMIunpack_rep_response_multi", setup_unpack_rep_multi,
+	  op_unpack_rep_multi, 0, ATMI_MULTI_MAX },
+	{ "ATMIvcache_lookup",           setup_vcache,     op_vcache_lookup, 1, 1 },
+	{ "ATMIqueue_put_rep/peek/commit", setup_queue,    op_queue_cycle,   1,
+	  ATMI_MULTI_MAX },
+	{ "ATMIsign_device_id",          setup_none,       op_sign,          1, 1 },
+	{ "ATMIsign_device_id_prepared", setup_prepare,    op_sign_prepared, 1, 1 },
+	{ "ATMIsign_device_id_batch",    setup_prepare,    op_sign_batch,    1,
+	  BENCH_BATCH },
+	{ "ATMIcheck_own_device_id_batch", setup_check_batch, op_check_batch, 1,
+	  BENCH_BATCH },
+	{ "ATMIcontext_prepare",         setup_none,       op_prepare,       1, 1 },
+};
+
+
+/*
+ * Scaling benchmarks: each thread packs or unpacks with its own session and
+ * its own entropy, registered with ATMIrng_set_thread(), and shares only
+ * the context and request descriptors, which are read but never written.
+ */
+typedef struct {
+	atmi_session_t  session;
+	uint8_t         resp[ATMI_SESSBUF_SIZE];
+	size_t          nresp;
+	uint64_t        rng;
+	uint64_t        iters;
+	uint64_t        warmup;
+	int             err;
+	pthread_t       tid;
+} scale_thread_t;
+
+typedef struct {
+	const char  *name;
+	int        (*setup)(scale_thread_t *t);
+	int        (*op)(scale_thread_t *t);
+	int          expect;        /* 1: op must succeed; 0: must fail.   */
+	int          keyx;          /* Precompute the shared key first.    */
+} scale_t;
+
+typedef struct {
+	const scale_t *s;
+	unsigned       nthreads;
+	double         ops_per_sec;
+	double         speedup;
+} scale_result_t;
+
+
+static pthread_barrier_t  scale_barrier;
+static const scale_t     *scale_cur;
+
+
+static void scale_rng(void *arg, void *p, size_t n)
+{
+	scale_thread_t *t = arg;
+	uint8_t        *b = p;
+	uint64_t        x;
+	size_t          m;
+
+	for(; n > 0u; b += m, n -= m) {
+		t->rng ^= t->rng >> 12;
+		t->rng ^= t->rng << 25;
+		t->rng ^= t->rng >> 27;
+		x = t->rng * 0x2545f4914f6cdd1du;
+
+		m = (n < sizeof(x)) ? n : sizeof(x);
+		memcpy(b, &x, m);
+	}
+}
+
+static int scale_none(scale_thread_t *t)
+{
+	(void)t;
+	return 0;
+}
+
+static int scale_pack_act(scale_thread_t *t)
+{
+	return ATMIpack_act_request(&context, &t->session, &actreq);
+}
+
+static int scale_pack_rep(scale_thread_t *t)
+{
+	return ATMIpack_rep_request(&context, &t->session, &repreq);
+}
+
+static int scale_reflect(scale_thread_t *t, int (*pack)(scale_thread_t *),
+                         uint8_t resptype)
+{
+	int len;
+
+	if( (len = pack(t)) < 0 )
+		return len;
+
+	memcpy(t->resp, t->session.packet, (size_t)len);
+	t->resp[3] = resptype;
+	t->nresp   = (size_t)len;
+	return 0;
+}
+
+static int scale_setup_unpack_act(scale_thread_t *t)
+{
+	return scale_reflect(t, scale_pack_act, ATMI_PKT_TYPE_ACT_RESP);
+}
+
+static int scale_setup_unpack_rep(scale_thread_t *t)
+{
+	return scale_reflect(t, scale_pack_rep, ATMI_PKT_TYPE_REP_RESP);
+}
+
+static int scale_unpack_act(scale_thread_t *t)
+{
+	atmi_act_response_t resp;
+
+	return ATMIunpack_act_response(&context, &t->session, t->resp,
+	                               t->nresp, &resp);
+}
+
+static int scale_unpack_rep(scale_thread_t *t)
+{
+	atmi_rep_response_t resp;
+
+	return ATMIunpack_rep_response(&context, &t->session, t->resp,
+	                               t->nresp, &resp);
+}
+
+
+static const scale_t scales[] = {
+	{ "ATMIpack_act_request",      scale_none,             scale_pack_act,
+	  1, 0 },
+	{ "ATMIpack_rep_request",      scale_none,             scale_pack_rep,
+	  1, 0 },
+	{ "ATMIunpack_act_response",   scale_setup_unpack_act, scale_unpack_act,
+	  0, 0 },
+	{ "ATMIunpack_rep_response",   scale_setup_unpack_rep, scale_unpack_rep,
+	  0, 0 },
+	{ "ATMIpack_act_request/keyx", scale_none,             scale_pack_act,
+	  1, 1 },
+	{ "ATMIunpack_act_response/keyx", scale_setup_unpack_act,
+	  scale_unpack_act, 0, 1 },
+};
+
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec*1e9 + (double)ts.tv_nsec;
+}
+
+
+static int bench_run(const bench_t *b, uint64_t iters, uint64_t warmup,
+                     bench_result_t *res)
+{
+	double    t0, t1;
+	uint64_t  c0, c1, i;
+	int       r;
+
+	/* Only benchmarks that ask for precomputed keys or the DRBG get them. */
+	ATMIkeyx_clear();
+	(void)ATMIrng_set_source(NULL, NULL, 0u);
+	if( (r = b->setup()) < 0 )
+		return r;
+
+	/* Confirm the operation behaves as expected before timing it. */
+	r = b->op();
+	if(b->expect ? (r < 0) : (r >= 0))
+		return (r < 0) ? r : -1;
+
+	for(i = 0u; i < warmup; i++)
+		(void)b->op();
+
+	ATMIstats_reset();
+	t0 = now_ns();
+	c0 = bench_cycles();
+	for(i = 0u; i < iters; i++)
+		(void)b->op();
+	c1 = bench_cycles();
+	t1 = now_ns();
+	res->have_stats = (ATMIstats_get(&res->stats) == 0);
+
+	res->b             = b;
+	res->iters         = iters;
+	res->ns_per_op     = (t1 - t0) / (double)(iters * b->nelem);
+	res->cycles_per_op = (double)(c1 - c0) / (double)(iters * b->nelem);
+	res->ops_per_sec   = 1e9 / res->ns_per_op;
+	return 0;
+}
+
+
+/* Per-phase breakdown of each benchmark, for builds with make TRACE=1. */
+static void print_phases(const bench_result_t *res, size_t n)
+{
+	const atmi_phase_stats_t *p;
+	double                    ops;
+	size_t                    i;
+	unsigned                  j;
+
+	printf("\n%-30s %-10s %12s %12s\n", "name", "phase",
+	       "calls/op", "cycles/op");
+	for(i = 0u; i < n; i++) {
+		if(!res[i].have_stats)
+			continue;
+		ops = (double)(res[i].iters * res[i].b->nelem);
+		for(j = 0u; j < ATMI_NPHASES; j++) {
+			p = &res[i].stats.phase[j];
+			if(p->calls == 0u)
+				continue;
+			printf("%-30s %-10s %12.2f %12.0f\n", res[i].b->name,
+			       ATMIstats_phase_name(j), (double)p->calls / ops,
+			       (double)p->cycles / ops);
+		}
+	}
+}
+
+
+static void print_results(const char *fmt, const bench_result_t *res,
+                          size_t n, uint64_t seed)
+{
+	size_t i;
+
+	if(!strcmp(fmt, "csv")) {
+		printf("name,iterations,ns_per_op,cycles_per_op,ops_per_sec\n");
+		for(i = 0u; i < n; i++) {
+			printf("%s,%" PRIu64 ",%.1f,", res[i].b->name,
+			       res[i].iters, res[i].ns_per_op);
+			if(BENCH_HAVE_CYCLES)
+				printf("%.0f", res[i].cycles_per_op);
+			printf(",%.1f\n", res[i].ops_per_sec);
+		}
+	}
+	else if(!strcmp(fmt, "json")) {
+		printf("{\n  \"sdk_version\": \"%s\",\n  \"seed\": %" PRIu64
+		       ",\n  \"results\": [\n", "0.10.5", seed);
+		for(i = 0u; i < n; i++) {
+			printf("    { \"name\": \"%s\", \"iterations\": %" PRIu64
+			       ", \"ns_per_op\": %.1f, \"cycles_per_op\": ",
+			       res[i].b->name, res[i].iters, res[i].ns_per_op);
+			if(BENCH_HAVE_CYCLES)
+				printf("%.0f", res[i].cycles_per_op);
+			else
+				printf("null");
+			printf(", \"ops_per_sec\": %.1f }%s\n", res[i].ops_per_sec,
+			       (i + 1u < n) ? "," : "");
+		}
+		printf("  ]\n}\n");
+	}
+	else {
+		printf("%-30s %10s %12s %12s %12s\n", "name", "iters",
+		       "ns/op", "cycles/op", "ops/sec");
+		for(i = 0u; i < n; i++)
+			printf("%-30s %10" PRIu64 " %12.1f %12.0f %12.1f\n",
+			       res[i].b->name, res[i].iters, res[i].ns_per_op,
+			       res[i].cycles_per_op, res[i].ops_per_sec);
+		if(n > 0u && res[0].have_stats)
+			print_phases(res, n);
+	}
+}
+
+
+static void *scale_worker(void *arg)
+{
+	scale_thread_t *t = arg;
+	uint64_t        i;
+	int             r;
+
+	ATMIrng_set_thread(scale_rng, t);
+
+	/* Confirm the operation behaves as expected before timing it. */
+	if( (r = scale_cur->setup(t)) >= 0 ) {
+		r = scale_cur->op(t);
+		if(scale_cur->expect ? (r >= 0) : (r < 0))
+			r = 0;
+		else if(r >= 0)
+			r = -1;
+	}
+	t->err = r;
+
+	for(i = 0u; t->err == 0 && i < t->warmup; i++)
+		(void)scale_cur->op(t);
+
+	/* Once all are ready, then again once the clock has been read. */
+	(void)pthread_barrier_wait(&scale_barrier);
+	(void)pthread_barrier_wait(&scale_barrier);
+
+	for(i = 0u; t->err == 0 && i < t->iters; i++)
+		(void)scale_cur->op(t);
+
+	ATMIrng_set_thread(NULL, NULL);
+	return NULL;
+}
+
+/* Run one scaling benchmark on n threads, each making iters calls. */
+static int scale_run(const scale_t *s, unsigned n, uint64_t iters,
+                     uint64_t warmup, uint64_t seed, scale_thread_t *ts,
+                     double *ops_per_sec)
+{
+	double    t0, t1;
+	unsigned  i, started;
+	int       r = 0;
+
+	ATMIkeyx_clear();
+	if(s->keyx && (r = ATMIkeyx_precompute(&context)) < 0)
+		return r;
+
+	scale_cur = s;
+	if(pthread_barrier_init(&scale_barrier, NULL, n + 1u))
+		return -1;
+
+	for(started = 0u; started < n; started++) {
+		memset(&ts[started], 0, sizeof(ts[started]));
+		ts[started].rng    = (seed + started + 1u) * 0x9e3779b97f4a7c15u;
+		ts[started].iters  = iters;
+		ts[started].warmup = warmup;
+		if(pthread_create(&ts[started].tid, NULL, scale_worker,
+		                  &ts[started]))
+			break;
+	}
+
+	/* Threads not started would leave the others waiting for ever. */
+	if(started < n) {
+		fprintf(stderr, "Error:Could not start %u threads.\n", n);
+		exit(2);
+	}
+
+	(void)pthread_barrier_wait(&scale_barrier);
+	t0 = now_ns();
+	(void)pthread_barrier_wait(&scale_barrier);
+
+	for(i = 0u; i < n; i++)
+		(void)pthread_join(ts[i].tid, NULL);
+	t1 = now_ns();
+
+	pthread_barrier_destroy(&scale_barrier);
+	for(i = 0u; i < n; i++)
+		if(ts[i].err < 0)
+			r = ts[i].err;
+
+	*ops_per_sec = (double)(iters * n) * 1e9 / (t1 - t0);
+	return r;
+}
+
+static void print_scale(const char *fmt, const scale_result_t *res,
+                        size_t n)
+{
+	size_t i;
+
+	if(!strcmp(fmt, "csv")) {
+		printf("name,threads,ops_per_sec,speedup,efficiency\n");
+		for(i = 0u; i < n; i++)
+			printf("%s,%u,%.1f,%.2f,%.2f\n", res[i].s->name,
+			       res[i].nthreads, res[i].ops_per_sec, res[i].speedup,
+			       res[i].speedup / res[i].nthreads);
+	}
+	else if(!strcmp(fmt, "json")) {
+		printf("{\n  \"sdk_version\": \"%s\",\n  \"scaling\": [\n",
+		       "0.10.5");
+		for(i = 0u; i < n; i++)
+			printf("    { \"name\": \"%s\", \"threads\": %u, "
+			       "\"ops_per_sec\": %.1f, \"speedup\": %.2f, "
+			       "\"efficiency\": %.2f }%s\n", res[i].s->name,
+			       res[i].nthreads, res[i].ops_per_sec, res[i].speedup,
+			       res[i].speedup / res[i].nthreads,
+			       (i + 1u < n) ? "," : "");
+		printf("  ]\n}\n");
+	}
+	else {
+		printf("%-30s %8s %12s %8s %10s\n", "name", "threads",
+		       "ops/sec", "speedup", "efficiency");
+		for(i = 0u; i < n; i++)
+			printf("%-30s %8u %12.1f %8.2f %10.2f\n", res[i].s->name,
+			       res[i].nthreads, res[i].ops_per_sec, res[i].speedup,
+			       res[i].speedup / res[i].nthreads);
+	}
+}
+
+/* Thread counts 1, 2, 4, ... below maxthreads, then maxthreads itself. */
+static int scale_main(const char *fmt, const char *filter,
+                      unsigned maxthreads, uint64_t iters, uint64_t warmup,
+                      uint64_t seed)
+{
+	scale_result_t *res;
+	scale_thread_t *ts;
+	double          base = 0.0;
+	size_t          i, n = 0u, nmax;
+	unsigned        k, nsteps;
+	int             r;
+
+	for(nsteps = 1u, k = 1u; k < maxthreads; k *= 2u)
+		nsteps++;
+	nmax = nsteps * (sizeof(scales) / sizeof(scales[0]));
+
+	res = calloc(nmax, sizeof(*res));
+	ts  = calloc(maxthreads, sizeof(*ts));
+	if(!res || !ts) {
+		fprintf(stderr, "Error:Out of memory.\n");
+		return 2;
+	}
+
+	for(i = 0u; i < sizeof(scales)/sizeof(scales[0]); i++) {
+		if(filter && !strstr(scales[i].name, filter))
+			continue;
+
+		for(k = 1u; ; k = (k * 2u < maxthreads) ? k * 2u : maxthreads) {
+			r = scale_run(&scales[i], k, iters, warmup, seed, ts,
+			              &res[n].ops_per_sec);
+			if(r < 0) {
+				fprintf(stderr, "Error:%s:Returned error %d.\n",
+				        scales[i].name, -r);
+				return 2;
+			}
+
+			if(k == 1u)
+				base = res[n].ops_per_sec;
+			res[n].s        = &scales[i];
+			res[n].nthreads = k;
+			res[n].speedup  = res[n].ops_per_sec / base;
+			n++;
+
+			if(k == maxthreads)
+				break;
+		}
+	}
+
+	print_scale(fmt, res, n);
+	ATMIkeyx_clear();
+	free(ts);
+	free(res);
+	return 0;
+}
+
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr,
+	        "Usage: %s [-n iters] [-w warmup] [-s seed] [-f text|csv|json]"
+	        " [-j threads] [filter]\n"
+	        "  -n iters   Timed iterations per benchmark (default 2000).\n"
+	        "  -w warmup  Untimed iterations per benchmark (default 100).\n"
+	        "  -s seed    Seed for the deterministic entropy source.\n"
+	        "  -f format  Output format (default text).\n"
+	        "  -j threads Measure scaling of pack and unpack from 1 to this\n"
+	        "             many threads instead; -n is then per thread.\n"
+	        "  filter     Only run benchmarks whose name contains this.\n",
+	        argv0);
+}
+
+
+int main(int argc, char *argv[])
+{
+	bench_result_t  res[sizeof(benches)/sizeof(benches[0])];
+	const char     *fmt    = "text";
+	const char     *filter = NULL;
+	uint64_t        iters  = 2000u;
+	uint64_t        warmup = 100u;
+	uint64_t        seed   = 1u;
+	unsigned long   nthreads = 0u;
+	size_t          i, n = 0u;
+	int             opt, r;
+
+	while( (opt = getopt(argc, argv, "n:w:s:f:j:h")) != -1 ) {
+		switch(opt) {
+		case 'n': iters  = strtoull(optarg, NULL, 0); break;
+		case 'w': warmup = strtoull(optarg, NULL, 0); break;
+		case 's': seed   = strtoull(optarg, NULL, 0); break;
+		case 'f': fmt    = optarg;                    break;
+		case 'j': nthreads = strtoul(optarg, NULL, 0); break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if(optind < argc)
+		filter = argv[optind];
+
+	if(iters == 0u || nthreads > BENCH_MAX_THREADS) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	bench_rng_state ^= seed * 0xbf58476d1ce4e5b9u;
+	(void)ATMIrng_install();
+	if(ATMImt_init() < 0) {
+		fprintf(stderr, "Error:Could not initialize the library.\n");
+		return 2;
+	}
+
+	ATMI_memrand(devid, sizeof(devid));
+	ATMI_memrand(&actreq, sizeof(actreq));
+	ATMI_memrand(&valreq, sizeof(valreq));
+	ATMI_memrand(&repreq, sizeof(repreq));
+	ATMI_memrand(repreqs, sizeof(repreqs));
+	for(i = 0u; i < ATMI_MULTI_MAX; i++)
+		memcpy(repreqs[i].id_requestor, repreq.id_requestor,
+		       sizeof(repreq.id_requestor));
+
+	if(nthreads > 0u)
+		return scale_main(fmt, filter, (unsigned)nthreads, iters, warmup,
+		                  seed);
+
+	for(i = 0u; i < sizeof(benches)/sizeof(benches[0]); i++) {
+		if(filter && !strstr(benches[i].name, filter))
+			continue;
+
+		if( (r = bench_run(&benches[i], iters, warmup, &res[n])) < 0 ) {
+			fprintf(stderr, "Error:%s:Returned error %d.\n",
+			        benches[i].name, -r);
+			return 2;
+		}
+		n++;
+	}
+
+	print_results(fmt, res, n, seed);
+	ATMIcontext_release(&pcontext);
+	return 0;
+}
@@ -1,7 +1,8 @@
 #!/usr/bin/env sh
 
 CURL=curl
-ATMI_IRN_ACT='http://device.atonomi.net/activate'
+# Override to target a local stand-in server (see tools/irn_standin.c).
+ATMI_IRN_ACT="${ATMI_IRN_ACT:-http://device.atonomi.net/activate}"
 
 PAYLOAD_TX=testonly_actreq.packet.bin
 PAYLOAD_RX=testonly_actresp.packet.bin
@@ -8,7 +8,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
-#include "lib/centri_ps.h"
+#include "centri_ps.h"
 
 
 /*
@@ -298,6 +298,22 @@ int ATMIsign_device_id(const atmi_context_t *ctx, atmi_session_t *ssn,
 
 
 
+/*
+ * Concurrency: all of the routines above are reentrant. Each keeps its
+ * working state in the session passed to it and on the calling thread's
+ * stack, and only reads the context, so any number of threads may pack,
+ * unpack and sign at once, sharing one context, provided no two use the
+ * same session at the same time. The prebuilt library's static data are
+ * constant tables only.
+ *
+ * The one thing shared by all threads is the source of entropy below,
+ * which may be called from several threads at once and must then be
+ * thread-safe. On targets where the library draws its entropy through
+ * libsodium, see also atmi_mt.h; to give each thread its own generator,
+ * see atmi_rng.h.
+ */
+
+
 /*
  * The CENTRI component of the Atonomi packet requires a source of entropy
  * in order to create any new packages (i.e. an RNG). Due to a limitation in
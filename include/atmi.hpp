@@ -0,0 +1,282 @@
+/*
+ * Atonomi Device SDK: C++ Interface
+ *
+ * Copyright (C) 2018 Atonomi
+ *
+ * Header-only C++17 layer over the zero-copy routines of atmi_zc.h. Each
+ * message kind is described by a tag type (atmi::Activation, ::Validation,
+ * ::Reputation) carrying its request and response types and the exact
+ * length of its packed request, so that session storage is sized per kind
+ * at compile time rather than for the worst case of ATMI_SESSBUF_SIZE.
+ */
+#ifndef ATMI_HPP_
+#define ATMI_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#if __cplusplus > 201703L && defined(__has_include)
+#if __has_include(<span>)
+#include <span>
+#endif
+#endif
+#include "atmi.h"
+#include "atmi_zc.h"
+
+
+namespace atmi {
+
+
+#ifdef __cpp_lib_span
+template<class T> using span = std::span<T>;
+#else
+/** Minimal stand-in for std::span<T> prior to C++20. */
+template<class T>
+class span {
+public:
+	constexpr span() noexcept : p_(nullptr), n_(0) {}
+	constexpr span(T *p, std::size_t n) noexcept : p_(p), n_(n) {}
+
+	template<class U, std::size_t N>
+	constexpr span(std::array<U, N> &a) noexcept : p_(a.data()), n_(N) {}
+
+	template<class U, std::size_t N>
+	constexpr span(const std::array<U, N> &a) noexcept
+		: p_(a.data()), n_(N) {}
+
+	template<std::size_t N>
+	constexpr span(T (&a)[N]) noexcept : p_(a), n_(N) {}
+
+	constexpr T          *data()  const noexcept { return p_; }
+	constexpr std::size_t size()  const noexcept { return n_; }
+	constexpr bool        empty() const noexcept { return n_ == 0; }
+	constexpr T          *begin() const noexcept { return p_; }
+	constexpr T          *end()   const noexcept { return p_ + n_; }
+
+	constexpr span subspan(std::size_t off, std::size_t n) const noexcept
+	{
+		return span(p_ + off, n);
+	}
+
+private:
+	T           *p_;
+	std::size_t  n_;
+};
+#endif
+
+
+/*
+ * Message kinds.
+ *
+ * packet_size is the exact length of a packed request. The PS_CALC_*
+ * macros of centri_ps_common.h give only upper bounds (415 bytes for an
+ * activation greeting, for instance), whereas the CENTRI encoding of the
+ * fixed-length ATMI messages always yields these lengths.
+ */
+struct Activation {
+	using request  = atmi_act_request_t;
+	using response = atmi_act_response_t;
+
+	static constexpr std::size_t packet_size = ATMI_PKTLEN_ACT_REQ;
+
+	static int pack(const atmi_context_t *ctx, atmi_ssnstate_t *sst,
+	                const request *req, uint8_t *buf, std::size_t nbuf,
+	                std::size_t headroom) noexcept
+	{
+		return ATMIpack_act_request_into(ctx, sst, req, buf, nbuf, headroom);
+	}
+
+	static int unpack(const atmi_context_t *ctx, atmi_ssnstate_t *sst,
+	                  const uint8_t *pin, std::size_t nin,
+	                  response *rsp) noexcept
+	{
+		return ATMIunpack_act_response_state(ctx, sst, pin, nin, rsp);
+	}
+
+	static int unpack_inplace(const atmi_context_t *ctx,
+	                          atmi_ssnstate_t *sst, uint8_t *pin,
+	                          std::size_t nin, std::size_t nbuf,
+	                          response *rsp) noexcept
+	{
+		return ATMIunpack_act_response_inplace(ctx, sst, pin, nin, nbuf, rsp);
+	}
+};
+
+struct Validation {
+	using request  = atmi_val_request_t;
+	using response = atmi_val_response_t;
+
+	static constexpr std::size_t packet_size = ATMI_PKTLEN_VAL_REQ;
+
+	static int pack(const atmi_context_t *ctx, atmi_ssnstate_t *sst,
+	                const request *req, uint8_t *buf, std::size_t nbuf,
+	                std::size_t headroom) noexcept
+	{
+		return ATMIpack_val_request_into(ctx, sst, req, buf, nbuf, headroom);
+	}
+
+	static int unpack(const atmi_context_t *ctx, atmi_ssnstate_t *sst,
+	                  const uint8_t *pin, std::size_t nin,
+	                  response *rsp) noexcept
+	{
+		return ATMIunpack_val_response_state(ctx, sst, pin, nin, rsp);
+	}
+
+	static int unpack_inplace(const atmi_context_t *ctx,
+	                          atmi_ssnstate_t *sst, uint8_t *pin,
+	                          std::size_t nin, std::size_t nbuf,
+	                          response *rsp) noexcept
+	{
+		return ATMIunpack_val_response_inplace(ctx, sst, pin, nin, nbuf, rsp);
+	}
+};
+
+struct Reputation {
+	using request  = atmi_rep_request_t;
+	using response = atmi_rep_response_t;
+
+	static constexpr std::size_t packet_size = ATMI_PKTLEN_REP_REQ;
+
+	static int pack(const atmi_context_t *ctx, atmi_ssnstate_t *sst,
+	                const request *req, uint8_t *buf, std::size_t nbuf,
+	                std::size_t headroom) noexcept
+	{
+		return ATMIpack_rep_request_into(ctx, sst, req, buf, nbuf, headroom);
+	}
+
+	static int unpack(const atmi_context_t *ctx, atmi_ssnstate_t *sst,
+	                  const uint8_t *pin, std::size_t nin,
+	                  response *rsp) noexcept
+	{
+		return ATMIunpack_rep_response_state(ctx, sst, pin, nin, rsp);
+	}
+
+	static int unpack_inplace(const atmi_context_t *ctx,
+	                          atmi_ssnstate_t *sst, uint8_t *pin,
+	                          std::size_t nin, std::size_t nbuf,
+	                          response *rsp) noexcept
+	{
+		return ATMIunpack_rep_response_inplace(ctx, sst, pin, nin, nbuf, rsp);
+	}
+};
+
+
+/** Exact size of a buffer holding a packed Kind request after headroom. */
+template<class Kind, std::size_t Headroom = 0>
+inline constexpr std::size_t packet_buffer_size = Headroom + Kind::packet_size;
+
+
+/**
+ * Pack a request into a caller-supplied array, leaving Headroom bytes free
+ * ahead of it. Arrays too small for the packet are rejected at compile
+ * time. Returns as for ATMIpack_*_request_into().
+ */
+template<class Kind, std::size_t Headroom = 0, std::size_t N>
+inline int pack(const atmi_context_t &ctx, atmi_ssnstate_t &sst,
+                const typename Kind::request &req,
+                std::array<uint8_t, N> &buf) noexcept
+{
+	static_assert(N >= packet_buffer_size<Kind, Headroom>,
+	              "buffer too small for this message kind");
+	return Kind::pack(&ctx, &sst, &req, buf.data(), N, Headroom);
+}
+
+
+/**
+ * Atonomi Session, sized for one message kind.
+ *
+ * Holds the session state together with a buffer of exactly Headroom plus
+ * Kind::packet_size bytes, rather than the ATMI_SESSBUF_SIZE working
+ * buffer of an atmi_session_t. Headroom may be reserved for transport
+ * framing, e.g. ATMI_HTTP_HEADROOM for frame_http_put().
+ *
+ * Member functions return zero or negative error codes as per the
+ * corresponding C routines, and do not throw.
+ */
+template<class Kind, std::size_t Headroom = 0>
+class Session {
+public:
+	using kind     = Kind;
+	using request  = typename Kind::request;
+	using response = typename Kind::response;
+
+	static constexpr std::size_t packet_size = Kind::packet_size;
+	static constexpr std::size_t headroom    = Headroom;
+	static constexpr std::size_t buffer_size =
+		packet_buffer_size<Kind, Headroom>;
+	static constexpr std::size_t state_size  = sizeof(atmi_ssnstate_t);
+
+	/** Pack req, opening a new session. See packet() for the output. */
+	int pack(const atmi_context_t &ctx, const request &req) noexcept
+	{
+		int r = Kind::pack(&ctx, &sst_, &req, buf_.data(), buffer_size,
+		                   Headroom);
+
+		npkt_ = (r > 0) ? static_cast<std::size_t>(r) : 0u;
+		return (r < 0) ? r : 0;
+	}
+
+	/** The most recently packed request, or an empty span. */
+	span<const uint8_t> packet() const noexcept
+	{
+		return span<const uint8_t>(buf_.data() + Headroom, npkt_);
+	}
+
+	/**
+	 * Prefix the packed request with an HTTP/1.1 PUT header in the headroom.
+	 * Returns the whole frame, or an empty span if nothing is packed or the
+	 * header does not fit.
+	 */
+	span<const uint8_t> frame_http_put(const char *host,
+	                                   const char *path) noexcept
+	{
+		int off;
+
+		if(npkt_ == 0u)
+			return span<const uint8_t>();
+		off = ATMIframe_http_put(buf_.data(), Headroom, npkt_, host, path);
+		if(off < 0)
+			return span<const uint8_t>();
+		return span<const uint8_t>(buf_.data() + off,
+		                           Headroom - static_cast<std::size_t>(off)
+		                           + npkt_);
+	}
+
+	/** Unpack the response to the packed request. */
+	int unpack(const atmi_context_t &ctx, span<const uint8_t> in,
+	           response &rsp) noexcept
+	{
+		return Kind::unpack(&ctx, &sst_, in.data(), in.size(), &rsp);
+	}
+
+	/**
+	 * Unpack the response within its receive buffer rxbuf, of which the
+	 * first nin bytes hold the packet. See ATMIunpack_*_response_inplace().
+	 */
+	int unpack_inplace(const atmi_context_t &ctx, span<uint8_t> rxbuf,
+	                   std::size_t nin, response &rsp) noexcept
+	{
+		return Kind::unpack_inplace(&ctx, &sst_, rxbuf.data(), nin,
+		                            rxbuf.size(), &rsp);
+	}
+
+	/** The underlying session state, for use with the C routines. */
+	atmi_ssnstate_t       &state()       noexcept { return sst_; }
+	const atmi_ssnstate_t &state() const noexcept { return sst_; }
+
+private:
+	atmi_ssnstate_t                   sst_;
+	std::array<uint8_t, buffer_size>  buf_;
+	std::size_t                       npkt_ = 0u;
+};
+
+
+static_assert(Activation::packet_size < ATMI_SESSBUF_SIZE &&
+              Validation::packet_size < ATMI_SESSBUF_SIZE &&
+              Reputation::packet_size < ATMI_SESSBUF_SIZE,
+              "packed requests exceed ATMI_SESSBUF_SIZE");
+
+
+} // namespace atmi
+
+#endif /*ATMI_HPP_*/
@@ -0,0 +1,116 @@
+/*
+ * Atonomi Device SDK: Batch Message Packing and Unpacking
+ *
+ * Copyright (C) 2018 Atonomi
+ */
+#ifndef ATMI_BATCH_H_
+#define ATMI_BATCH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "atmi.h"
+
+
+/**
+ * Atonomi Worker Pool
+ *
+ * A fixed set of worker threads across which batch operations may be
+ * split. Opaque; see ATMIpool_create(). Pools are only available on hosts
+ * with POSIX threads and a heap; building with ATMI_NO_THREADS or
+ * ATMI_NO_HEAP defined removes them, in which case ATMIpool_create() always
+ * fails and batches run entirely on the calling thread.
+ */
+typedef struct atmi_pool atmi_pool_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Create a worker pool.
+ *
+ * The calling thread of a batch operation always takes part in the work,
+ * so a pool of N-1 workers keeps N cores busy.
+ *
+ * \param nworkers  Number of worker threads to start (at least one).
+ *
+ * \return NULL      Invalid arguments, no pool support, or out of memory.
+ * \return pool      Location of new pool.
+ */
+atmi_pool_t *ATMIpool_create(unsigned nworkers);
+
+/**
+ * Stop all workers and free a worker pool. No batch may be in progress.
+ *
+ * \param pool    Location of pool to destroy. May be NULL.
+ */
+void ATMIpool_destroy(atmi_pool_t *pool);
+
+
+
+/*
+ * Batch pack and unpack routines.
+ *
+ * Each routine performs the corresponding single-message operation on the
+ * n elements of the given arrays, using one session per element. Element
+ * i of a request or response array pairs with element i of the session
+ * array. If pool is non-NULL, elements are spread across the pool's
+ * workers as well as the calling thread; otherwise they are processed in
+ * order on the calling thread. Concurrent batches on one pool are
+ * serialized.
+ *
+ * The per-element result of the single-message routine (packed length or
+ * negative error code for pack; zero or negative error code for unpack) is
+ * stored in status[i].
+ *
+ * \return -EINVAL   Invalid arguments (bad pointers). Nothing was done.
+ * \return count     Number of elements which completed successfully.
+ */
+int ATMIpack_act_request_batch(const atmi_context_t *ctx,
+                               atmi_session_t ssns[],
+                               const atmi_act_request_t acts[],
+                               size_t n, int status[], atmi_pool_t *pool);
+
+int ATMIpack_val_request_batch(const atmi_context_t *ctx,
+                               atmi_session_t ssns[],
+                               const atmi_val_request_t vals[],
+                               size_t n, int status[], atmi_pool_t *pool);
+
+int ATMIpack_rep_request_batch(const atmi_context_t *ctx,
+                               atmi_session_t ssns[],
+                               atmi_rep_request_t reps[],
+                               size_t n, int status[], atmi_pool_t *pool);
+
+/*
+ * For unpacking, pinbufs[i] and nins[i] describe the response received
+ * for the request packed into ssns[i].
+ */
+int ATMIunpack_act_response_batch(const atmi_context_t *ctx,
+                                  atmi_session_t ssns[],
+                                  const void *const pinbufs[],
+                                  const size_t nins[],
+                                  atmi_act_response_t acts[],
+                                  size_t n, int status[], atmi_pool_t *pool);
+
+int ATMIunpack_val_response_batch(const atmi_context_t *ctx,
+                                  atmi_session_t ssns[],
+                                  const void *const pinbufs[],
+                                  const size_t nins[],
+                                  atmi_val_response_t vals[],
+                                  size_t n, int status[], atmi_pool_t *pool);
+
+int ATMIunpack_rep_response_batch(const atmi_context_t *ctx,
+                                  atmi_session_t ssns[],
+                                  const void *const pinbufs[],
+                                  const size_t nins[],
+                                  atmi_rep_response_t reps[],
+                                  size_t n, int status[], atmi_pool_t *pool);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*ATMI_BATCH_H_*/
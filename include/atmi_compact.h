@@ -0,0 +1,110 @@
+/*
+ * Atonomi Device SDK: Compact Sessions
+ *
+ * Copyright (C) 2018 Atonomi
+ */
+#ifndef ATMI_COMPACT_H_
+#define ATMI_COMPACT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "atmi.h"
+
+
+/*
+ * Of a session's state[] buffer, only the CENTRI session data is needed
+ * between packing a request and unpacking its response; the rest (package
+ * pointers, lengths and the working buffer) matters only during a call.
+ * A compact session keeps just that data, in snapshot form (see
+ * atmi_snap.h), with the remainder held in a transient workspace on the
+ * stack of the pack and unpack routines below.
+ *
+ * Snapshots of freshly packed requests are 36 bytes for the prebuilt
+ * libraries of this release, so a compact session occupies 40 bytes in
+ * place of the 873 of an atmi_session_t on 64-bit targets.
+ */
+#define ATMI_SESSION_COMPACT_SIZE   (40u)
+
+
+/**
+ * Atonomi Compact Session
+ *
+ * Opaque. Contents are position-independent and may be copied or stored
+ * freely while awaiting a response.
+ */
+typedef struct {
+	uint8_t  len;
+	uint8_t  snap[ATMI_SESSION_COMPACT_SIZE - 1u];
+} atmi_session_compact_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Pack request messages, keeping only compact session data.
+ *
+ * As ATMIpack_*_request_into() (see atmi_zc.h), the packet is written at
+ * buf + headroom. About ATMI_SESSBUF_STATE_SIZE bytes of stack are used as
+ * a transient workspace.
+ *
+ * \param ctx      Location of Atonomi library context structure.
+ * \param cs       Location of compact session to populate.
+ * \param act/val/rep  Location of request descriptor.
+ * \param buf      Location of output buffer.
+ * \param nbuf     Size of output buffer in bytes.
+ * \param headroom Number of bytes to leave free at the start of buf.
+ *
+ * \return -EINVAL   Invalid arguments (bad pointers).
+ * \return -ENOSPC   Output buffer too small, or session data too large to
+ *                   compact (not the case with this release's libraries).
+ * \return -EFAULT   Could not encrypt message data (bad keys?).
+ * \return >0        Success. Number of packed bytes placed at buf+headroom.
+ */
+int ATMIpack_act_request_compact(const atmi_context_t *ctx,
+                                 atmi_session_compact_t *cs,
+                                 const atmi_act_request_t *act,
+                                 uint8_t *buf, size_t nbuf, size_t headroom);
+
+int ATMIpack_val_request_compact(const atmi_context_t *ctx,
+                                 atmi_session_compact_t *cs,
+                                 const atmi_val_request_t *val,
+                                 uint8_t *buf, size_t nbuf, size_t headroom);
+
+int ATMIpack_rep_request_compact(const atmi_context_t *ctx,
+                                 atmi_session_compact_t *cs,
+                                 const atmi_rep_request_t *rep,
+                                 uint8_t *buf, size_t nbuf, size_t headroom);
+
+/**
+ * Unpack response messages for requests packed with
+ * ATMIpack_*_request_compact().
+ *
+ * A transient workspace of about ATMI_SESSBUF_STATE_SIZE plus
+ * ATMI_SESSBUF_SIZE bytes is taken from the stack. The compact session is
+ * not modified. Arguments and return values are otherwise as for
+ * ATMIunpack_*, with -EBADF also returned for a corrupt compact session.
+ */
+int ATMIunpack_act_response_compact(const atmi_context_t *ctx,
+                                    const atmi_session_compact_t *cs,
+                                    const void *pinbuf, size_t nin,
+                                    atmi_act_response_t *act);
+
+int ATMIunpack_val_response_compact(const atmi_context_t *ctx,
+                                    const atmi_session_compact_t *cs,
+                                    const void *pinbuf, size_t nin,
+                                    atmi_val_response_t *val);
+
+int ATMIunpack_rep_response_compact(const atmi_context_t *ctx,
+                                    const atmi_session_compact_t *cs,
+                                    const void *pinbuf, size_t nin,
+                                    atmi_rep_response_t *rep);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*ATMI_COMPACT_H_*/
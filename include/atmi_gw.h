@@ -0,0 +1,166 @@
+/*
+ * Atonomi Device SDK: Multi-device Gateway
+ *
+ * Copyright (C) 2018 Atonomi
+ */
+#ifndef ATMI_GW_H_
+#define ATMI_GW_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "atmi.h"
+
+
+/*
+ * Size of the key identifying each in-flight request, the same as that of a
+ * CENTRI session ID.
+ */
+#define ATMI_GW_KEY_SIZE            PS_SESSION_ID_BYTES
+
+
+/**
+ * Atonomi Gateway
+ *
+ * Tracks requests packed on behalf of many devices until their responses
+ * arrive, so that a gateway need not keep an atmi_session_t per device.
+ * Each in-flight request holds a copy of its device's context and a
+ * compact session (see atmi_compact.h), about 128 bytes in all, in a table
+ * of fixed capacity allocated up front. Lookups are O(1).
+ *
+ * Requests cannot be routed by CENTRI session ID. A request's greeting
+ * carries no session ID: the IRN chooses one and sends it only in its
+ * response, which ATMIpeek_response() can read, but which matches nothing
+ * the gateway holds. Nor is anything else in a response's cleartext tied
+ * to its request. So the gateway gives each request a key of its own,
+ * unique within the gateway, and the caller passes this key back in along
+ * with the response, e.g. having remembered it against the HTTP request
+ * that carried the packet.
+ *
+ * All routines may be called concurrently from any number of threads. The
+ * table is split into independently locked stripes so that threads rarely
+ * contend. Building with ATMI_NO_THREADS defined removes all locking.
+ *
+ * The table is allocated from the heap, so building with ATMI_NO_HEAP
+ * defined omits this module.
+ */
+typedef struct atmi_gw atmi_gw_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Create a gateway.
+ *
+ * \param capacity  Maximum number of requests in flight at once.
+ *
+ * \return NULL      Invalid arguments or out of memory.
+ * \return gw        Location of new gateway.
+ */
+atmi_gw_t *ATMIgw_create(size_t capacity);
+
+/**
+ * Free a gateway, discarding any requests still in flight. No other call
+ * may be in progress on it.
+ *
+ * \param gw      Location of gateway to destroy. May be NULL.
+ */
+void ATMIgw_destroy(atmi_gw_t *gw);
+
+/**
+ * Report the number of requests currently in flight.
+ *
+ * \param gw      Location of gateway.
+ *
+ * \return count  Number of requests awaiting a response.
+ */
+size_t ATMIgw_inflight(atmi_gw_t *gw);
+
+
+/**
+ * Pack request messages on behalf of a device.
+ *
+ * The device's context is copied; it need not be kept by the caller.
+ *
+ * \param gw      Location of gateway.
+ * \param ctx     Location of device's Atonomi library context structure.
+ * \param act/val/rep  Location of request descriptor.
+ * \param key     Location in which to store the request's key.
+ * \param pkt     Location in which to store packed output.
+ * \param npkt    Size of output buffer. ATMI_SESSBUF_SIZE always suffices.
+ *
+ * \return -EINVAL   Invalid arguments (bad pointers).
+ * \return -ENOSPC   Gateway full, or output buffer too small.
+ * \return -EFAULT   Could not encrypt message data (bad keys?).
+ * \return >0        Success. Number of packed bytes placed in pkt.
+ */
+int ATMIgw_pack_act_request(atmi_gw_t *gw, const atmi_context_t *ctx,
+                            const atmi_act_request_t *act,
+                            uint8_t key[ATMI_GW_KEY_SIZE],
+                            uint8_t *pkt, size_t npkt);
+
+int ATMIgw_pack_val_request(atmi_gw_t *gw, const atmi_context_t *ctx,
+                            const atmi_val_request_t *val,
+                            uint8_t key[ATMI_GW_KEY_SIZE],
+                            uint8_t *pkt, size_t npkt);
+
+int ATMIgw_pack_rep_request(atmi_gw_t *gw, const atmi_context_t *ctx,
+                            atmi_rep_request_t *rep,
+                            uint8_t key[ATMI_GW_KEY_SIZE],
+                            uint8_t *pkt, size_t npkt);
+
+/**
+ * Unpack response messages, routing each to its request.
+ *
+ * The request is retired whatever the outcome, once found, as no other
+ * response to it will arrive. The framing of the input is first checked
+ * with ATMIpeek_response(), and input failing that check is rejected
+ * without decryption.
+ *
+ * \param gw      Location of gateway.
+ * \param key     Key of the request, as returned when it was packed.
+ * \param pinbuf  Location of packed input.
+ * \param nin     Length of packed input in bytes.
+ * \param act/val/rep  Location in which to store unpacked response.
+ *
+ * \return -ESRCH    No request in flight with this key.
+ * \return -EINVAL   Invalid arguments, or request was of another type.
+ * \return -ENOENT   Input is not a response of the request's type.
+ * \return -EBADF    Input framing is truncated or malformed.
+ * \return           Otherwise, as per the matching ATMIunpack_* routine.
+ */
+int ATMIgw_unpack_act_response(atmi_gw_t *gw,
+                               const uint8_t key[ATMI_GW_KEY_SIZE],
+                               const void *pinbuf, size_t nin,
+                               atmi_act_response_t *act);
+
+int ATMIgw_unpack_val_response(atmi_gw_t *gw,
+                               const uint8_t key[ATMI_GW_KEY_SIZE],
+                               const void *pinbuf, size_t nin,
+                               atmi_val_response_t *val);
+
+int ATMIgw_unpack_rep_response(atmi_gw_t *gw,
+                               const uint8_t key[ATMI_GW_KEY_SIZE],
+                               const void *pinbuf, size_t nin,
+                               atmi_rep_response_t *rep);
+
+/**
+ * Retire a request without a response, e.g. after a timeout.
+ *
+ * \param gw      Location of gateway.
+ * \param key     Key of the request.
+ *
+ * \return -EINVAL   Invalid arguments (bad pointers).
+ * \return -ESRCH    No request in flight with this key.
+ * \return 0         Success.
+ */
+int ATMIgw_cancel(atmi_gw_t *gw, const uint8_t key[ATMI_GW_KEY_SIZE]);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*ATMI_GW_H_*/
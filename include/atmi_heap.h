@@ -0,0 +1,78 @@
+/*
+ * Atonomi Device SDK: Heap-free Builds
+ *
+ * Copyright (C) 2018 Atonomi
+ */
+#ifndef ATMI_HEAP_H_
+#define ATMI_HEAP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*
+ * The Atonomi API itself never allocates: responses are decrypted directly
+ * into the session's packet[] buffer. Some CENTRI and NaCl routines within
+ * the prebuilt libraries do however request small, short-lived buffers via
+ * malloc() and free(), namely:
+ *
+ *  - one buffer of roughly 400 bytes while encoding each request, and
+ *  - on Cortex-M, one buffer of the message size plus 32 bytes per NaCl box
+ *    operation (several per pack, unpack and sign).
+ *
+ * No more than two are ever held at once by a single call. On targets with
+ * no heap, build the SDK sources with ATMI_NO_HEAP defined, and link the
+ * program with the linker options in ATMI_HEAP_LDFLAGS: all calls to
+ * malloc(), calloc(), realloc() and free() are then served from a small
+ * static pool of fixed-size blocks, without fragmentation, and no C library
+ * heap is linked. Allocation scans a bitmap of the pool's blocks, so takes
+ * time bounded by ATMI_HEAP_BLOCKS. Requests larger than a block, including
+ * any made by the application, are refused.
+ *
+ * The gateway, batch worker pool, HTTP transport and file-backed queue
+ * media (atmi_gw.h, atmi_batch.h, atmi_http.h, atmi_queue.h) need more
+ * memory than a pool block, so are left out of such builds: the gateway
+ * and HTTP transport entirely, while ATMIpool_create() always fails and
+ * ATMIqueue_media_file() returns -ENODEV.
+ *
+ * The pool is guarded by a spinlock, as threads may pack and unpack
+ * concurrently. On Cortex-M, where the critical section depends
+ * on the system, there is no lock by default: define ATMI_HEAP_LOCK() and
+ * ATMI_HEAP_UNLOCK() to provide one (masking interrupts, say) unless all
+ * calls into the library are serialized.
+ */
+#define ATMI_HEAP_LDFLAGS                                               \
+	"-Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free,"   \
+	"--undefined=ATMIpriv_heap_linked"
+
+#ifndef ATMI_HEAP_BLOCK_SIZE
+#define ATMI_HEAP_BLOCK_SIZE        (512u)
+#endif
+#ifndef ATMI_HEAP_BLOCKS
+#define ATMI_HEAP_BLOCKS            (4u)
+#endif
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Report the greatest number of pool blocks simultaneously in use, and the
+ * number of allocations refused, since startup. Only available when built
+ * with ATMI_NO_HEAP defined.
+ *
+ * \param nfailed Location in which to store count of refused allocations.
+ *                May be NULL.
+ *
+ * \return blocks High-water mark in blocks.
+ */
+unsigned ATMIheap_high_water(unsigned *nfailed);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*ATMI_HEAP_H_*/
@@ -0,0 +1,196 @@
+/*
+ * Atonomi Device SDK: HTTP/1.1 Transport
+ *
+ * Copyright (C) 2018 Atonomi
+ */
+#ifndef ATMI_HTTP_H_
+#define ATMI_HTTP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "atmi.h"
+
+
+/* IRN endpoints, used to select the request path. */
+enum {
+	ATMI_HTTP_ACT = 0,
+	ATMI_HTTP_VAL,
+	ATMI_HTTP_REP,
+	ATMI_HTTP_REP_MULTI,        /* Aggregated amendments (atmi_multi.h). */
+	ATMI_HTTP_NENDPOINTS
+};
+
+
+/**
+ * Atonomi HTTP Transport Configuration
+ *
+ * Unset (zero or NULL) fields take the defaults shown.
+ */
+typedef struct {
+	const char  *host;          /** IRN host name or address.
+	                                Default "device.atonomi.net".         */
+	uint16_t     port;          /** TCP port. Default 80.                 */
+	const char  *paths[ATMI_HTTP_NENDPOINTS];
+	                            /** Path of each endpoint. Default
+	                                "/activate", "/validate",
+	                                "/reputation" and
+	                                "/reputation/multi".                  */
+	unsigned     nconns;        /** Persistent connections. Default 4.    */
+	unsigned     depth;         /** Requests pipelined per connection.
+	                                Default 8.                            */
+	unsigned     timeout_ms;    /** Time allowed each request from
+	                                ATMIhttp_put() to its response.
+	                                Default 10000.                        */
+} atmi_http_config_t;
+
+
+/**
+ * Called once per request with its outcome. For a 200 response, body
+ * points to the packed response, ready for the matching ATMIunpack_*
+ * routine; it is only valid until the callback returns.
+ *
+ * \param arg       As passed to ATMIhttp_put().
+ * \param status    HTTP status code, or a negative error code if no
+ *                  response was received: -EPIPE if the connection was
+ *                  refused or lost, -EIO if the response was malformed,
+ *                  -EPROTO if its length was given neither by
+ *                  Content-Length nor by chunked transfer coding,
+ *                  -ETIMEDOUT if the request's timeout passed first.
+ * \param body      Location of response body.
+ * \param nbody     Length of response body in bytes.
+ * \param latency   Nanoseconds from ATMIhttp_put() to completion.
+ */
+typedef void (*atmi_http_done_fn)(void *arg, int status,
+                                  const uint8_t *body, size_t nbody,
+                                  uint64_t latency);
+
+
+/**
+ * Atonomi HTTP Transport
+ *
+ * Sends packed requests to the IRN as HTTP/1.1 PUTs over a pool of
+ * persistent, non-blocking connections, pipelining up to depth requests on
+ * each. Requests are queued by ATMIhttp_put() and all I/O and callbacks take
+ * place within ATMIhttp_poll(), so a single thread drives everything and no
+ * locking is needed. Connections are opened on demand and reopened after
+ * the server closes them.
+ *
+ * A request still unanswered when its timeout passes fails with
+ * -ETIMEDOUT. If it was sent, its connection is presumed dead (as when a
+ * NAT or load balancer drops it without a reset) and closed: the requests
+ * sent on it fail likewise, and those not yet sent are requeued.
+ *
+ * A server may close a keep-alive connection it finds idle just as new
+ * requests are sent on it. So when a connection that has already answered
+ * a request is closed or reset before any of the next response arrives,
+ * the requests outstanding on it are requeued, once, for a fresh
+ * connection, as PUT is idempotent; a request already retried fails with
+ * -EPIPE.
+ *
+ * Only available on Linux (epoll); building elsewhere, or with ATMI_NO_HEAP
+ * defined, omits this module.
+ * Plain HTTP only: TLS, if needed, must be provided by a proxy. Response
+ * bodies may be sent with a Content-Length or chunked; one delimited only
+ * by the server closing the connection is not supported.
+ */
+typedef struct atmi_http atmi_http_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Create an HTTP transport. The host name is resolved here, blocking.
+ *
+ * \param cfg     Location of configuration. May be NULL for all defaults.
+ *
+ * \return NULL      Host not resolved, or out of memory.
+ * \return http      Location of new transport.
+ */
+atmi_http_t *ATMIhttp_create(const atmi_http_config_t *cfg);
+
+/**
+ * Close all connections and free a transport. Callbacks of requests still
+ * outstanding are not called.
+ *
+ * \param http    Location of transport. May be NULL.
+ */
+void ATMIhttp_destroy(atmi_http_t *http);
+
+/**
+ * Queue a packed request for sending. The packet is copied.
+ *
+ * \param http    Location of transport.
+ * \param ep      Endpoint: ATMI_HTTP_ACT, ATMI_HTTP_VAL, ATMI_HTTP_REP or
+ *                ATMI_HTTP_REP_MULTI.
+ * \param pkt     Location of packed request.
+ * \param npkt    Length of packed request in bytes.
+ * \param done    Completion callback.
+ * \param arg     Argument passed to completion callback.
+ *
+ * \return -EINVAL   Invalid arguments.
+ * \return -ENOMEM   Out of memory.
+ * \return 0         Success.
+ */
+int ATMIhttp_put(atmi_http_t *http, unsigned ep, const void *pkt, size_t npkt,
+                 atmi_http_done_fn done, void *arg);
+
+/**
+ * Queue a request packed in place for sending, without copying it.
+ *
+ * The packet must lie at buf + headroom, as left by the
+ * ATMIpack_*_request_into() routines of atmi_zc.h; the HTTP header is
+ * written into the headroom ahead of it by ATMIframe_http_put(), and the
+ * frame is sent from there. ATMI_HTTP_HEADROOM suffices for host names of
+ * typical length. The buffer belongs to the transport until the request's
+ * callback is called (or the transport destroyed), and must not be changed
+ * or freed before then. Request records are recycled, so once warmed up
+ * this allocates nothing.
+ *
+ * \param http     Location of transport.
+ * \param ep       Endpoint, as for ATMIhttp_put().
+ * \param buf      Location of buffer holding headroom and packet.
+ * \param headroom Number of bytes free ahead of the packet.
+ * \param npkt     Length of packed request in bytes.
+ * \param done     Completion callback.
+ * \param arg      Argument passed to completion callback.
+ *
+ * eturn -EINVAL   Invalid arguments.
+ * eturn -ENOSPC   Header does not fit within headroom.
+ * eturn -ENOMEM   Out of memory.
+ * eturn 0         Success.
+ */
+int ATMIhttp_put_into(atmi_http_t *http, unsigned ep, uint8_t *buf,
+                      size_t headroom, size_t npkt,
+                      atmi_http_done_fn done, void *arg);
+
+/**
+ * Perform pending I/O, calling completion callbacks as responses arrive.
+ *
+ * \param http       Location of transport.
+ * \param timeout_ms Longest time to wait for I/O; -1 to wait indefinitely,
+ *                   0 to not wait at all. Waits end early when the timeout
+ *                   of an outstanding request passes.
+ *
+ * \return -EINVAL   Invalid arguments.
+ * \return >=0       Number of requests completed.
+ */
+int ATMIhttp_poll(atmi_http_t *http, int timeout_ms);
+
+/**
+ * Report the number of requests queued or awaiting a response.
+ *
+ * \param http    Location of transport.
+ *
+ * \return count  Number of outstanding requests.
+ */
+size_t ATMIhttp_outstanding(const atmi_http_t *http);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*ATMI_HTTP_H_*/
@@ -0,0 +1,82 @@
+/*
+ * Atonomi Device SDK: Precomputed Key Exchange
+ *
+ * Copyright (C) 2018 Atonomi
+ */
+#ifndef ATMI_KEYX_H_
+#define ATMI_KEYX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "atmi.h"
+
+
+/*
+ * Shared keys computed ahead of time.
+ *
+ * Every CENTRI greeting is boxed between the device's own key pair and the
+ * IRN session manager's public key, and every response is opened with the
+ * same pair; the IRN identifies the device by the public key the greeting
+ * carries, so no ephemeral key pair is involved. The Curve25519 scalar
+ * multiplication deriving the shared key nonetheless runs again on every
+ * pack and unpack, and dominates their cost, on Cortex-M especially.
+ *
+ * ATMIkeyx_precompute() performs that multiplication once, e.g. at boot,
+ * during idle time or from a low-priority task, and holds the result in a
+ * small table of ATMI_KEYX_SLOTS entries. Programs linked with the linker
+ * options in ATMI_KEYX_LDFLAGS then take the shared key from the table
+ * within the prebuilt library's key derivation, falling back to computing
+ * it inline for key pairs not held. Output is unchanged either way.
+ *
+ * Lookups are lock-free and may run on any thread alongside precomputation
+ * on another.
+ */
+#ifndef ATMI_KEYX_SLOTS
+#define ATMI_KEYX_SLOTS             (4u)
+#endif
+
+#define ATMI_KEYX_LDFLAGS                                               \
+	"-Wl,--wrap=crypto_box_curve25519xsalsa20poly1305_beforenm,"     \
+	"--undefined=ATMIpriv_keyx_linked"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Compute the shared key between a device and the IRN, and hold it for use
+ * by subsequent ATMIpack* and ATMIunpack* calls with this context. When
+ * all slots are taken, the one filled longest ago is replaced.
+ *
+ * The table holds copies of the device's private key, so that lookups may
+ * match on it. Remove them via ATMIkeyx_forget() or ATMIkeyx_clear().
+ *
+ * \param ctx     Location of Atonomi library context structure.
+ *
+ * \return -EINVAL   Invalid arguments (bad pointers).
+ * \return -ENODEV   Not linked with ATMI_KEYX_LDFLAGS.
+ * \return -EFAULT   Key derivation failed (bad keys?).
+ * \return 0         Success. Shared key held.
+ */
+int ATMIkeyx_precompute(const atmi_context_t *ctx);
+
+/**
+ * Remove the shared key held for a context, if any.
+ *
+ * \param ctx     Location of Atonomi library context structure.
+ */
+void ATMIkeyx_forget(const atmi_context_t *ctx);
+
+/**
+ * Remove all held shared keys.
+ */
+void ATMIkeyx_clear(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*ATMI_KEYX_H_*/
@@ -0,0 +1,55 @@
+/*
+ * Atonomi Device SDK: Multi-threaded Use
+ *
+ * Copyright (C) 2018 Atonomi
+ */
+#ifndef ATMI_MT_H_
+#define ATMI_MT_H_
+
+#include "atmi.h"
+
+
+/*
+ * Process-wide state touched by the prebuilt library.
+ *
+ * The pack, unpack and signing routines are reentrant (see atmi.h), and
+ * share nothing between threads but the source of entropy. Where that is
+ * reached through libsodium (x86-64 and Cortex-A), each draw first calls
+ * sodium_init(), which takes a process-wide spinlock even once libsodium
+ * is initialized, and sleeps when it finds the lock taken: with many
+ * threads packing, they queue on it.
+ *
+ * ATMImt_init() performs libsodium's one-time initialization up front.
+ * Programs linked with the linker options in ATMI_MT_LDFLAGS then return
+ * from every later sodium_init() call at once, without taking the lock.
+ * Together with a per-thread source of entropy (ATMIrng_set_thread(), or
+ * the DRBG of ATMIrng_set_source() with ATMIrng_install(); see atmi_rng.h),
+ * threads then share no mutable state at all within these routines.
+ */
+#define ATMI_MT_LDFLAGS                                                 \
+	"-Wl,--wrap=sodium_init,--undefined=ATMIpriv_mt_linked"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Perform the library's one-time initialization. Call this once, before
+ * starting threads that call into the library.
+ *
+ * \return -EFAULT   libsodium could not be initialized.
+ * \return 0         Success, but each draw of entropy still takes
+ *                   libsodium's lock (not linked with ATMI_MT_LDFLAGS).
+ * \return 1         Success. Draws of entropy take no lock (linked with
+ *                   ATMI_MT_LDFLAGS, or a target without libsodium).
+ */
+int ATMImt_init(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*ATMI_MT_H_*/
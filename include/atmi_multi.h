@@ -0,0 +1,116 @@
+/*
+ * Atonomi Device SDK: Aggregated Reputation Amendments
+ *
+ * Copyright (C) 2018 Atonomi
+ */
+#ifndef ATMI_MULTI_H_
+#define ATMI_MULTI_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "atmi.h"
+#include "atmi_zc.h"
+
+
+/*
+ * Many reputation amendments in one request.
+ *
+ * ATMIpack_rep_request() sends one amendment per greeting, and each request
+ * on its own round trip, so a device reporting on n peers pays for n
+ * envelopes and n round trips. ATMIpack_rep_request_multi() instead packs
+ * up to ATMI_MULTI_MAX amendments, all made by the same requestor, into a
+ * single request for the ATMI_HTTP_REP_MULTI endpoint (see atmi_http.h).
+ *
+ * A CENTRI greeting carries at most 220 bytes of message, so amendments are
+ * grouped ATMI_MULTI_PER_PKG to a greeting: each greeting's message holds
+ * the requestor's Device ID once, followed by the subject's Device ID,
+ * reputation token and comms flags of each of its amendments. The request
+ * is the run of ATMI_MULTI_NPKG(n) greetings, back to back; each packet is
+ * delimited by the envelope length in its own header. The IRN answers with
+ * a run of as many packets, in the same order, each holding one result per
+ * amendment.
+ *
+ * Each greeting opens its own session, so one session state is kept per
+ * greeting. The key exchange is the same for all of them, and is best done
+ * once ahead of time with ATMIkeyx_precompute() (see atmi_keyx.h).
+ */
+#define ATMI_MULTI_PER_PKG          (3u)
+
+#ifndef ATMI_MULTI_MAX
+#define ATMI_MULTI_MAX              (16u * ATMI_MULTI_PER_PKG)
+#endif
+
+/* Number of greetings, and session states, for n amendments. */
+#define ATMI_MULTI_NPKG(n)                                              \
+	(((n) + ATMI_MULTI_PER_PKG - 1u) / ATMI_MULTI_PER_PKG)
+
+/* Exact length of a packed request of n amendments. */
+#define ATMI_PKTLEN_REP_MULTI_REQ(n)                                    \
+	((size_t)199u * ATMI_MULTI_NPKG(n) + (size_t)51u * (n))
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Pack request message: Reputation Amendments, aggregated.
+ *
+ * \note          Ensure at least 4400 bytes of stack space are available.
+ *
+ * \param ctx      Location of Atonomi library context structure.
+ * \param ssts     Location of array of ATMI_MULTI_NPKG(n) session states.
+ *                 Must be preserved for unpacking the response.
+ * \param reps     Location of array of reputation request descriptors.
+ *                 All must share the same id_requestor.
+ * \param n        Number of descriptors, 1 to ATMI_MULTI_MAX.
+ * \param buf      Location of output buffer.
+ * \param nbuf     Size of output buffer in bytes. Must be at least headroom
+ *                 plus ATMI_PKTLEN_REP_MULTI_REQ(n).
+ * \param headroom Number of bytes to leave free at the start of buf.
+ *
+ * \return -EINVAL   Invalid arguments (bad pointers or count, or differing
+ *                   requestors).
+ * \return -ENOSPC   Output buffer too small.
+ * \return -EFAULT   Could not encrypt message data (bad keys?).
+ * \return >0        Success. Number of packed bytes placed at buf+headroom.
+ */
+int ATMIpack_rep_request_multi(const atmi_context_t *ctx,
+                               atmi_ssnstate_t ssts[],
+                               const atmi_rep_request_t reps[], size_t n,
+                               uint8_t *buf, size_t nbuf, size_t headroom);
+
+/**
+ * Unpack response message: Reputation Amendments, aggregated.
+ *
+ * Each packet of the response is unpacked as by ATMIunpack_*_state(). The
+ * result of each amendment in a packet that unpacks is stored in the
+ * corresponding element of reps; each amendment in a packet that does not
+ * has the packet's error code (as per ATMIunpack_*) stored as its success
+ * code instead.
+ *
+ * \param ctx     Location of Atonomi library context structure.
+ * \param ssts    Location of array of session states, as preserved from
+ *                the call to pack the corresponding request.
+ * \param pinbuf  Location of received input message in which to unpack.
+ * \param nin     Length of received input in bytes.
+ * \param reps    Location of array in which to store the result of each
+ *                amendment, in the order they were packed.
+ * \param n       Number of amendments packed in the request.
+ *
+ * \return -EINVAL   Invalid arguments (bad pointers or count).
+ * \return -EBADF    Input is not a run of ATMI_MULTI_NPKG(n) packets.
+ * \return count     Number of amendments whose results were received.
+ */
+int ATMIunpack_rep_response_multi(const atmi_context_t *ctx,
+                                  atmi_ssnstate_t ssts[],
+                                  const void *pinbuf, size_t nin,
+                                  atmi_rep_response_t reps[], size_t n);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*ATMI_MULTI_H_*/
@@ -0,0 +1,74 @@
+/*
+ * Atonomi Device SDK: Response Inspection
+ *
+ * Copyright (C) 2018 Atonomi
+ */
+#ifndef ATMI_PEEK_H_
+#define ATMI_PEEK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "atmi.h"
+
+
+/* CENTRI package types, as reported in atmi_peek_t.pkgtype. */
+#define ATMI_PKG_GREETING           (0u)
+#define ATMI_PKG_STOP               (3u)
+#define ATMI_PKG_TYPE_MAX           (4u)
+
+
+/**
+ * Atonomi Packet Summary
+ *
+ * Cleartext fields of a received packet, as found by ATMIpeek_response().
+ * Pointers refer into the packet itself.
+ */
+typedef struct {
+	uint8_t         type;       /** ATMI message type, e.g. 'a' for an
+	                                activation response.                  */
+	uint8_t         pkgtype;    /** CENTRI package type (ATMI_PKG_*).     */
+	size_t          nplain;     /** Declared length of the decrypted
+	                                envelope, or zero if not declared.    */
+	size_t          nbody;      /** Length of the encrypted body.         */
+	const uint8_t  *sid;        /** Cleartext session ID, or NULL.        */
+	size_t          nsid;       /** Length of session ID.                 */
+} atmi_peek_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Check the framing of a received packet without decrypting it.
+ *
+ * Parses the ATMI header and the cleartext CENTRI framing of the envelope,
+ * taking time proportional only to the number of framing fields. Neither
+ * keys nor session state are used. Only truncation and attributes that
+ * overrun the packet are rejected in the envelope: its version byte and
+ * package type are reported but not checked. A packet rejected here would
+ * also be rejected by the ATMIunpack_* routines, so it may be dropped
+ * without spending a decryption on it; one that passes may still fail to
+ * unpack.
+ *
+ * \param pinbuf  Location of received packet.
+ * \param nin     Length of received packet.
+ * \param out     Location in which to store summary. May be NULL.
+ *
+ * \return -EINVAL   Invalid arguments (bad pointers or length). As for
+ *                   ATMIunpack_*, the packet must be longer than its
+ *                   5-byte header and no more than ATMI_SESSBUF_SIZE
+ *                   bytes longer.
+ * \return -ENOENT   Not an ATMI response or stop packet.
+ * \return -EBADF    Envelope truncated, or an attribute overruns it.
+ * \return 0         Success. Summary written to out.
+ */
+int ATMIpeek_response(const void *pinbuf, size_t nin, atmi_peek_t *out);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*ATMI_PEEK_H_*/
@@ -0,0 +1,125 @@
+/*
+ * Atonomi Device SDK: Persistent Sessions
+ *
+ * Copyright (C) 2018 Atonomi
+ */
+#ifndef ATMI_PERSIST_H_
+#define ATMI_PERSIST_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "atmi.h"
+
+
+/*
+ * Each regular ATMIpack* call opens a new CENTRI Protected Session with a
+ * greeting of about 200 bytes of envelope, boxed between the device's own
+ * key pair and the IRN's public key (see atmi_keyx.h for the cost of
+ * that). Once the response to that greeting has been unpacked, the session
+ * is established and may instead be kept and reused: later requests are
+ * sent as data packages, which carry only 40 bytes or so of overhead.
+ *
+ * Usage:
+ *
+ *  1. Pack and unpack the first request of any type with the regular
+ *     routines in atmi.h. On success, retain the atmi_session_t rather than
+ *     discarding it.
+ *  2. Pack further requests with the ATMIpack_*_data() routines below and
+ *     unpack their responses with the matching ATMIunpack_*_data() routines,
+ *     always using the same session.
+ *  3. When done, pack a stop package with ATMIpack_stop(), send it, and
+ *     discard the session.
+ *
+ * If any step fails, or the IRN stops the session itself (reported as
+ * -EPIPE), discard the session and start over from step 1. The session's
+ * packet[] buffer is used as for the regular routines, and the same stack
+ * requirements apply.
+ *
+ * \note Reuse of sessions must be supported by the IRN endpoint. The
+ *       Atonomi protocol defines no message type for stop packages: the
+ *       'S' used here, and expected of stops from the IRN, is an
+ *       extension of this SDK's own that has not been confirmed against
+ *       any IRN deployment.
+ */
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Pack request messages as data packages on an established session.
+ *
+ * \param ctx     Location of Atonomi library context structure.
+ * \param ssn     Location of session established by a prior successful
+ *                unpack.
+ * \param act/val/rep  Location of request descriptor.
+ *
+ * \return -EINVAL   Invalid arguments (bad pointers).
+ * \return -EPIPE    Session not established.
+ * \return -EFAULT   Could not encrypt message data (bad keys?).
+ * \return >0        Success. Number of packed bytes placed in ssn->packet.
+ */
+int ATMIpack_act_data(const atmi_context_t *ctx, atmi_session_t *ssn,
+                      const atmi_act_request_t *act);
+
+int ATMIpack_val_data(const atmi_context_t *ctx, atmi_session_t *ssn,
+                      const atmi_val_request_t *val);
+
+int ATMIpack_rep_data(const atmi_context_t *ctx, atmi_session_t *ssn,
+                      const atmi_rep_request_t *rep);
+
+/**
+ * Unpack response messages received on an established session.
+ *
+ * \param ctx     Location of Atonomi library context structure.
+ * \param ssn     Location of session used to pack the request.
+ * \param pinbuf  Location of packed input.
+ * \param nin     Length of packed input in bytes.
+ * \param act/val/rep  Location in which to store unpacked response.
+ *
+ * \return -EINVAL   Invalid arguments (bad pointers or input length).
+ * \return -ENOENT   Input does not contain an expected Atonomi packet.
+ * \return -EBADF    Packet found but could not be properly unpacked.
+ * \return -EFAULT   Packet found but encrypted payload was bad.
+ * \return -EPIPE    IRN stopped the session. Discard it.
+ * \return 0         Success.
+ */
+int ATMIunpack_act_data(const atmi_context_t *ctx, atmi_session_t *ssn,
+                        const void *pinbuf, size_t nin,
+                        atmi_act_response_t *act);
+
+int ATMIunpack_val_data(const atmi_context_t *ctx, atmi_session_t *ssn,
+                        const void *pinbuf, size_t nin,
+                        atmi_val_response_t *val);
+
+int ATMIunpack_rep_data(const atmi_context_t *ctx, atmi_session_t *ssn,
+                        const void *pinbuf, size_t nin,
+                        atmi_rep_response_t *rep);
+
+/**
+ * Pack a stop package, closing a session.
+ *
+ * The session may not be used afterwards, other than to send the packed
+ * output from its packet[] buffer. A session whose greeting has been sent
+ * but not yet answered may also be stopped this way.
+ *
+ * \param ctx     Location of Atonomi library context structure.
+ * \param ssn     Location of session.
+ * \param reason  Reason code passed on to the IRN. Zero for normal closure.
+ *
+ * \return -EINVAL   Invalid arguments (bad pointers).
+ * \return -EPIPE    No session open.
+ * \return -EFAULT   Could not encrypt stop package.
+ * \return >0        Success. Number of packed bytes placed in ssn->packet.
+ */
+int ATMIpack_stop(const atmi_context_t *ctx, atmi_session_t *ssn,
+                  uint8_t reason);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*ATMI_PERSIST_H_*/
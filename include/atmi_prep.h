@@ -0,0 +1,162 @@
+/*
+ * Atonomi Device SDK: Prepared Contexts
+ *
+ * Copyright (C) 2018 Atonomi
+ */
+#ifndef ATMI_PREP_H_
+#define ATMI_PREP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "atmi.h"
+
+
+/**
+ * Atonomi Prepared Library Context
+ *
+ * Holds a device's keys along with key material derived from them once up
+ * front, so it need not be recomputed on every call. Namely, this caches
+ * the Curve25519 shared key between the device and the IRN session manager
+ * (the result of the scalar multiplication that otherwise dominates the
+ * cost of cross-signing a Device ID).
+ *
+ * The embedded atmi_context_t may be passed to any of the regular ATMIpack*
+ * and ATMIunpack* routines. Those box and open every greeting with this
+ * same shared key, but derive it within the prebuilt library. In programs
+ * linked with ATMI_KEYX_LDFLAGS, preparing a context also holds its shared
+ * key in the table of atmi_keyx.h, as ATMIkeyx_precompute() would, so that
+ * they too skip the multiplication; otherwise they are not sped up.
+ *
+ * As with atmi_context_t, this contains private key material. Clear it via
+ * ATMIcontext_release() once it is no longer needed, which also removes
+ * the shared key from that table.
+ */
+typedef struct {
+	atmi_context_t  ctx;            /** Device keys, as provided.        */
+	uint8_t         boxkey[32];     /** Shared key with the IRN server.  */
+	uint32_t        prepared;       /** Nonzero once prepared.           */
+} atmi_prepared_context_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Prepare a library context, deriving and caching key material.
+ *
+ * \param pctx    Location of prepared context to populate.
+ * \param ctx     Location of Atonomi library context structure.
+ *
+ * \return -EINVAL   Invalid arguments (bad pointers).
+ * \return -EFAULT   Key derivation failed (bad keys?).
+ * \return 0         Success.
+ */
+int ATMIcontext_prepare(atmi_prepared_context_t *pctx,
+                        const atmi_context_t *ctx);
+
+/**
+ * Clear all key material held in a prepared context.
+ *
+ * \param pctx    Location of prepared context. May be NULL.
+ */
+void ATMIcontext_release(atmi_prepared_context_t *pctx);
+
+/**
+ * Sign the provided Device ID using a prepared context.
+ *
+ * Output is interchangeable with that of ATMIsign_device_id(), but skips
+ * the per-call key exchange.
+ *
+ * \param pctx      Location of prepared context.
+ * \param idsgn_out Location in which to store signed Device ID output.
+ *                  This output is 72 bytes in length.
+ * \param devid_in  Location of input Device ID to be signed.
+ *                  This input is 32 bytes in length.
+ *
+ * \return -EINVAL   Invalid arguments (bad pointers or unprepared context).
+ * \return -EFAULT   Signing procedure failed.
+ * \return 0         Success. Signed Device ID written to \param idsgn_out.
+ */
+int ATMIsign_device_id_prepared(const atmi_prepared_context_t *pctx,
+                                uint8_t       idsgn_out[72],
+                                const uint8_t devid_in [32]);
+
+/**
+ * Sign n Device IDs using a prepared context.
+ *
+ * Output is as for ATMIsign_device_id_prepared() applied to each element,
+ * but on x86-64 hosts supporting AVX2 eight IDs are processed at once.
+ *
+ * \param pctx       Location of prepared context.
+ * \param idsgns_out Location of n signed Device ID outputs.
+ * \param devids_in  Location of n input Device IDs.
+ * \param n          Number of Device IDs to sign.
+ *
+ * \return -EINVAL   Invalid arguments (bad pointers or unprepared context).
+ * \return 0         Success. All signed Device IDs written.
+ */
+int ATMIsign_device_id_batch(const atmi_prepared_context_t *pctx,
+                             uint8_t       idsgns_out[][72],
+                             const uint8_t devids_in[][32], size_t n);
+
+/**
+ * Check that a cross-signed Device ID is one this device issued.
+ *
+ * \note This is a self-check, not verification of another device's
+ *       signature. Cross-signed IDs are sealed for the IRN server: they
+ *       are authenticated with the key shared between the signing device
+ *       and the IRN, so no third party (such as a hub forwarding requests)
+ *       can check them, and a signature by any other device fails with
+ *       -EBADF. These routines let the signing device itself confirm that
+ *       a cross-signed ID is one it issued for devid_in, e.g. before
+ *       vouching for it again or after retrieving it from storage.
+ *
+ * \param ctx       Location of Atonomi library context structure of the
+ *                  device which signed the ID.
+ * \param idsgn_in  Location of signed Device ID (72 bytes).
+ * \param devid_in  Location of the Device ID expected within (32 bytes).
+ *
+ * \return -EINVAL   Invalid arguments (bad pointers).
+ * \return -EFAULT   Key derivation failed (bad keys?).
+ * \return -EBADF    Signature is not a cross-signature of devid_in by ctx.
+ * \return 0         Success. Signature is ctx's own.
+ */
+int ATMIcheck_own_device_id(const atmi_context_t *ctx,
+                            const uint8_t idsgn_in[72],
+                            const uint8_t devid_in[32]);
+
+/**
+ * Check a cross-signed Device ID using a prepared context, as for
+ * ATMIcheck_own_device_id() but without the per-call key exchange.
+ *
+ * \return -EINVAL   Invalid arguments (bad pointers or unprepared context).
+ * \return -EBADF    Signature is not a cross-signature of devid_in.
+ * \return 0         Success. Signature is the device's own.
+ */
+int ATMIcheck_own_device_id_prepared(const atmi_prepared_context_t *pctx,
+                                     const uint8_t idsgn_in[72],
+                                     const uint8_t devid_in[32]);
+
+/**
+ * Check n cross-signed Device IDs using a prepared context.
+ *
+ * The result of ATMIcheck_own_device_id_prepared() for element i is stored
+ * in status[i]. As for ATMIsign_device_id_batch(), AVX2 is used where
+ * available.
+ *
+ * \return -EINVAL   Invalid arguments (bad pointers or unprepared context).
+ * \return count     Number of signatures found to be the device's own.
+ */
+int ATMIcheck_own_device_id_batch(const atmi_prepared_context_t *pctx,
+                                  const uint8_t idsgns_in[][72],
+                                  const uint8_t devids_in[][32],
+                                  size_t n, int status[]);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*ATMI_PREP_H_*/
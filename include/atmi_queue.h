@@ -0,0 +1,238 @@
+/*
+ * Atonomi Device SDK: Store-and-Forward Queue
+ *
+ * Copyright (C) 2018 Atonomi
+ */
+#ifndef ATMI_QUEUE_H_
+#define ATMI_QUEUE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "atmi.h"
+
+
+/*
+ * Persistent queue of activation and reputation requests awaiting a link.
+ *
+ * A device that is offline records each request as it arises, and when the
+ * link returns reads the oldest of them back in batches, packs and sends
+ * each batch (reputation amendments by the same requestor may go in one
+ * request with ATMIpack_rep_request_multi(), see atmi_multi.h), and then
+ * removes the batch from the queue. Requests are stored as descriptors, not
+ * packets: each is packed only when it is sent, in a fresh session.
+ *
+ * The queue is an append-only log on a ring of erasable pages, written as
+ * NOR flash is: a page is erased as a whole, to all 0xff bytes, and each
+ * byte is then programmed at most once. Each record, a type byte, the
+ * request (32 bytes for activation, 81 for reputation with both comms flags
+ * in one byte) and a check byte, is programmed once and never modified;
+ * removing requests appends a checkpoint record holding the position of the
+ * oldest request remaining. A page is erased for reuse only once all it
+ * holds has been removed. On opening, the queue is recovered by reading the
+ * pages back: a record torn by a reset fails its check and ends its page,
+ * and requests removed before the last checkpoint are not read again.
+ * Requests removed by a call to ATMIqueue_commit() that did not complete
+ * may be read again, and so sent twice.
+ *
+ * The storage is reached through the page operations of an
+ * atmi_queue_media_t: an MCU supplies its own flash driver, while on Linux
+ * ATMIqueue_media_file() backs the pages with a memory-mapped file.
+ *
+ * One page is kept in reserve for checkpoints, so a queue holds
+ * npages - 2 pages of requests, of about (page_size - 8) / 83 reputation
+ * amendments each.
+ *
+ * Queues are not internally synchronized; calls on one queue must be
+ * serialized.
+ */
+#define ATMI_QUEUE_ACT              ('A')
+#define ATMI_QUEUE_REP              ('R')
+
+#define ATMI_QUEUE_MIN_PAGES        (3u)
+#define ATMI_QUEUE_MIN_PAGE_SIZE    (128u)
+
+
+/**
+ * Atonomi Queue Media
+ *
+ * Page operations on the storage, each returning 0 on success or a
+ * negative error code, which is passed on to the caller of the queue
+ * function. Offsets are in bytes from the start of the page.
+ */
+typedef struct {
+	int (*read) (void *arg, uint32_t page, uint32_t off, void *p, size_t n);
+	int (*prog) (void *arg, uint32_t page, uint32_t off, const void *p,
+	             size_t n);         /** Program erased bytes, in order.  */
+	int (*erase)(void *arg, uint32_t page); /** Set all bytes to 0xff.   */
+	int (*sync) (void *arg);        /** Make programmed data durable, or
+	                                    NULL if programming already is.   */
+	void      *arg;                 /** Passed to each operation.        */
+	uint32_t   page_size;           /** Size of erasable page in bytes.  */
+	uint32_t   npages;              /** Number of pages.                 */
+} atmi_queue_media_t;
+
+/**
+ * Atonomi Queue
+ *
+ * All fields are internal.
+ */
+typedef struct {
+	atmi_queue_media_t  m;
+	uint32_t            head_seq, head_off;     /* Oldest request.    */
+	uint32_t            tail_seq, tail_off;     /* Next record.       */
+	uint32_t            npending;
+} atmi_queue_t;
+
+/**
+ * Queued request, as read back by ATMIqueue_peek().
+ */
+typedef struct {
+	uint8_t  type;                  /** ATMI_QUEUE_ACT or ATMI_QUEUE_REP. */
+	union {
+		atmi_act_request_t  act;
+		atmi_rep_request_t  rep;
+	} req;
+} atmi_queue_item_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Open a queue, recovering the requests pending on its media.
+ *
+ * Media holding no queue, such as new or blank storage, open as an empty
+ * queue; nothing is erased until needed.
+ *
+ * \param q       Location of queue.
+ * \param m       Location of media description, which is copied. Requires
+ *                at least ATMI_QUEUE_MIN_PAGES pages of at least
+ *                ATMI_QUEUE_MIN_PAGE_SIZE bytes.
+ *
+ * \return -EINVAL   Invalid arguments (bad pointers or geometry).
+ * \return <0        Error returned by a media operation.
+ * \return count     Success. Number of requests pending.
+ */
+int ATMIqueue_open(atmi_queue_t *q, const atmi_queue_media_t *m);
+
+/**
+ * Append an activation request to the queue.
+ *
+ * The request is programmed but, for media with a sync operation, may not
+ * survive a power loss until ATMIqueue_sync() has been called.
+ *
+ * \param q       Location of queue.
+ * \param act     Location of activation request descriptor.
+ *
+ * \return -EINVAL   Invalid arguments (bad pointers).
+ * \return -ENOSPC   Queue full.
+ * \return <0        Error returned by a media operation.
+ * \return 0         Success.
+ */
+int ATMIqueue_put_act(atmi_queue_t *q, const atmi_act_request_t *act);
+
+/**
+ * Append a reputation request to the queue, as by ATMIqueue_put_act().
+ *
+ * The comms flags are stored as 0 or 1.
+ *
+ * \param q       Location of queue.
+ * \param rep     Location of reputation request descriptor.
+ *
+ * \return -EINVAL   Invalid arguments (bad pointers).
+ * \return -ENOSPC   Queue full.
+ * \return <0        Error returned by a media operation.
+ * \return 0         Success.
+ */
+int ATMIqueue_put_rep(atmi_queue_t *q, const atmi_rep_request_t *rep);
+
+/**
+ * Read the oldest pending requests, without removing them.
+ *
+ * \param q       Location of queue.
+ * \param items   Location of array in which to store the requests, oldest
+ *                first.
+ * \param n       Maximum number of requests to read.
+ *
+ * \return -EINVAL   Invalid arguments (bad pointers).
+ * \return <0        Error returned by a media operation.
+ * \return count     Success. Number of requests stored in items.
+ */
+int ATMIqueue_peek(atmi_queue_t *q, atmi_queue_item_t items[], size_t n);
+
+/**
+ * Remove the oldest pending requests, once sent, and checkpoint the queue.
+ *
+ * The checkpoint is synced to the media before returning. In the one case
+ * of a reset having torn a record in the page kept for checkpoints, while
+ * the queue was full, the checkpoint waits for a later commit that frees a
+ * page, and the requests removed may be read again after another reset.
+ *
+ * \param q       Location of queue.
+ * \param n       Number of requests to remove; at most the number pending.
+ *
+ * \return -EINVAL   Invalid arguments (bad pointer or count).
+ * \return <0        Error returned by a media operation.
+ * \return 0         Success.
+ */
+int ATMIqueue_commit(atmi_queue_t *q, size_t n);
+
+/**
+ * Make all requests appended so far durable, on media with a sync
+ * operation.
+ *
+ * \param q       Location of queue.
+ *
+ * \return -EINVAL   Invalid arguments (bad pointer).
+ * \return <0        Error returned by a media operation.
+ * \return 0         Success.
+ */
+int ATMIqueue_sync(atmi_queue_t *q);
+
+/**
+ * Number of requests pending in a queue.
+ *
+ * \param q       Location of queue.
+ *
+ * \return count     Number of requests pending, or zero for a bad pointer.
+ */
+size_t ATMIqueue_pending(const atmi_queue_t *q);
+
+
+/**
+ * Describe media backed by a memory-mapped file (Linux only, and not in
+ * ATMI_NO_HEAP builds).
+ *
+ * The file is created if need be, and sized to npages * page_size bytes.
+ * Its contents survive the process ending at any point; ATMIqueue_sync()
+ * and ATMIqueue_commit() write them back to the file with msync().
+ *
+ * \param m         Location in which to store the media description.
+ * \param path      Path of file.
+ * \param page_size Size of page in bytes.
+ * \param npages    Number of pages.
+ *
+ * \return -EINVAL   Invalid arguments (bad pointers or geometry).
+ * \return -EIO      Could not open, size or map the file.
+ * \return -ENOMEM   Out of memory.
+ * \return -ENODEV   Not supported on this platform.
+ * \return 0         Success.
+ */
+int ATMIqueue_media_file(atmi_queue_media_t *m, const char *path,
+                         uint32_t page_size, uint32_t npages);
+
+/**
+ * Unmap and close media described by ATMIqueue_media_file().
+ *
+ * \param m       Location of media description.
+ */
+void ATMIqueue_media_file_close(atmi_queue_media_t *m);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*ATMI_QUEUE_H_*/
@@ -0,0 +1,113 @@
+/*
+ * Atonomi Device SDK: Entropy Sources
+ *
+ * Copyright (C) 2018 Atonomi
+ */
+#ifndef ATMI_RNG_H_
+#define ATMI_RNG_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "atmi.h"
+
+
+/*
+ * Routing of the entropy used by the SDK.
+ *
+ * By default every request for entropy is passed straight to ATMI_memrand()
+ * (see atmi.h), in as many small pieces as the library asks for. Requests
+ * made through ATMIrng_fill() may instead be served by:
+ *
+ *  - a function registered for the calling thread with ATMIrng_set_thread();
+ *    otherwise
+ *  - a ChaCha20 DRBG, if enabled with ATMIrng_set_source() and the flag
+ *    ATMI_RNG_DRBG. Each thread keeps its own generator, reseeded from the
+ *    source every ATMI_RNG_RESEED_BYTES of output, so that the source is
+ *    visited rarely, with one 32-byte request each time, and never by two
+ *    threads for the same draw. On hosts, a process created by fork()
+ *    reseeds all of its generators before their next output, so that
+ *    parent and child never share a stream; otherwise
+ *  - the source given to ATMIrng_set_source(), by default ATMI_memrand().
+ *
+ * Where the prebuilt library draws its entropy through libsodium (x86-64
+ * and Cortex-A), ATMIrng_install() routes it through ATMIrng_fill(). The
+ * Cortex-M libraries call ATMI_memrand() directly: there, ATMI_memrand()
+ * may itself call ATMIrng_fill(), provided a source other than
+ * ATMI_memrand() (e.g. a function reading the TRNG) is set beforehand.
+ */
+#define ATMI_RNG_DRBG               (1u)
+
+#ifndef ATMI_RNG_RESEED_BYTES
+#define ATMI_RNG_RESEED_BYTES       (1u << 16)
+#endif
+
+/**
+ * Entropy source: write n random bytes to p.
+ */
+typedef void (*atmi_rng_fn)(void *arg, void *p, size_t n);
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Obtain n bytes of entropy, from the calling thread's function, the DRBG
+ * or the source, as described above.
+ *
+ * \param p       Location in which to store output.
+ * \param n       Number of bytes to store.
+ */
+void ATMIrng_fill(void *p, size_t n);
+
+/**
+ * Set the source of entropy for all threads, and whether it is drawn on
+ * directly or through the DRBG. Generators on all threads are reseeded from
+ * the new source before their next output.
+ *
+ * Call this during initialization, or while no other thread is drawing
+ * entropy. The source may be called from several threads at once, and must
+ * be thread-safe if the SDK is used from several threads.
+ *
+ * \param fn      Source, or NULL for ATMI_memrand().
+ * \param arg     Argument passed to fn.
+ * \param flags   Zero, or ATMI_RNG_DRBG.
+ *
+ * \return -EINVAL   Invalid arguments (unknown flags).
+ * \return 0         Success.
+ */
+int ATMIrng_set_source(atmi_rng_fn fn, void *arg, unsigned flags);
+
+/**
+ * Register an entropy function for the calling thread only, or remove it
+ * if fn is NULL. It then serves all of the thread's requests, bypassing the
+ * DRBG and the source.
+ *
+ * \param fn      Function, or NULL.
+ * \param arg     Argument passed to fn.
+ */
+void ATMIrng_set_thread(atmi_rng_fn fn, void *arg);
+
+/**
+ * Clear the calling thread's DRBG state, e.g. before the thread exits. It
+ * is reseeded if used again.
+ */
+void ATMIrng_wipe_thread(void);
+
+/**
+ * Route the entropy drawn through libsodium by the prebuilt library through
+ * ATMIrng_fill().
+ *
+ * \return -ENODEV   The library for this target does not use libsodium;
+ *                   route ATMI_memrand() instead.
+ * \return 0         Success.
+ */
+int ATMIrng_install(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*ATMI_RNG_H_*/
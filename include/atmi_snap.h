@@ -0,0 +1,77 @@
+/*
+ * Atonomi Device SDK: Session Snapshots
+ *
+ * Copyright (C) 2018 Atonomi
+ */
+#ifndef ATMI_SNAP_H_
+#define ATMI_SNAP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "atmi.h"
+
+
+/*
+ * A session's state[] buffer holds live pointers and scratch fields that
+ * only matter during a call, alongside the CENTRI session data needed to
+ * decode a response. A snapshot holds just the latter, free of pointers and
+ * padding, for keeping in backup RAM or flash while a device sleeps between
+ * sending a request and receiving its response.
+ *
+ * The session data is stored as differences from its usual contents after
+ * packing a request into a zeroed session, so such a snapshot is under 40
+ * bytes (against the 336 of state[] on 64-bit targets). The regular
+ * ATMIpack* routines leave the session data they do not use as they find
+ * it, and which of it the library reads once a response arrives is not
+ * known, so export stores whatever is there: zero the session before
+ * packing (as a static or memset() one is) to keep the snapshot small. A
+ * session packed over leftover contents still exports and restores
+ * correctly, but takes 240 bytes or so. Snapshots are versioned and carry
+ * a CRC-8; they are specific to the prebuilt library they came from but
+ * not to the word size or endianness of the target.
+ */
+#define ATMI_SNAPSHOT_MAX_SIZE      (2u + sizeof(PSSession))
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Export a snapshot of a session.
+ *
+ * \param ssn     Location of session, as left by an ATMIpack* call. See
+ *                above on zeroing it beforehand.
+ * \param out     Location in which to store snapshot.
+ * \param nout    Size of output buffer. ATMI_SNAPSHOT_MAX_SIZE always
+ *                suffices.
+ *
+ * \return -EINVAL   Invalid arguments (bad pointers).
+ * \return -ENOSPC   Output buffer too small.
+ * \return >0        Success. Length of snapshot in bytes.
+ */
+int ATMIsession_export(const atmi_session_t *ssn, uint8_t *out, size_t nout);
+
+/**
+ * Restore a session from a snapshot, ready for unpacking a response.
+ *
+ * Any prior contents of the session are discarded.
+ *
+ * \param ssn     Location of session to restore into.
+ * \param in      Location of snapshot.
+ * \param nin     Length of snapshot in bytes.
+ *
+ * \return -EINVAL   Invalid arguments (bad pointers or length).
+ * \return -ENOENT   Snapshot version not recognised.
+ * \return -EBADF    Snapshot corrupt (bad CRC or encoding).
+ * \return 0         Success.
+ */
+int ATMIsession_import(atmi_session_t *ssn, const uint8_t *in, size_t nin);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*ATMI_SNAP_H_*/
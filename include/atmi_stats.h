@@ -0,0 +1,155 @@
+/*
+ * Atonomi Device SDK: Instrumentation
+ *
+ * Copyright (C) 2018 Atonomi
+ */
+#ifndef ATMI_STATS_H_
+#define ATMI_STATS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*
+ * Per-phase timing of the prebuilt libraries.
+ *
+ * The internals of the prebuilt libraries cannot be modified, but their
+ * calls between object files can be intercepted at link time. Linking
+ * with the linker options in ATMI_TRACE_LDFLAGS (make TRACE=1 does so for
+ * the tools and benchmarks) routes each call to the functions below through
+ * a counter that records calls and cycles. Programs linked without them
+ * pay nothing, and ATMIstats_get() then returns -ENODEV.
+ *
+ * Phases nest: a CENTRI package operation includes the key exchanges,
+ * boxes and entropy requests it makes. Figures are inclusive of nested
+ * phases, except ATMI_PHASE_CODEC, which is the time within CENTRI package
+ * operations not spent in any other phase: framing, TLV and cm0 encoding.
+ *
+ *   Phase                 Intercepted functions
+ *   ATMI_PHASE_GREETING   pse_generate_greeting
+ *   ATMI_PHASE_DATA       pse_generate_data_package, pse_generate_stop_package
+ *   ATMI_PHASE_INCOMING   pse_process_incoming_package
+ *   ATMI_PHASE_KEYGEN     crypto_scalarmult_base (ephemeral key pairs)
+ *   ATMI_PHASE_KEYX       crypto_scalarmult_curve25519 (key exchange)
+ *   ATMI_PHASE_BOX        crypto_box_easy, crypto_box_open_easy
+ *   ATMI_PHASE_RNG        randombytes_buf, ATMI_memrand
+ *   ATMI_PHASE_CODEC      (remainder of the first three)
+ *
+ * The Cortex-M libraries bundle TweetNaCl in place of libsodium, and
+ * differ: ATMI_PHASE_KEYGEN intercepts crypto_scalarmult_curve25519_base,
+ * and ATMI_PHASE_RNG ATMI_memrand alone. Their key exchange is made within
+ * tweetnacl.o, where no call can be intercepted, so ATMI_PHASE_KEYX counts
+ * nothing there, and its time falls to ATMI_PHASE_BOX.
+ *
+ * Counters are 64 bits wide. On hosts they are updated atomically, but
+ * Cortex-M has no such atomic operations, and there they are updated
+ * within ATMI_STATS_LOCK() and ATMI_STATS_UNLOCK(). These do nothing by
+ * default: define them when building the SDK (masking interrupts, say)
+ * unless all calls into the library are serialized.
+ */
+enum {
+	ATMI_PHASE_GREETING,
+	ATMI_PHASE_DATA,
+	ATMI_PHASE_INCOMING,
+	ATMI_PHASE_KEYGEN,
+	ATMI_PHASE_KEYX,
+	ATMI_PHASE_BOX,
+	ATMI_PHASE_RNG,
+	ATMI_PHASE_CODEC,
+	ATMI_NPHASES
+};
+
+#if !defined(__ARM_ARCH_6M__) && !defined(__ARM_ARCH_7M__)
+#define ATMI_TRACE_LDFLAGS                                              \
+	"-Wl,--wrap=pse_generate_greeting,--wrap=pse_generate_data_package," \
+	"--wrap=pse_generate_stop_package,--wrap=pse_process_incoming_package," \
+	"--wrap=crypto_scalarmult_base,--wrap=crypto_scalarmult_curve25519," \
+	"--wrap=crypto_box_easy,--wrap=crypto_box_open_easy,"            \
+	"--wrap=randombytes_buf,--wrap=ATMI_memrand,"                    \
+	"--undefined=ATMIpriv_trace_linked"
+#else
+#define ATMI_TRACE_LDFLAGS                                              \
+	"-Wl,--wrap=pse_generate_greeting,--wrap=pse_generate_data_package," \
+	"--wrap=pse_generate_stop_package,--wrap=pse_process_incoming_package," \
+	"--wrap=crypto_scalarmult_curve25519_base,"                      \
+	"--wrap=crypto_box_easy,--wrap=crypto_box_open_easy,"            \
+	"--wrap=ATMI_memrand,"                                           \
+	"--undefined=ATMIpriv_trace_linked"
+#endif
+
+/* Histogram bucket i counts calls taking [2^i, 2^(i+1)) cycles. */
+#define ATMI_STATS_BUCKETS          (32u)
+
+
+/**
+ * Statistics for one phase.
+ */
+typedef struct {
+	uint64_t  calls;
+	uint64_t  cycles;                       /** Sum over all calls.  */
+	uint64_t  min;
+	uint64_t  max;
+	uint64_t  hist[ATMI_STATS_BUCKETS];
+} atmi_phase_stats_t;
+
+typedef struct {
+	atmi_phase_stats_t  phase[ATMI_NPHASES];
+} atmi_stats_t;
+
+/**
+ * Tracer, called on leaving each phase with its duration.
+ */
+typedef void (*atmi_tracer_fn)(void *arg, unsigned phase, uint64_t cycles);
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Retrieve statistics accumulated since startup or ATMIstats_reset(),
+ * summed over all threads. Each phase is read as a whole only on Cortex-M;
+ * elsewhere a snapshot taken during calls on other threads may be slightly
+ * skewed.
+ *
+ * \param out     Location in which to store statistics.
+ *
+ * \return -EINVAL   Invalid arguments (bad pointers).
+ * \return -ENODEV   Not linked with ATMI_TRACE_LDFLAGS.
+ * \return 0         Success.
+ */
+int ATMIstats_get(atmi_stats_t *out);
+
+/**
+ * Clear all accumulated statistics.
+ */
+void ATMIstats_reset(void);
+
+/**
+ * Register a tracer, or remove it if fn is NULL. Tracers are called on
+ * the thread making the call, and must be thread-safe if the library is
+ * used from several threads. Calls made while the tracer is being changed
+ * are not traced. This routine must not itself be called from several
+ * threads at once.
+ */
+void ATMIstats_set_tracer(atmi_tracer_fn fn, void *arg);
+
+/**
+ * Name of a phase, e.g. "greeting", or NULL if out of range.
+ */
+const char *ATMIstats_phase_name(unsigned phase);
+
+/**
+ * Read the cycle counter used for timing. The default uses the time-stamp
+ * counter on x86 and CLOCK_MONOTONIC nanoseconds elsewhere; bare-metal
+ * targets may provide their own definition (e.g. reading DWT->CYCCNT).
+ */
+uint64_t ATMIstats_clock(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*ATMI_STATS_H_*/
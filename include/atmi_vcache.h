@@ -0,0 +1,134 @@
+/*
+ * Atonomi Device SDK: Validation Result Cache
+ *
+ * Copyright (C) 2018 Atonomi
+ */
+#ifndef ATMI_VCACHE_H_
+#define ATMI_VCACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "atmi.h"
+
+
+/*
+ * Recent validation results, keyed by the subject's Device ID.
+ *
+ * A device that validates the same few peers over and over may consult the
+ * cache before packing a validation request, and store each result it
+ * unpacks. Successful results are served for ttl units of time, failures
+ * for neg_ttl units. Time is supplied by the caller with every call, in any
+ * units (e.g. seconds, or RTOS ticks), from a counter that may wrap; a
+ * lifetime must be less than half its range.
+ *
+ * Entries live in an open-addressed table in caller-supplied memory, of
+ * ATMI_VCACHE_ENTRY_SIZE bytes per slot; no allocation is made. The table
+ * is kept at most three-quarters full, evicting the least recently used
+ * entry to make room. Lookups and stores take constant time on average.
+ *
+ * Reputation tokens are one-time use, and belong to the validation that
+ * obtained them, so the cache does not keep them: results it returns have
+ * reputation_token zeroed. A device intending to submit a reputation
+ * amendment after an interaction should validate with the IRN instead.
+ *
+ * Caches are not internally synchronized; calls on one cache must be
+ * serialized.
+ */
+#define ATMI_VCACHE_ENTRY_SIZE      (80u)
+#define ATMI_VCACHE_MAX_SLOTS       (32768u)
+
+
+/**
+ * Atonomi Validation Cache
+ *
+ * All fields are internal.
+ */
+typedef struct {
+	void      *slots;
+	uint32_t   ttl;
+	uint32_t   neg_ttl;
+	uint16_t   mask;
+	uint16_t   nlive;
+	uint16_t   nmax;
+	uint16_t   head;            /* Most recently used.  */
+	uint16_t   tail;            /* Least recently used. */
+} atmi_vcache_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Initialize an empty cache in caller-supplied memory.
+ *
+ * The table takes the largest power-of-two number of slots, up to
+ * ATMI_VCACHE_MAX_SLOTS, that fits in mem; three-quarters of them hold
+ * entries.
+ *
+ * \param vc      Location of cache.
+ * \param mem     Location of memory for the table, which must be kept for
+ *                the life of the cache.
+ * \param nmem    Size of mem in bytes; at least 4 * ATMI_VCACHE_ENTRY_SIZE,
+ *                plus 3 bytes if mem is not 4-byte aligned.
+ * \param ttl     Lifetime of successful results, in caller time units.
+ * \param neg_ttl Lifetime of failures, in caller time units; zero to not
+ *                cache failures.
+ *
+ * \return -EINVAL   Invalid arguments (bad pointers, too little memory, or
+ *                   zero ttl).
+ * \return count     Success. Number of entries the cache holds.
+ */
+int ATMIvcache_init(atmi_vcache_t *vc, void *mem, size_t nmem,
+                    uint32_t ttl, uint32_t neg_ttl);
+
+/**
+ * Look up the validation result for a subject.
+ *
+ * \param vc      Location of cache.
+ * \param id      Subject's Device ID, as in atmi_val_request_t.
+ * \param now     Current time.
+ * \param val     Location in which to store the cached result. Its success
+ *                field is negative for a cached failure.
+ *
+ * \return -EINVAL   Invalid arguments (bad pointers).
+ * \return -ENOENT   No result cached, or it has expired.
+ * \return 0         Success. Result stored in val.
+ */
+int ATMIvcache_lookup(atmi_vcache_t *vc, const uint8_t id[32], uint32_t now,
+                      atmi_val_response_t *val);
+
+/**
+ * Store the validation result for a subject, replacing any already cached.
+ *
+ * Results whose success field is negative are stored as failures, or not
+ * at all if the cache was initialized with a zero neg_ttl; these include
+ * error codes returned by ATMIunpack_val_response() or the transport, if
+ * stored as the success field.
+ *
+ * \param vc      Location of cache.
+ * \param id      Subject's Device ID, as in atmi_val_request_t.
+ * \param now     Current time.
+ * \param val     Location of result, as unpacked.
+ *
+ * \return -EINVAL   Invalid arguments (bad pointers).
+ * \return 0         Success.
+ */
+int ATMIvcache_store(atmi_vcache_t *vc, const uint8_t id[32], uint32_t now,
+                     const atmi_val_response_t *val);
+
+/**
+ * Remove the result cached for a subject, if any.
+ *
+ * \param vc      Location of cache.
+ * \param id      Subject's Device ID.
+ */
+void ATMIvcache_forget(atmi_vcache_t *vc, const uint8_t id[32]);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*ATMI_VCACHE_H_*/
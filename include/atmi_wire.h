@@ -0,0 +1,107 @@
+/*
+ * Atonomi Device SDK: Compact Wire Encoding
+ *
+ * Copyright (C) 2018 Atonomi
+ */
+#ifndef ATMI_WIRE_H_
+#define ATMI_WIRE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "atmi.h"
+
+
+/*
+ * Compact encoding of packed messages for constrained links.
+ *
+ * A packed message is laid out as the 5-byte ATMI header followed by a
+ * CENTRI envelope whose framing (lengths, format version, attribute tags)
+ * is fixed or derivable from the message length, and which carries the
+ * sender's public key in clear. The compact encoding drops everything
+ * derivable, saving ATMI_WIRE_SAVING bytes per message, and with
+ * ATMI_WIRE_NOKEY also the public key, saving ATMI_WIRE_SAVING_NOKEY bytes
+ * where the receiver already knows it (e.g. from a device registry):
+ *
+ *   Offset  Length  Field
+ *   0       1       ATMI_WIRE_COMPACT, ORed with flags.
+ *   1       1       ATMI message type, as in the ATMI header.
+ *   2       1       Message CRC, as in the ATMI header.
+ *   3       1       CENTRI package type.
+ *   4       2       Declared decrypted length, little-endian.
+ *   6       24      Nonce.
+ *   30      32      Public key, unless ATMI_WIRE_NOKEY.
+ *   30/62   ...     Ciphertext, to the end of the message.
+ *
+ * The encrypted content is unchanged, so decoding restores the original
+ * message byte for byte. The leading byte doubles as a version field: that
+ * of a standard message is always 'a' (0x61), so receivers can accept both
+ * forms on the same channel. A device may send compact requests to an
+ * endpoint known to accept them, which then replies in kind; the IRN
+ * itself accepts only standard messages, so a front end near the device
+ * must expand them before forwarding.
+ */
+#define ATMI_WIRE_COMPACT           (0xc0u)
+#define ATMI_WIRE_NOKEY             (0x01u)
+
+#define ATMI_WIRE_SAVING            (13u)
+#define ATMI_WIRE_SAVING_NOKEY      (ATMI_WIRE_SAVING + 32u)
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Check whether a message is in compact encoding.
+ *
+ * \return 1 if compact, 0 otherwise (including for NULL or empty input).
+ */
+int ATMIwire_is_compact(const void *pinbuf, size_t nin);
+
+/**
+ * Encode a packed message compactly.
+ *
+ * \param pinbuf  Location of packed message, e.g. a request from an
+ *                ATMIpack_* routine.
+ * \param nin     Length of packed message.
+ * \param poutbuf Location in which to store compact message. May equal
+ *                pinbuf, to encode in place.
+ * \param nout    Size of poutbuf.
+ * \param flags   Zero, or ATMI_WIRE_NOKEY.
+ *
+ * \return -EINVAL   Invalid arguments (bad pointers or flags).
+ * \return -EBADF    Message not in the layout this encoding covers, such
+ *                   as a stop package; send it as it is.
+ * \return -ENOSPC   Output buffer too small.
+ * \return >0        Success. Length of compact message.
+ */
+int ATMIwire_compact(const void *pinbuf, size_t nin,
+                     void *poutbuf, size_t nout, unsigned flags);
+
+/**
+ * Decode a compact message, restoring the packed message it was made from.
+ *
+ * \param pinbuf  Location of compact message.
+ * \param nin     Length of compact message.
+ * \param pubkey  Public key the message was made with. Required if the
+ *                message was encoded with ATMI_WIRE_NOKEY, else ignored.
+ * \param poutbuf Location in which to store packed message. Must not
+ *                overlap pinbuf.
+ * \param nout    Size of poutbuf.
+ *
+ * \return -EINVAL   Invalid arguments (bad pointers, or key required).
+ * \return -ENOENT   Not a compact message.
+ * \return -EBADF    Compact message truncated or oversized.
+ * \return -ENOSPC   Output buffer too small.
+ * \return >0        Success. Length of packed message.
+ */
+int ATMIwire_expand(const void *pinbuf, size_t nin, const uint8_t pubkey[32],
+                    void *poutbuf, size_t nout);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*ATMI_WIRE_H_*/
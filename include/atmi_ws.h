@@ -0,0 +1,120 @@
+/*
+ * Atonomi Device SDK: Caller-supplied Workspaces
+ *
+ * Copyright (C) 2018 Atonomi
+ */
+#ifndef ATMI_WS_H_
+#define ATMI_WS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "atmi.h"
+
+
+/*
+ * Size of the scratch area needed by any one call made through a
+ * workspace. This covers the worst-case stack requirement of the library
+ * (4400 bytes on ARM; about 4700 bytes on x86-64) plus headroom for the
+ * trampoline and for exception frames or signal handlers stacked while a
+ * call is in progress. It may be overridden at build time if measured
+ * usage (see ATMIworkspace_used()) shows otherwise for a given target.
+ */
+#ifndef ATMI_WORKSPACE_SIZE
+#if defined(__x86_64__)
+#define ATMI_WORKSPACE_SIZE         (8192u)
+#else
+#define ATMI_WORKSPACE_SIZE         (4608u)
+#endif
+#endif
+
+
+/**
+ * Atonomi Workspace
+ *
+ * All temporaries needed by the prebuilt library live on the stack of the
+ * calling thread. The *_ws variants of each API call below instead run the
+ * call with its stack placed in a workspace, so that the calling task need
+ * only provide a few dozen bytes of stack of its own. A single statically
+ * allocated workspace may thus serve any number of tasks, so long as no two
+ * calls use it at the same time (e.g. by guarding it with a mutex).
+ *
+ * Interrupts or signals taken during a call will stack onto the workspace;
+ * ATMI_WORKSPACE_SIZE allows for this. Stack overflow checking provided by
+ * some RTOSes may not recognise the workspace as belonging to the task and
+ * should be disabled around these calls.
+ *
+ * \note On targets without a stack switching implementation (anything but
+ *       x86-64 or ARM), calls are made directly on the caller's stack.
+ */
+typedef struct {
+	uint8_t  stack[ATMI_WORKSPACE_SIZE] __attribute__((aligned(16)));
+} atmi_workspace_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Fill a workspace with a known pattern, so that ATMIworkspace_used() can
+ * later report its high-water mark. Optional; only needed for sizing.
+ *
+ * \param ws      Location of workspace.
+ */
+void ATMIworkspace_init(atmi_workspace_t *ws);
+
+/**
+ * Report the greatest number of bytes of a workspace used by any call since
+ * it was last passed to ATMIworkspace_init().
+ *
+ * \param ws      Location of workspace.
+ *
+ * \return bytes  High-water mark in bytes.
+ */
+size_t ATMIworkspace_used(const atmi_workspace_t *ws);
+
+
+/*
+ * Workspace variants of each API call. Arguments and return values are
+ * identical to those documented in atmi.h, save for -EINVAL also being
+ * returned if ws is NULL.
+ */
+int ATMIpack_act_request_ws(atmi_workspace_t *ws,
+                            const atmi_context_t *ctx, atmi_session_t *ssn,
+                            const atmi_act_request_t *act);
+
+int ATMIpack_val_request_ws(atmi_workspace_t *ws,
+                            const atmi_context_t *ctx, atmi_session_t *ssn,
+                            const atmi_val_request_t *val);
+
+int ATMIpack_rep_request_ws(atmi_workspace_t *ws,
+                            const atmi_context_t *ctx, atmi_session_t *ssn,
+                            atmi_rep_request_t *rep);
+
+int ATMIunpack_act_response_ws(atmi_workspace_t *ws,
+                               const atmi_context_t *ctx, atmi_session_t *ssn,
+                               const void *pinbuf, size_t nin,
+                               atmi_act_response_t *act);
+
+int ATMIunpack_val_response_ws(atmi_workspace_t *ws,
+                               const atmi_context_t *ctx, atmi_session_t *ssn,
+                               const void *pinbuf, size_t nin,
+                               atmi_val_response_t *val);
+
+int ATMIunpack_rep_response_ws(atmi_workspace_t *ws,
+                               const atmi_context_t *ctx, atmi_session_t *ssn,
+                               const void *pinbuf, size_t nin,
+                               atmi_rep_response_t *rep);
+
+int ATMIsign_device_id_ws(atmi_workspace_t *ws,
+                          const atmi_context_t *ctx, atmi_session_t *ssn,
+                          uint8_t       idsgn_out[72],
+                          const uint8_t devid_in [32]);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*ATMI_WS_H_*/
@@ -0,0 +1,151 @@
+/*
+ * Atonomi Device SDK: Zero-copy Packing
+ *
+ * Copyright (C) 2018 Atonomi
+ */
+#ifndef ATMI_ZC_H_
+#define ATMI_ZC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "atmi.h"
+
+
+/* Exact length of each packed request. */
+#define ATMI_PKTLEN_ACT_REQ         (198u)
+#define ATMI_PKTLEN_VAL_REQ         (304u)
+#define ATMI_PKTLEN_REP_REQ         (249u)
+
+/* Headroom sufficient for ATMIframe_http_put() with typical host names. */
+#define ATMI_HTTP_HEADROOM          (192u)
+
+
+/**
+ * Atonomi Session State
+ *
+ * The state[] half of an atmi_session_t alone. The routines below place
+ * packets in caller-supplied buffers rather than in a session's packet[]
+ * working buffer, so only this much need be kept per request in flight.
+ */
+typedef struct {
+	uint8_t  state[ATMI_SESSBUF_STATE_SIZE]
+	         __attribute__((aligned(sizeof(void *))));
+} atmi_ssnstate_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Pack request messages directly into a caller-supplied buffer.
+ *
+ * The packet is written at buf + headroom, leaving the headroom free for
+ * transport framing (see ATMIframe_http_put()). Any space beyond the end
+ * of the packet is likewise left untouched as tailroom. Output and stack
+ * requirements are otherwise as for ATMIpack_*.
+ *
+ * \param ctx      Location of Atonomi library context structure.
+ * \param sst      Location of session state. Must be preserved for
+ *                 unpacking the corresponding response.
+ * \param act/val/rep  Location of request descriptor.
+ * \param buf      Location of output buffer.
+ * \param nbuf     Size of output buffer in bytes. Must be at least headroom
+ *                 plus ATMI_PKTLEN_*_REQ.
+ * \param headroom Number of bytes to leave free at the start of buf.
+ *
+ * \return -EINVAL   Invalid arguments (bad pointers).
+ * \return -ENOSPC   Output buffer too small.
+ * \return -EFAULT   Could not encrypt message data (bad keys?).
+ * \return >0        Success. Number of packed bytes placed at buf+headroom.
+ */
+int ATMIpack_act_request_into(const atmi_context_t *ctx, atmi_ssnstate_t *sst,
+                              const atmi_act_request_t *act,
+                              uint8_t *buf, size_t nbuf, size_t headroom);
+
+int ATMIpack_val_request_into(const atmi_context_t *ctx, atmi_ssnstate_t *sst,
+                              const atmi_val_request_t *val,
+                              uint8_t *buf, size_t nbuf, size_t headroom);
+
+int ATMIpack_rep_request_into(const atmi_context_t *ctx, atmi_ssnstate_t *sst,
+                              const atmi_rep_request_t *rep,
+                              uint8_t *buf, size_t nbuf, size_t headroom);
+
+/**
+ * Unpack response messages for requests packed with ATMIpack_*_into().
+ *
+ * A temporary working buffer of ATMI_SESSBUF_SIZE bytes is taken from the
+ * stack. Arguments and return values are otherwise as for ATMIunpack_*.
+ */
+int ATMIunpack_act_response_state(const atmi_context_t *ctx,
+                                  atmi_ssnstate_t *sst,
+                                  const void *pinbuf, size_t nin,
+                                  atmi_act_response_t *act);
+
+int ATMIunpack_val_response_state(const atmi_context_t *ctx,
+                                  atmi_ssnstate_t *sst,
+                                  const void *pinbuf, size_t nin,
+                                  atmi_val_response_t *val);
+
+int ATMIunpack_rep_response_state(const atmi_context_t *ctx,
+                                  atmi_ssnstate_t *sst,
+                                  const void *pinbuf, size_t nin,
+                                  atmi_rep_response_t *rep);
+
+/**
+ * Unpack response messages within the caller's receive buffer.
+ *
+ * As ATMIunpack_*_response_state(), but rather than taking a temporary
+ * working buffer from the stack, the envelope is decrypted into the unused
+ * space following the packet in the receive buffer. The packet itself is
+ * left intact, so on -ENOSPC the call may be repeated with a larger buffer.
+ *
+ * \param pinbuf  Location of receive buffer holding the packet.
+ * \param nin     Length of the packet.
+ * \param nbuf    Size of the receive buffer, at least nin. Bytes from nin
+ *                onward are overwritten.
+ *
+ * \return -ENOSPC   Too little space follows the packet.
+ * \return           Otherwise as for ATMIunpack_*.
+ */
+int ATMIunpack_act_response_inplace(const atmi_context_t *ctx,
+                                    atmi_ssnstate_t *sst,
+                                    void *pinbuf, size_t nin, size_t nbuf,
+                                    atmi_act_response_t *act);
+
+int ATMIunpack_val_response_inplace(const atmi_context_t *ctx,
+                                    atmi_ssnstate_t *sst,
+                                    void *pinbuf, size_t nin, size_t nbuf,
+                                    atmi_val_response_t *val);
+
+int ATMIunpack_rep_response_inplace(const atmi_context_t *ctx,
+                                    atmi_ssnstate_t *sst,
+                                    void *pinbuf, size_t nin, size_t nbuf,
+                                    atmi_rep_response_t *rep);
+
+/**
+ * Write an HTTP/1.1 PUT request header into the headroom before a packet,
+ * ending immediately before it, so that header and packet may be sent with
+ * a single write or DMA transfer.
+ *
+ * \param buf      Location of buffer, as passed to ATMIpack_*_into().
+ * \param headroom Headroom reserved ahead of the packet.
+ * \param npkt     Length of packet.
+ * \param host     Value for the Host header, e.g. "device.atonomi.net".
+ * \param path     Request path, e.g. "/activate".
+ *
+ * \return -EINVAL   Invalid arguments (bad pointers).
+ * \return -ENOSPC   Header does not fit within headroom.
+ * \return >=0       Success. Offset in buf at which the frame begins; the
+ *                   frame is headroom - offset + npkt bytes long.
+ */
+int ATMIframe_http_put(uint8_t *buf, size_t headroom, size_t npkt,
+                       const char *host, const char *path);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*ATMI_ZC_H_*/
@@ -0,0 +1,374 @@
+/*
+ * Atonomi Device SDK: Batch Message Packing and Unpacking
+ *
+ * Copyright (C) 2018 Atonomi
+ */
+#include <limits.h>
+#include <stdlib.h>
+#include "atmi_errno.h"
+#include "atmi_batch.h"
+#include "atmi_priv.h"
+
+/* Worker pools need threads, and a heap for their state. */
+#if !defined(ATMI_NO_THREADS) && !defined(ATMI_NO_HEAP)
+#define BATCH_POOL
+#include <pthread.h>
+#endif
+
+
+/*
+ * Number of consecutive elements claimed by a thread at a time. Each
+ * element costs tens of microseconds, so contention on the shared index
+ * is negligible even at one; a few keeps neighbouring sessions together.
+ */
+#define ATMI_BATCH_CHUNK    (4u)
+
+
+typedef struct atmi_batch_job atmi_batch_job_t;
+typedef int (*atmi_batch_fn)(const atmi_batch_job_t *job, size_t i);
+
+struct atmi_batch_job {
+	atmi_batch_fn          fn;
+	const atmi_context_t  *ctx;
+	atmi_session_t        *ssns;
+	const void            *reqs;
+	void                  *outs;
+	const void *const     *pinbufs;
+	const size_t          *nins;
+	int                   *status;
+	size_t                 n;
+	size_t                 next;   /* Next unclaimed element (atomic). */
+	size_t                 nok;    /* Successful elements (atomic).    */
+};
+
+
+static void batch_run(atmi_batch_job_t *job)
+{
+	size_t  i, end, nok = 0u;
+	int     r;
+
+	for(;;) {
+		i = __atomic_fetch_add(&job->next, ATMI_BATCH_CHUNK,
+		                       __ATOMIC_RELAXED);
+		if(i >= job->n)
+			break;
+
+		end = (job->n - i > ATMI_BATCH_CHUNK) ? i + ATMI_BATCH_CHUNK
+		                                      : job->n;
+		for(; i < end; i++) {
+			r = job->fn(job, i);
+			job->status[i] = r;
+			nok += (r >= 0);
+		}
+	}
+
+	__atomic_fetch_add(&job->nok, nok, __ATOMIC_RELAXED);
+}
+
+
+
+#ifdef BATCH_POOL
+struct atmi_pool {
+	pthread_mutex_t    submit;     /* Serializes batches.              */
+	pthread_mutex_t    lock;       /* Protects all fields below.       */
+	pthread_cond_t     wake;
+	pthread_cond_t     idle;
+	atmi_batch_job_t  *job;
+	unsigned           gen;        /* Incremented per dispatched job.  */
+	unsigned           busy;       /* Workers yet to finish this job.  */
+	unsigned           nworkers;
+	int                stop;
+	pthread_t          workers[];
+};
+
+
+static void *pool_worker(void *arg)
+{
+	atmi_pool_t       *pool = arg;
+	atmi_batch_job_t  *job;
+	unsigned           seen = 0u;
+
+	pthread_mutex_lock(&pool->lock);
+	for(;;) {
+		while(!pool->stop && pool->gen == seen)
+			pthread_cond_wait(&pool->wake, &pool->lock);
+		if(pool->stop)
+			break;
+
+		seen = pool->gen;
+		job  = pool->job;
+		pthread_mutex_unlock(&pool->lock);
+
+		batch_run(job);
+
+		pthread_mutex_lock(&pool->lock);
+		if(--pool->busy == 0u)
+			pthread_cond_signal(&pool->idle);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+
+static void pool_stop(atmi_pool_t *pool, unsigned nstarted)
+{
+	unsigned  i;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = 1;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+
+	for(i = 0u; i < nstarted; i++)
+		(void)pthread_join(pool->workers[i], NULL);
+
+	pthread_cond_destroy(&pool->idle);
+	pthread_cond_destroy(&pool->wake);
+	pthread_mutex_destroy(&pool->lock);
+	pthread_mutex_destroy(&pool->submit);
+	ATMIpriv_free(pool);
+}
+
+
+atmi_pool_t *ATMIpool_create(unsigned nworkers)
+{
+	atmi_pool_t  *pool;
+	unsigned      i;
+
+	if(nworkers == 0u)
+		return NULL;
+
+	pool = ATMIpriv_calloc(1u, sizeof(*pool) +
+	                           nworkers*sizeof(pool->workers[0]));
+	if(!pool)
+		return NULL;
+
+	pool->nworkers = nworkers;
+	pthread_mutex_init(&pool->submit, NULL);
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->wake, NULL);
+	pthread_cond_init(&pool->idle, NULL);
+
+	for(i = 0u; i < nworkers; i++) {
+		if(!!pthread_create(&pool->workers[i], NULL, pool_worker, pool)) {
+			pool_stop(pool, i);
+			return NULL;
+		}
+	}
+
+	return pool;
+}
+
+
+void ATMIpool_destroy(atmi_pool_t *pool)
+{
+	if(pool)
+		pool_stop(pool, pool->nworkers);
+}
+
+
+static void pool_dispatch(atmi_pool_t *pool, atmi_batch_job_t *job)
+{
+	pthread_mutex_lock(&pool->submit);
+
+	pthread_mutex_lock(&pool->lock);
+	pool->job  = job;
+	pool->busy = pool->nworkers;
+	pool->gen++;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+
+	batch_run(job);
+
+	pthread_mutex_lock(&pool->lock);
+	while(pool->busy > 0u)
+		pthread_cond_wait(&pool->idle, &pool->lock);
+	pool->job = NULL;
+	pthread_mutex_unlock(&pool->lock);
+
+	pthread_mutex_unlock(&pool->submit);
+}
+
+#else /*BATCH_POOL*/
+
+atmi_pool_t *ATMIpool_create(unsigned nworkers)
+{
+	(void)nworkers;
+	return NULL;
+}
+
+
+void ATMIpool_destroy(atmi_pool_t *pool)
+{
+	(void)pool;
+}
+
+#endif /*BATCH_POOL*/
+
+
+
+static int batch_exec(atmi_batch_job_t *job, atmi_pool_t *pool)
+{
+	if(!job->ctx || !job->ssns || !job->status || job->n > INT_MAX)
+		return -EINVAL;
+	if(job->n > 0u && (!job->reqs && !job->outs))
+		return -EINVAL;
+
+	job->next = 0u;
+	job->nok  = 0u;
+
+#ifdef BATCH_POOL
+	if(pool && job->n > ATMI_BATCH_CHUNK) {
+		pool_dispatch(pool, job);
+		return (int)job->nok;
+	}
+#else
+	(void)pool;
+#endif
+
+	batch_run(job);
+	return (int)job->nok;
+}
+
+
+
+static int item_pack_act(const atmi_batch_job_t *job, size_t i)
+{
+	const atmi_act_request_t *reqs = job->reqs;
+
+	return ATMIpack_act_request(job->ctx, &job->ssns[i], &reqs[i]);
+}
+
+static int item_pack_val(const atmi_batch_job_t *job, size_t i)
+{
+	const atmi_val_request_t *reqs = job->reqs;
+
+	return ATMIpack_val_request(job->ctx, &job->ssns[i], &reqs[i]);
+}
+
+static int item_pack_rep(const atmi_batch_job_t *job, size_t i)
+{
+	atmi_rep_request_t *reqs = (atmi_rep_request_t *)job->reqs;
+
+	return ATMIpack_rep_request(job->ctx, &job->ssns[i], &reqs[i]);
+}
+
+static int item_unpack_act(const atmi_batch_job_t *job, size_t i)
+{
+	atmi_act_response_t *outs = job->outs;
+
+	return ATMIunpack_act_response(job->ctx, &job->ssns[i],
+	                               job->pinbufs[i], job->nins[i], &outs[i]);
+}
+
+static int item_unpack_val(const atmi_batch_job_t *job, size_t i)
+{
+	atmi_val_response_t *outs = job->outs;
+
+	return ATMIunpack_val_response(job->ctx, &job->ssns[i],
+	                               job->pinbufs[i], job->nins[i], &outs[i]);
+}
+
+static int item_unpack_rep(const atmi_batch_job_t *job, size_t i)
+{
+	atmi_rep_response_t *outs = job->outs;
+
+	return ATMIunpack_rep_response(job->ctx, &job->ssns[i],
+	                               job->pinbufs[i], job->nins[i], &outs[i]);
+}
+
+
+
+int ATMIpack_act_request_batch(const atmi_context_t *ctx,
+                               atmi_session_t ssns[],
+                               const atmi_act_request_t acts[],
+                               size_t n, int status[], atmi_pool_t *pool)
+{
+	atmi_batch_job_t job = {
+		.fn = item_pack_act, .ctx = ctx, .ssns = ssns,
+		.reqs = acts, .status = status, .n = n
+	};
+
+	return batch_exec(&job, pool);
+}
+
+int ATMIpack_val_request_batch(const atmi_context_t *ctx,
+                               atmi_session_t ssns[],
+                               const atmi_val_request_t vals[],
+                               size_t n, int status[], atmi_pool_t *pool)
+{
+	atmi_batch_job_t job = {
+		.fn = item_pack_val, .ctx = ctx, .ssns = ssns,
+		.reqs = vals, .status = status, .n = n
+	};
+
+	return batch_exec(&job, pool);
+}
+
+int ATMIpack_rep_request_batch(const atmi_context_t *ctx,
+                               atmi_session_t ssns[],
+                               atmi_rep_request_t reps[],
+                               size_t n, int status[], atmi_pool_t *pool)
+{
+	atmi_batch_job_t job = {
+		.fn = item_pack_rep, .ctx = ctx, .ssns = ssns,
+		.reqs = reps, .status = status, .n = n
+	};
+
+	return batch_exec(&job, pool);
+}
+
+int ATMIunpack_act_response_batch(const atmi_context_t *ctx,
+                                  atmi_session_t ssns[],
+                                  const void *const pinbufs[],
+                                  const size_t nins[],
+                                  atmi_act_response_t acts[],
+                                  size_t n, int status[], atmi_pool_t *pool)
+{
+	atmi_batch_job_t job = {
+		.fn = item_unpack_act, .ctx = ctx, .ssns = ssns,
+		.outs = acts, .pinbufs = pinbufs, .nins = nins,
+		.status = status, .n = n
+	};
+
+	if(n > 0u && (!pinbufs || !nins))
+		return -EINVAL;
+	return batch_exec(&job, pool);
+}
+
+int ATMIunpack_val_response_batch(const atmi_context_t *ctx,
+                                  atmi_session_t ssns[],
+                                  const void *const pinbufs[],
+                                  const size_t nins[],
+                                  atmi_val_response_t vals[],
+                                  size_t n, int status[], atmi_pool_t *pool)
+{
+	atmi_batch_job_t job = {
+		.fn = item_unpack_val, .ctx = ctx, .ssns = ssns,
+		.outs = vals, .pinbufs = pinbufs, .nins = nins,
+		.status = status, .n = n
+	};
+
+	if(n > 0u && (!pinbufs || !nins))
+		return -EINVAL;
+	return batch_exec(&job, pool);
+}
+
+int ATMIunpack_rep_response_batch(const atmi_context_t *ctx,
+                                  atmi_session_t ssns[],
+                                  const void *const pinbufs[],
+                                  const size_t nins[],
+                                  atmi_rep_response_t reps[],
+                                  size_t n, int status[], atmi_pool_t *pool)
+{
+	atmi_batch_job_t job = {
+		.fn = item_unpack_rep, .ctx = ctx, .ssns = ssns,
+		.outs = reps, .pinbufs = pinbufs, .nins = nins,
+		.status = status, .n = n
+	};
+
+	if(n > 0u && (!pinbufs || !nins))
+		return -EINVAL;
+	return batch_exec(&job, pool);
+}
@@ -0,0 +1,120 @@
+/*
+ * Atonomi Device SDK: Compact Sessions
+ *
+ * Copyright (C) 2018 Atonomi
+ */
+#include <string.h>
+#include "atmi_errno.h"
+#include "atmi_compact.h"
+#include "atmi_priv.h"
+
+
+static int pack_compact(const atmi_context_t *ctx, atmi_session_compact_t *cs,
+                        uint8_t type, const void *msg, size_t nmsg,
+                        uint8_t *buf, size_t nbuf, size_t headroom)
+{
+	atmi_session_state_t  st;
+	int                   r, n;
+
+	if(!ctx || !cs || !msg || !buf)
+		return -EINVAL;
+	if(headroom >= nbuf)
+		return -ENOSPC;
+
+	r = ATMIpriv_pack_greeting(ctx, &st, buf + headroom, nbuf - headroom,
+	                           type, msg, nmsg);
+	if(r > 0) {
+		n = ATMIpriv_snap_export(&st.pkg.sessionInfo, cs->snap,
+		                         sizeof(cs->snap));
+		if(n < 0)
+			r = n;
+		else
+			cs->len = (uint8_t)n;
+	}
+
+	memset(&st, 0, sizeof(st));
+	return r;
+}
+
+static int unpack_compact(const atmi_context_t *ctx,
+                          const atmi_session_compact_t *cs,
+                          const void *pinbuf, size_t nin, uint8_t type,
+                          void *out, size_t nout)
+{
+	atmi_session_state_t  st;
+	uint8_t               work[ATMI_SESSBUF_SIZE];
+	int                   r;
+
+	if(!ctx || !cs || !pinbuf || !out)
+		return -EINVAL;
+	if(cs->len > sizeof(cs->snap))
+		return -EBADF;
+
+	memset(&st, 0, sizeof(st));
+	r = ATMIpriv_snap_import(&st.pkg.sessionInfo, cs->snap, cs->len);
+	if(r == -EINVAL || r == -ENOENT)
+		r = -EBADF;
+	if(!r)
+		r = ATMIpriv_unpack(ctx, &st, pinbuf, nin, type,
+		                    work, sizeof(work), out, nout);
+
+	memset(&st, 0, sizeof(st));
+	return r;
+}
+
+
+
+int ATMIpack_act_request_compact(const atmi_context_t *ctx,
+                                 atmi_session_compact_t *cs,
+                                 const atmi_act_request_t *act,
+                                 uint8_t *buf, size_t nbuf, size_t headroom)
+{
+	return pack_compact(ctx, cs, ATMI_PKT_TYPE_ACT_REQ,
+	                    act, ATMI_MSGLEN_ACT_REQ, buf, nbuf, headroom);
+}
+
+int ATMIpack_val_request_compact(const atmi_context_t *ctx,
+                                 atmi_session_compact_t *cs,
+                                 const atmi_val_request_t *val,
+                                 uint8_t *buf, size_t nbuf, size_t headroom)
+{
+	return pack_compact(ctx, cs, ATMI_PKT_TYPE_VAL_REQ,
+	                    val, ATMI_MSGLEN_VAL_REQ, buf, nbuf, headroom);
+}
+
+int ATMIpack_rep_request_compact(const atmi_context_t *ctx,
+                                 atmi_session_compact_t *cs,
+                                 const atmi_rep_request_t *rep,
+                                 uint8_t *buf, size_t nbuf, size_t headroom)
+{
+	return pack_compact(ctx, cs, ATMI_PKT_TYPE_REP_REQ,
+	                    rep, ATMI_MSGLEN_REP_REQ, buf, nbuf, headroom);
+}
+
+
+int ATMIunpack_act_response_compact(const atmi_context_t *ctx,
+                                    const atmi_session_compact_t *cs,
+                                    const void *pinbuf, size_t nin,
+                                    atmi_act_response_t *act)
+{
+	return unpack_compact(ctx, cs, pinbuf, nin, ATMI_PKT_TYPE_ACT_RESP,
+	                      act, ATMI_MSGLEN_ACT_RESP);
+}
+
+int ATMIunpack_val_response_compact(const atmi_context_t *ctx,
+                                    const atmi_session_compact_t *cs,
+                                    const void *pinbuf, size_t nin,
+                                    atmi_val_response_t *val)
+{
+	return unpack_compact(ctx, cs, pinbuf, nin, ATMI_PKT_TYPE_VAL_RESP,
+	                      val, ATMI_MSGLEN_VAL_RESP);
+}
+
+int ATMIunpack_rep_response_compact(const atmi_context_t *ctx,
+                                    const atmi_session_compact_t *cs,
+                                    const void *pinbuf, size_t nin,
+                                    atmi_rep_response_t *rep)
+{
+	return unpack_compact(ctx, cs, pinbuf, nin, ATMI_PKT_TYPE_REP_RESP,
+	                      rep, ATMI_MSGLEN_REP_RESP);
+}
@@ -0,0 +1,408 @@
+/*
+ * Atonomi Device SDK: Multi-device Gateway
+ *
+ * Copyright (C) 2018 Atonomi
+ */
+#ifndef ATMI_NO_HEAP
+
+#include <stdlib.h>
+#include <string.h>
+#include "atmi_errno.h"
+#include "atmi_gw.h"
+#include "atmi_compact.h"
+#include "atmi_peek.h"
+#include "atmi_rng.h"
+#include "atmi_priv.h"
+
+#ifndef ATMI_NO_THREADS
+#include <pthread.h>
+typedef pthread_mutex_t gw_lock_t;
+#define GW_LOCK_INIT(l)         pthread_mutex_init((l), NULL)
+#define GW_LOCK_FINI(l)         pthread_mutex_destroy(l)
+#define GW_LOCK(l)              pthread_mutex_lock(l)
+#define GW_UNLOCK(l)            pthread_mutex_unlock(l)
+#else
+typedef char gw_lock_t;
+#define GW_LOCK_INIT(l)         ((void)(l))
+#define GW_LOCK_FINI(l)         ((void)(l))
+#define GW_LOCK(l)              ((void)(l))
+#define GW_UNLOCK(l)            ((void)(l))
+#endif
+
+
+/* Number of independently locked stripes of the hash table. */
+#define ATMI_GW_STRIPES         (64u)
+#define ATMI_GW_NIL             (UINT32_MAX)
+
+
+typedef struct {
+	uint8_t                 key[ATMI_GW_KEY_SIZE];
+	uint32_t                next;  /* Next entry in chain or free list. */
+	uint8_t                 type;  /* Expected response type byte.      */
+	atmi_session_compact_t  cs;
+	atmi_context_t          ctx;
+} gw_entry_t;
+
+struct atmi_gw {
+	gw_lock_t    stripes[ATMI_GW_STRIPES];
+	gw_lock_t    freelock;         /* Protects free and ninflight.      */
+	uint32_t     free;
+	size_t       ninflight;
+	uint64_t     seq;              /* Request key counter.              */
+	uint8_t      salt[8];
+	uint32_t     mask;             /* Number of buckets, less one.      */
+	uint32_t    *buckets;
+	gw_entry_t  *entries;
+};
+
+/* gw_take() result for a key found with a different request type. */
+#define ATMI_GW_MISMATCH        (ATMI_GW_NIL - 1u)
+
+
+static uint32_t gw_hash(const atmi_gw_t *gw, const uint8_t *key)
+{
+	uint64_t  a, b;
+
+	memcpy(&a, key, sizeof(a));
+	memcpy(&b, key + sizeof(a), sizeof(b));
+
+	/* MurmurHash3 finalizer. */
+	a ^= b;
+	a ^= a >> 33;
+	a *= 0xff51afd7ed558ccdull;
+	a ^= a >> 33;
+	a *= 0xc4ceb9fe1a85ec53ull;
+	a ^= a >> 33;
+
+	return (uint32_t)a & gw->mask;
+}
+
+static gw_lock_t *gw_stripe(atmi_gw_t *gw, uint32_t bucket)
+{
+	return &gw->stripes[bucket % ATMI_GW_STRIPES];
+}
+
+
+static uint32_t gw_alloc(atmi_gw_t *gw)
+{
+	uint32_t  i;
+
+	GW_LOCK(&gw->freelock);
+	i = gw->free;
+	if(i != ATMI_GW_NIL) {
+		gw->free = gw->entries[i].next;
+		gw->ninflight++;
+	}
+	GW_UNLOCK(&gw->freelock);
+
+	return i;
+}
+
+static void gw_release(atmi_gw_t *gw, uint32_t i)
+{
+	gw_entry_t *e = &gw->entries[i];
+
+	memset(&e->ctx, 0, sizeof(e->ctx));
+	memset(&e->cs, 0, sizeof(e->cs));
+
+	GW_LOCK(&gw->freelock);
+	e->next  = gw->free;
+	gw->free = i;
+	gw->ninflight--;
+	GW_UNLOCK(&gw->freelock);
+}
+
+
+/* Unlink and return the entry for key, or ATMI_GW_NIL. */
+static uint32_t gw_take(atmi_gw_t *gw, const uint8_t *key, int type)
+{
+	uint32_t    b = gw_hash(gw, key);
+	uint32_t   *link, i;
+	gw_lock_t  *l = gw_stripe(gw, b);
+
+	GW_LOCK(l);
+	for(link = &gw->buckets[b]; (i = *link) != ATMI_GW_NIL;
+	    link = &gw->entries[i].next) {
+		if(!memcmp(gw->entries[i].key, key, ATMI_GW_KEY_SIZE)) {
+			if(type >= 0 && gw->entries[i].type != (uint8_t)type)
+				i = ATMI_GW_MISMATCH;
+			else
+				*link = gw->entries[i].next;
+			break;
+		}
+	}
+	GW_UNLOCK(l);
+
+	return i;
+}
+
+
+
+atmi_gw_t *ATMIgw_create(size_t capacity)
+{
+	atmi_gw_t  *gw;
+	uint32_t    nb, i;
+
+	if(capacity == 0u || capacity >= ATMI_GW_MISMATCH ||
+	   capacity > SIZE_MAX / sizeof(gw_entry_t))
+		return NULL;
+
+	for(nb = 1u; nb < capacity && nb < (1uL << 31); nb <<= 1)
+		;
+
+	gw = ATMIpriv_calloc(1u, sizeof(*gw));
+	if(!gw)
+		return NULL;
+
+	gw->buckets = ATMIpriv_malloc(nb * sizeof(gw->buckets[0]));
+	gw->entries = ATMIpriv_malloc(capacity * sizeof(gw->entries[0]));
+	if(!gw->buckets || !gw->entries) {
+		ATMIpriv_free(gw->buckets);
+		ATMIpriv_free(gw->entries);
+		ATMIpriv_free(gw);
+		return NULL;
+	}
+
+	gw->mask = nb - 1u;
+	for(i = 0u; i < nb; i++)
+		gw->buckets[i] = ATMI_GW_NIL;
+	for(i = 0u; i < capacity; i++)
+		gw->entries[i].next = (i + 1u < capacity) ? i + 1u : ATMI_GW_NIL;
+	gw->free = 0u;
+
+	for(i = 0u; i < ATMI_GW_STRIPES; i++)
+		GW_LOCK_INIT(&gw->stripes[i]);
+	GW_LOCK_INIT(&gw->freelock);
+
+	ATMIrng_fill(gw->salt, sizeof(gw->salt));
+	return gw;
+}
+
+
+void ATMIgw_destroy(atmi_gw_t *gw)
+{
+	unsigned  i;
+
+	if(!gw)
+		return;
+
+	for(i = 0u; i < ATMI_GW_STRIPES; i++)
+		GW_LOCK_FINI(&gw->stripes[i]);
+	GW_LOCK_FINI(&gw->freelock);
+
+	ATMIpriv_free(gw->buckets);
+	ATMIpriv_free(gw->entries);
+	ATMIpriv_free(gw);
+}
+
+
+size_t ATMIgw_inflight(atmi_gw_t *gw)
+{
+	size_t  n;
+
+	if(!gw)
+		return 0u;
+
+	GW_LOCK(&gw->freelock);
+	n = gw->ninflight;
+	GW_UNLOCK(&gw->freelock);
+
+	return n;
+}
+
+
+
+typedef int (*gw_pack_fn)(const atmi_context_t *, atmi_session_compact_t *,
+                          const void *, uint8_t *, size_t, size_t);
+
+static int gw_pack_act(const atmi_context_t *ctx, atmi_session_compact_t *cs,
+                       const void *req, uint8_t *pkt, size_t npkt, size_t h)
+{
+	return ATMIpack_act_request_compact(ctx, cs, req, pkt, npkt, h);
+}
+
+static int gw_pack_val(const atmi_context_t *ctx, atmi_session_compact_t *cs,
+                       const void *req, uint8_t *pkt, size_t npkt, size_t h)
+{
+	return ATMIpack_val_request_compact(ctx, cs, req, pkt, npkt, h);
+}
+
+static int gw_pack_rep(const atmi_context_t *ctx, atmi_session_compact_t *cs,
+                       const void *req, uint8_t *pkt, size_t npkt, size_t h)
+{
+	return ATMIpack_rep_request_compact(ctx, cs, req, pkt, npkt, h);
+}
+
+static int gw_pack(atmi_gw_t *gw, const atmi_context_t *ctx, const void *req,
+                   gw_pack_fn fn, uint8_t type, uint8_t *key,
+                   uint8_t *pkt, size_t npkt)
+{
+	gw_entry_t     *e;
+	uint64_t        seq;
+	uint32_t        i, b;
+	gw_lock_t      *l;
+	int             r;
+
+	if(!gw || !ctx || !req || !key || !pkt)
+		return -EINVAL;
+
+	i = gw_alloc(gw);
+	if(i == ATMI_GW_NIL)
+		return -ENOSPC;
+	e = &gw->entries[i];
+
+	r = fn(ctx, &e->cs, req, pkt, npkt, 0u);
+	if(r <= 0) {
+		gw_release(gw, i);
+		return r;
+	}
+
+	memcpy(&e->ctx, ctx, sizeof(e->ctx));
+	e->type = type;
+
+	/* Request key: gateway salt, then a sequence number. */
+	seq = __atomic_fetch_add(&gw->seq, 1u, __ATOMIC_RELAXED);
+	memcpy(e->key, gw->salt, sizeof(gw->salt));
+	memcpy(e->key + sizeof(gw->salt), &seq, sizeof(seq));
+	memcpy(key, e->key, ATMI_GW_KEY_SIZE);
+
+	b = gw_hash(gw, e->key);
+	l = gw_stripe(gw, b);
+	GW_LOCK(l);
+	e->next = gw->buckets[b];
+	gw->buckets[b] = i;
+	GW_UNLOCK(l);
+
+	return r;
+}
+
+
+typedef int (*gw_unpack_fn)(const atmi_context_t *,
+                            const atmi_session_compact_t *,
+                            const void *, size_t, void *);
+
+static int gw_unpack_act(const atmi_context_t *ctx,
+                         const atmi_session_compact_t *cs,
+                         const void *pin, size_t nin, void *out)
+{
+	return ATMIunpack_act_response_compact(ctx, cs, pin, nin, out);
+}
+
+static int gw_unpack_val(const atmi_context_t *ctx,
+                         const atmi_session_compact_t *cs,
+                         const void *pin, size_t nin, void *out)
+{
+	return ATMIunpack_val_response_compact(ctx, cs, pin, nin, out);
+}
+
+static int gw_unpack_rep(const atmi_context_t *ctx,
+                         const atmi_session_compact_t *cs,
+                         const void *pin, size_t nin, void *out)
+{
+	return ATMIunpack_rep_response_compact(ctx, cs, pin, nin, out);
+}
+
+static int gw_unpack(atmi_gw_t *gw, const uint8_t *key,
+                     const void *pinbuf, size_t nin, void *out,
+                     gw_unpack_fn fn, uint8_t type)
+{
+	gw_entry_t     *e;
+	atmi_peek_t     pk;
+	uint32_t        i;
+	int             r;
+
+	if(!gw || !key || !pinbuf || !out)
+		return -EINVAL;
+
+	i = gw_take(gw, key, type);
+	if(i == ATMI_GW_NIL)
+		return -ESRCH;
+	if(i == ATMI_GW_MISMATCH)
+		return -EINVAL;
+	e = &gw->entries[i];
+
+	/* Shed garbage without spending a decryption on it. */
+	r = ATMIpeek_response(pinbuf, nin, &pk);
+	if(r == 0 && pk.type != type && pk.type != ATMI_PKT_TYPE_STOP)
+		r = -ENOENT;
+	if(r == 0)
+		r = fn(&e->ctx, &e->cs, pinbuf, nin, out);
+
+	gw_release(gw, i);
+	return r;
+}
+
+
+
+int ATMIgw_pack_act_request(atmi_gw_t *gw, const atmi_context_t *ctx,
+                            const atmi_act_request_t *act,
+                            uint8_t key[ATMI_GW_KEY_SIZE],
+                            uint8_t *pkt, size_t npkt)
+{
+	return gw_pack(gw, ctx, act, gw_pack_act,
+	               ATMI_PKT_TYPE_ACT_RESP, key, pkt, npkt);
+}
+
+int ATMIgw_pack_val_request(atmi_gw_t *gw, const atmi_context_t *ctx,
+                            const atmi_val_request_t *val,
+                            uint8_t key[ATMI_GW_KEY_SIZE],
+                            uint8_t *pkt, size_t npkt)
+{
+	return gw_pack(gw, ctx, val, gw_pack_val,
+	               ATMI_PKT_TYPE_VAL_RESP, key, pkt, npkt);
+}
+
+int ATMIgw_pack_rep_request(atmi_gw_t *gw, const atmi_context_t *ctx,
+                            atmi_rep_request_t *rep,
+                            uint8_t key[ATMI_GW_KEY_SIZE],
+                            uint8_t *pkt, size_t npkt)
+{
+	return gw_pack(gw, ctx, rep, gw_pack_rep,
+	               ATMI_PKT_TYPE_REP_RESP, key, pkt, npkt);
+}
+
+
+int ATMIgw_unpack_act_response(atmi_gw_t *gw,
+                               const uint8_t key[ATMI_GW_KEY_SIZE],
+                               const void *pinbuf, size_t nin,
+                               atmi_act_response_t *act)
+{
+	return gw_unpack(gw, key, pinbuf, nin, act,
+	                 gw_unpack_act, ATMI_PKT_TYPE_ACT_RESP);
+}
+
+int ATMIgw_unpack_val_response(atmi_gw_t *gw,
+                               const uint8_t key[ATMI_GW_KEY_SIZE],
+                               const void *pinbuf, size_t nin,
+                               atmi_val_response_t *val)
+{
+	return gw_unpack(gw, key, pinbuf, nin, val,
+	                 gw_unpack_val, ATMI_PKT_TYPE_VAL_RESP);
+}
+
+int ATMIgw_unpack_rep_response(atmi_gw_t *gw,
+                               const uint8_t key[ATMI_GW_KEY_SIZE],
+                               const void *pinbuf, size_t nin,
+                               atmi_rep_response_t *rep)
+{
+	return gw_unpack(gw, key, pinbuf, nin, rep,
+	                 gw_unpack_rep, ATMI_PKT_TYPE_REP_RESP);
+}
+
+
+int ATMIgw_cancel(atmi_gw_t *gw, const uint8_t key[ATMI_GW_KEY_SIZE])
+{
+	uint32_t  i;
+
+	if(!gw || !key)
+		return -EINVAL;
+
+	i = gw_take(gw, key, -1);
+	if(i == ATMI_GW_NIL)
+		return -ESRCH;
+
+	gw_release(gw, i);
+	return 0;
+}
+
+#endif /*ATMI_NO_HEAP*/
@@ -0,0 +1,154 @@
+/*
+ * Atonomi Device SDK: Heap-free Builds
+ *
+ * Copyright (C) 2018 Atonomi
+ *
+ * Link-time wrappers (GNU ld --wrap) around the C library's allocator.
+ * Nothing refers to this file's symbols unless the program is linked with
+ * ATMI_HEAP_LDFLAGS, whose --undefined pulls it in ahead of the prebuilt
+ * library; none of them calls through to the real allocator, so none is
+ * linked.
+ */
+#include "atmi_heap.h"
+
+#ifdef ATMI_NO_HEAP
+
+#include <string.h>
+
+#ifndef ATMI_HEAP_LOCK
+#if !defined(__ARM_ARCH_6M__) && !defined(__ARM_ARCH_7M__)
+static char heap_lock;
+#define ATMI_HEAP_LOCK()                                                \
+	do { } while(__atomic_test_and_set(&heap_lock, __ATOMIC_ACQUIRE))
+#define ATMI_HEAP_UNLOCK()                                              \
+	__atomic_clear(&heap_lock, __ATOMIC_RELEASE)
+#else
+#define ATMI_HEAP_LOCK()        do { } while(0)
+#define ATMI_HEAP_UNLOCK()      do { } while(0)
+#endif
+#endif
+
+typedef char atmi_heap_blocks_check[(ATMI_HEAP_BLOCKS <= 32u) ? 1 : -1];
+
+
+const int ATMIpriv_heap_linked = 1;
+
+static union {
+	uint8_t   b[ATMI_HEAP_BLOCK_SIZE];
+	uint64_t  align;
+} heap_pool[ATMI_HEAP_BLOCKS];
+
+static uint32_t  heap_used;            /* Bit n set: block n in use.    */
+static unsigned  heap_nused;
+static unsigned  heap_hwm;
+static unsigned  heap_nfailed;
+
+
+void *__wrap_malloc(size_t n);
+void *__wrap_calloc(size_t nmemb, size_t size);
+void *__wrap_realloc(void *p, size_t n);
+void  __wrap_free(void *p);
+
+
+/* Index of the pool block at p, or -1 if p is not one. */
+static int heap_block(const void *p)
+{
+	uintptr_t  a    = (uintptr_t)p;
+	uintptr_t  base = (uintptr_t)heap_pool;
+	size_t     i;
+
+	if(a < base || a >= base + sizeof(heap_pool))
+		return -1;
+
+	i = (size_t)(a - base) / sizeof(heap_pool[0]);
+	return (p == heap_pool[i].b) ? (int)i : -1;
+}
+
+static void heap_refuse(void)
+{
+	ATMI_HEAP_LOCK();
+	heap_nfailed++;
+	ATMI_HEAP_UNLOCK();
+}
+
+
+void *__wrap_malloc(size_t n)
+{
+	unsigned  i;
+	void     *p = NULL;
+
+	ATMI_HEAP_LOCK();
+
+	if(n <= ATMI_HEAP_BLOCK_SIZE) {
+		for(i = 0u; i < ATMI_HEAP_BLOCKS; i++) {
+			if( !(heap_used & (1uL << i)) ) {
+				heap_used |= (1uL << i);
+				p = heap_pool[i].b;
+				if(++heap_nused > heap_hwm)
+					heap_hwm = heap_nused;
+				break;
+			}
+		}
+	}
+
+	if(!p)
+		heap_nfailed++;
+
+	ATMI_HEAP_UNLOCK();
+	return p;
+}
+
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+	void *p;
+
+	if(size && nmemb > ATMI_HEAP_BLOCK_SIZE / size) {
+		heap_refuse();
+		return NULL;
+	}
+
+	if( (p = __wrap_malloc(nmemb * size)) != NULL )
+		memset(p, 0, nmemb * size);
+	return p;
+}
+
+
+void *__wrap_realloc(void *p, size_t n)
+{
+	if(!p)
+		return __wrap_malloc(n);
+
+	/* Every block already holds as much as any allocation may. */
+	if(heap_block(p) < 0 || n > ATMI_HEAP_BLOCK_SIZE) {
+		heap_refuse();
+		return NULL;
+	}
+	return p;
+}
+
+
+void __wrap_free(void *p)
+{
+	int i;
+
+	if( (i = heap_block(p)) < 0 )
+		return;
+
+	ATMI_HEAP_LOCK();
+	if(heap_used & (1uL << i)) {
+		heap_used &= ~(1uL << i);
+		heap_nused--;
+	}
+	ATMI_HEAP_UNLOCK();
+}
+
+
+unsigned ATMIheap_high_water(unsigned *nfailed)
+{
+	if(nfailed)
+		*nfailed = heap_nfailed;
+	return heap_hwm;
+}
+
+#endif /*ATMI_NO_HEAP*/
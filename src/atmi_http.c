@@ -0,0 +1,831 @@
+/*
+ * Atonomi Device SDK: HTTP/1.1 Transport
+ *
+ * Copyright (C) 2018 Atonomi
+ */
+#if defined(__linux__) && !defined(ATMI_NO_HEAP)
+
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "atmi_http.h"
+#include "atmi_zc.h"
+#include "atmi_priv.h"
+
+
+#define HTTP_RXBUF_SIZE     (8192u)     /* Fits aggregated responses. */
+#define HTTP_HDR_MAX        (512u)
+#define HTTP_MAX_EVENTS     (32)
+#define HTTP_MAX_IOV        (16)
+
+enum { CONN_CLOSED, CONN_CONNECTING, CONN_OPEN };
+
+
+typedef struct http_req {
+	struct http_req    *next;
+	atmi_http_done_fn   done;
+	void               *arg;
+	uint64_t            t0;
+	uint64_t            deadline;
+	int                 retried;   /* Requeued after a connection loss. */
+	int                 borrowed;  /* frame is the caller's, not buf[]. */
+	uint8_t            *frame;     /* Header and body.                  */
+	size_t              len;
+	uint8_t             buf[];
+} http_req_t;
+
+typedef struct {
+	int          fd;
+	int          state;
+	uint32_t     events;           /* As registered with epoll.         */
+	unsigned     n;                /* Requests in head..tail.           */
+	int          reused;           /* Has answered a request.           */
+	http_req_t  *head, *tail;      /* Sent or sending, oldest first.    */
+	http_req_t  *wr;               /* First not yet completely written. */
+	size_t       wroff;
+	size_t       nrx;
+	uint8_t      rx[HTTP_RXBUF_SIZE];
+} http_conn_t;
+
+struct atmi_http {
+	int                      epfd;
+	struct sockaddr_storage  addr;
+	socklen_t                addrlen;
+	char                    *host;
+	char                    *paths[ATMI_HTTP_NENDPOINTS];
+	unsigned                 depth;
+	unsigned                 nconns;
+	uint64_t                 timeout;          /* In nanoseconds.       */
+	http_req_t              *qhead, *qtail;    /* Not yet dispatched.   */
+	http_req_t              *spare;            /* Borrowed, for reuse.  */
+	size_t                   noutstanding;
+	http_conn_t              conns[];
+};
+
+
+static const char *const http_default_paths[ATMI_HTTP_NENDPOINTS] = {
+	[ATMI_HTTP_ACT]       = "/activate",
+	[ATMI_HTTP_VAL]       = "/validate",
+	[ATMI_HTTP_REP]       = "/reputation",
+	[ATMI_HTTP_REP_MULTI] = "/reputation/multi",
+};
+
+
+static uint64_t http_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+
+/* strdup(), from the heap the SDK's own tables come from (atmi_priv.h). */
+static char *http_strdup(const char *s)
+{
+	size_t  n = strlen(s) + 1u;
+	char   *d;
+
+	if( (d = ATMIpriv_malloc(n)) != NULL )
+		memcpy(d, s, n);
+	return d;
+}
+
+
+static void http_complete(atmi_http_t *h, http_req_t *rq, int status,
+                          const uint8_t *body, size_t nbody)
+{
+	atmi_http_done_fn  done = rq->done;
+	void              *arg  = rq->arg;
+	uint64_t           t0   = rq->t0;
+
+	/* Recycled first, as the callback may well queue another request. */
+	h->noutstanding--;
+	if(rq->borrowed) {
+		rq->next = h->spare;
+		h->spare = rq;
+	} else {
+		ATMIpriv_free(rq);
+	}
+
+	done(arg, status, body, nbody, http_now() - t0);
+}
+
+
+static void conn_watch(atmi_http_t *h, http_conn_t *c)
+{
+	struct epoll_event  ev;
+	uint32_t            events;
+
+	if(c->state == CONN_CONNECTING)
+		events = EPOLLOUT;
+	else
+		events = EPOLLIN | (c->wr ? EPOLLOUT : 0u);
+
+	if(events != c->events) {
+		ev.events   = events;
+		ev.data.ptr = c;
+		(void)epoll_ctl(h->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+		c->events = events;
+	}
+}
+
+
+/*
+ * Close a connection, failing its requests with the given status. If
+ * requeue is set, requests the server has not seen any part of go back on
+ * the queue instead. Returns the number of requests completed.
+ */
+static int conn_close(atmi_http_t *h, http_conn_t *c, int status,
+                      int requeue)
+{
+	http_req_t  *rq, *next, *unsent;
+	int          ncomplete = 0;
+
+	if(c->state == CONN_CLOSED)
+		return 0;
+
+	(void)epoll_ctl(h->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+	(void)close(c->fd);
+
+	unsent = requeue ? c->wr : NULL;
+	if(unsent && c->wroff > 0u)
+		unsent = unsent->next;
+
+	for(rq = c->head; rq && rq != unsent; rq = next) {
+		next = rq->next;
+		http_complete(h, rq, status, NULL, 0u);
+		ncomplete++;
+	}
+
+	if(unsent) {
+		c->tail->next = h->qhead;
+		if(!h->qhead)
+			h->qtail = c->tail;
+		h->qhead = unsent;
+	}
+
+	c->fd     = -1;
+	c->state  = CONN_CLOSED;
+	c->events = 0u;
+	c->n      = 0u;
+	c->reused = 0;
+	c->head   = c->tail = c->wr = NULL;
+	c->wroff  = 0u;
+	c->nrx    = 0u;
+	return ncomplete;
+}
+
+/*
+ * Close a connection the server has dropped. If it had answered earlier
+ * requests and nothing of the next response had arrived, it was most
+ * likely closed as idle while these were sent: each request not already
+ * retried goes back on the queue for a fresh connection, and the rest
+ * fail. Otherwise only the unsent requests are requeued. Returns the
+ * number of requests completed.
+ */
+static int conn_lost(atmi_http_t *h, http_conn_t *c)
+{
+	http_req_t  *rq, *next, *last = NULL;
+	http_req_t  *retry = NULL, **rtail = &retry;
+	http_req_t  *fail = NULL, **ftail = &fail;
+
+	if(!c->reused || c->nrx > 0u)
+		return conn_close(h, c, -EPIPE, 1);
+
+	for(rq = c->head; rq; rq = next) {
+		next = rq->next;
+		if(rq->retried) {
+			*ftail = rq;
+			ftail  = &rq->next;
+		} else {
+			rq->retried = 1;
+			*rtail = last = rq;
+			rtail  = &rq->next;
+		}
+	}
+	*ftail = NULL;
+	*rtail = h->qhead;
+
+	if(retry) {
+		if(!h->qhead)
+			h->qtail = last;
+		h->qhead = retry;
+	}
+
+	c->head = fail;
+	c->wr   = NULL;
+	return conn_close(h, c, -EPIPE, 0);
+}
+
+
+static int conn_open(atmi_http_t *h, http_conn_t *c)
+{
+	struct epoll_event  ev;
+	int                 on = 1;
+
+	c->fd = socket(h->addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	if(c->fd < 0)
+		return -1;
+
+	(void)setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+	if(connect(c->fd, (struct sockaddr *)&h->addr, h->addrlen) < 0 &&
+	   errno != EINPROGRESS) {
+		(void)close(c->fd);
+		return -1;
+	}
+
+	c->state    = CONN_CONNECTING;
+	c->events   = EPOLLOUT;
+	ev.events   = c->events;
+	ev.data.ptr = c;
+	if(epoll_ctl(h->epfd, EPOLL_CTL_ADD, c->fd, &ev) < 0) {
+		(void)close(c->fd);
+		c->state = CONN_CLOSED;
+		return -1;
+	}
+
+	return 0;
+}
+
+
+static int conn_flush(http_conn_t *c)
+{
+	struct iovec  iov[HTTP_MAX_IOV];
+	http_req_t   *rq;
+	ssize_t       w;
+	size_t        n;
+	int           i;
+
+	while(c->wr) {
+		for(i = 0, rq = c->wr; rq && i < HTTP_MAX_IOV; rq = rq->next, i++) {
+			iov[i].iov_base = rq->frame + ((i == 0) ? c->wroff : 0u);
+			iov[i].iov_len  = rq->len - ((i == 0) ? c->wroff : 0u);
+		}
+
+		w = writev(c->fd, iov, i);
+		if(w < 0)
+			return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+
+		for(n = (size_t)w; c->wr && n >= c->wr->len - c->wroff; ) {
+			n       -= c->wr->len - c->wroff;
+			c->wr    = c->wr->next;
+			c->wroff = 0u;
+		}
+		c->wroff += n;
+	}
+
+	return 0;
+}
+
+
+/*
+ * Walk a chunked body of which n bytes have been received at p. If it is
+ * complete, sets *nbody to its decoded length and *nenc to the length of
+ * its encoding, trailer included, and returns 1; if decode is set, the
+ * chunks' data are also moved together at p. Returns 0 if more is needed,
+ * or -1 if the encoding is malformed.
+ */
+static int http_chunked(uint8_t *p, size_t n, int decode, size_t *nbody,
+                        size_t *nenc)
+{
+	const uint8_t  *eol;
+	size_t          off = 0u, body = 0u, size, len;
+	unsigned        d;
+	int             x = 0;
+
+	for(;;) {
+		if( !(eol = memmem(p + off, n - off, "\r\n", 2u)) )
+			return 0;
+		len = (size_t)(eol - (p + off));
+
+		/* Hex size, then any extensions after a ';'. */
+		for(size = 0u, d = 0u; d < len; d++) {
+			x = p[off + d];
+			if(!isxdigit(x))
+				break;
+			if(size > HTTP_RXBUF_SIZE)
+				return -1;
+			x    = isdigit(x) ? x - '0' : tolower(x) - 'a' + 10;
+			size = size * 16u + (size_t)x;
+		}
+		if(d == 0u || (d < len && x != ';' && x != ' ' && x != '\t'))
+			return -1;
+		off += len + 2u;
+
+		if(size == 0u)
+			break;
+		if(size > HTTP_RXBUF_SIZE)
+			return -1;
+		if(size > n - off || n - off - size < 2u)
+			return 0;
+		if(p[off + size] != '\r' || p[off + size + 1u] != '\n')
+			return -1;
+
+		if(decode)
+			memmove(p + body, p + off, size);
+		body += size;
+		off  += size + 2u;
+	}
+
+	/* Trailer fields, up to an empty line. */
+	do {
+		if( !(eol = memmem(p + off, n - off, "\r\n", 2u)) )
+			return 0;
+		len  = (size_t)(eol - (p + off));
+		off += len + 2u;
+	} while(len > 0u);
+
+	*nbody = body;
+	*nenc  = off;
+	return 1;
+}
+
+
+/*
+ * Parse complete responses from the receive buffer, completing requests
+ * in order. Returns the number completed. *status is set nonzero if the
+ * connection must then be closed: negative for an error with which to fail
+ * any requests still outstanding on it, or positive if the server asked to
+ * close after its last response.
+ */
+static int conn_parse(atmi_http_t *h, http_conn_t *c, int *status)
+{
+	const uint8_t  *hdrend;
+	char            hdr[HTTP_HDR_MAX], *line, *save;
+	size_t          hdrlen, clen, total;
+	int             code, ncomplete = 0, close_after, have_clen, chunked;
+	int             r;
+	http_req_t     *rq;
+
+	*status = 0;
+
+	while(c->nrx > 0u) {
+		hdrend = memmem(c->rx, c->nrx, "\r\n\r\n", 4u);
+		if(!hdrend) {
+			if(c->nrx >= sizeof(hdr))
+				*status = -EIO;
+			return ncomplete;
+		}
+
+		hdrlen = (size_t)(hdrend - c->rx) + 4u;
+		if(hdrlen > sizeof(hdr)) {
+			*status = -EIO;
+			return ncomplete;
+		}
+		memcpy(hdr, c->rx, hdrlen - 4u);
+		hdr[hdrlen - 4u] = '\0';
+
+		if(sscanf(hdr, "HTTP/1.%*u %d", &code) != 1) {
+			*status = -EIO;
+			return ncomplete;
+		}
+
+		clen        = 0u;
+		have_clen   = 0;
+		chunked     = 0;
+		close_after = !strncmp(hdr, "HTTP/1.0", 8u);
+		line        = strtok_r(hdr, "\r\n", &save);
+		while( (line = strtok_r(NULL, "\r\n", &save)) ) {
+			if(!strncasecmp(line, "Content-Length:", 15u)) {
+				clen      = strtoul(line + 15, NULL, 10);
+				have_clen = 1;
+			}
+			else if(!strncasecmp(line, "Transfer-Encoding:", 18u)) {
+				/* No coding but chunked is accepted. */
+				chunked = strcasestr(line + 18, "chunked")
+				          ? 1 : -1;
+			}
+			else if(!strncasecmp(line, "Connection:", 11u) &&
+			        strcasestr(line + 11, "close")) {
+				close_after = 1;
+			}
+		}
+
+		/* Interim responses carry no body and answer nothing. */
+		if(code >= 100 && code < 200) {
+			memmove(c->rx, c->rx + hdrlen, c->nrx - hdrlen);
+			c->nrx -= hdrlen;
+			continue;
+		}
+
+		/* These never have a body. */
+		if(code == 204 || code == 304) {
+			have_clen = 1;
+			clen      = 0u;
+			chunked   = 0;
+		}
+
+		/* A body ended by closing the connection cannot be told apart
+		 * from a lost connection. */
+		if(chunked < 0 || (!chunked && !have_clen)) {
+			*status = -EPROTO;
+			return ncomplete;
+		}
+
+		/* A response must follow the whole of its request. */
+		if((!chunked && clen > sizeof(c->rx) - hdrlen) ||
+		   !c->head || c->head == c->wr) {
+			*status = -EIO;
+			return ncomplete;
+		}
+
+		if(chunked) {
+			r = http_chunked(c->rx + hdrlen, c->nrx - hdrlen, 0,
+			                 &clen, &total);
+			if(r == 0 && c->nrx == sizeof(c->rx))
+				r = -1;
+			if(r <= 0) {
+				if(r < 0)
+					*status = -EIO;
+				return ncomplete;
+			}
+			(void)http_chunked(c->rx + hdrlen, c->nrx - hdrlen, 1,
+			                   &clen, &total);
+			total += hdrlen;
+		}
+		else {
+			total = hdrlen + clen;
+			if(c->nrx < total)
+				return ncomplete;
+		}
+
+		rq      = c->head;
+		c->head = rq->next;
+		if(!c->head)
+			c->tail = NULL;
+		c->n--;
+
+		c->reused = 1;
+		http_complete(h, rq, code, c->rx + hdrlen, clen);
+		ncomplete++;
+
+		memmove(c->rx, c->rx + total, c->nrx - total);
+		c->nrx -= total;
+
+		if(close_after) {
+			*status = 1;
+			return ncomplete;
+		}
+	}
+
+	return ncomplete;
+}
+
+
+static int conn_event(atmi_http_t *h, http_conn_t *c, uint32_t events)
+{
+	int        err = 0, status, ncomplete = 0;
+	socklen_t  len = sizeof(err);
+	ssize_t    n;
+
+	if(c->state == CONN_CONNECTING) {
+		if(getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err)
+			return conn_close(h, c, -EPIPE, 0);
+		c->state = CONN_OPEN;
+	}
+
+	if(events & EPOLLIN) {
+		for(;;) {
+			n = recv(c->fd, c->rx + c->nrx, sizeof(c->rx) - c->nrx, 0);
+			if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+				break;
+			if(n <= 0)
+				return ncomplete + conn_lost(h, c);
+
+			c->nrx    += (size_t)n;
+			ncomplete += conn_parse(h, c, &status);
+			if(status > 0)
+				return ncomplete + conn_lost(h, c);
+			if(status < 0)
+				return ncomplete + conn_close(h, c, status, 0);
+		}
+	}
+	else if(events & (EPOLLERR | EPOLLHUP)) {
+		return conn_lost(h, c);
+	}
+
+	if(conn_flush(c) < 0)
+		return ncomplete + conn_lost(h, c);
+
+	conn_watch(h, c);
+	return ncomplete;
+}
+
+
+/* Hand queued requests to the least loaded connections with room. */
+static void http_dispatch(atmi_http_t *h)
+{
+	http_conn_t  *c, *best;
+	http_req_t   *rq;
+	unsigned      i;
+
+	while(h->qhead) {
+		for(best = NULL, i = 0u; i < h->nconns; i++) {
+			c = &h->conns[i];
+			if(c->n < h->depth && (!best || c->n < best->n))
+				best = c;
+		}
+		if(!best)
+			break;
+
+		if(best->state == CONN_CLOSED && conn_open(h, best) < 0) {
+			rq = h->qhead;
+			h->qhead = rq->next;
+			http_complete(h, rq, -EPIPE, NULL, 0u);
+			continue;
+		}
+
+		rq       = h->qhead;
+		h->qhead = rq->next;
+		rq->next = NULL;
+
+		if(best->tail)
+			best->tail->next = rq;
+		else
+			best->head = rq;
+		best->tail = rq;
+		if(!best->wr) {
+			best->wr    = rq;
+			best->wroff = 0u;
+		}
+		best->n++;
+	}
+	if(!h->qhead)
+		h->qtail = NULL;
+
+	for(i = 0u; i < h->nconns; i++) {
+		c = &h->conns[i];
+		if(c->state == CONN_OPEN && c->wr) {
+			if(conn_flush(c) < 0)
+				(void)conn_lost(h, c);
+			else
+				conn_watch(h, c);
+		}
+	}
+}
+
+
+/*
+ * Fail requests whose timeout has passed, closing the connections they
+ * were sent on. Returns the number completed, and sets *next to the
+ * earliest deadline still pending, or UINT64_MAX if none is.
+ */
+static int http_expire(atmi_http_t *h, uint64_t *next)
+{
+	uint64_t      now = http_now();
+	http_conn_t  *c;
+	http_req_t   *rq;
+	unsigned      i;
+	int           ncomplete = 0;
+
+	/* Each connection's oldest request is the first to expire. */
+	for(i = 0u; i < h->nconns; i++) {
+		c = &h->conns[i];
+		if(c->head && c->head->deadline <= now)
+			ncomplete += conn_close(h, c, -ETIMEDOUT, 1);
+	}
+
+	/* Requeued requests precede all others, so the queue is in order. */
+	while( (rq = h->qhead) && rq->deadline <= now ) {
+		h->qhead = rq->next;
+		http_complete(h, rq, -ETIMEDOUT, NULL, 0u);
+		ncomplete++;
+	}
+	if(!h->qhead)
+		h->qtail = NULL;
+
+	*next = h->qhead ? h->qhead->deadline : UINT64_MAX;
+	for(i = 0u; i < h->nconns; i++) {
+		c = &h->conns[i];
+		if(c->head && c->head->deadline < *next)
+			*next = c->head->deadline;
+	}
+
+	return ncomplete;
+}
+
+
+atmi_http_t *ATMIhttp_create(const atmi_http_config_t *cfg)
+{
+	static const atmi_http_config_t  defcfg;
+	struct addrinfo                  hints, *ai;
+	atmi_http_t                     *h;
+	const char                      *host;
+	char                             port[8];
+	unsigned                         nconns, i;
+
+	if(!cfg)
+		cfg = &defcfg;
+
+	host   = cfg->host ? cfg->host : "device.atonomi.net";
+	nconns = cfg->nconns ? cfg->nconns : 4u;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family   = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	(void)snprintf(port, sizeof(port), "%u",
+	               (unsigned)(cfg->port ? cfg->port : 80u));
+	if(getaddrinfo(host, port, &hints, &ai) != 0)
+		return NULL;
+
+	h = ATMIpriv_calloc(1u, sizeof(*h) + nconns*sizeof(h->conns[0]));
+	if(!h) {
+		freeaddrinfo(ai);
+		return NULL;
+	}
+
+	memcpy(&h->addr, ai->ai_addr, ai->ai_addrlen);
+	h->addrlen = ai->ai_addrlen;
+	freeaddrinfo(ai);
+
+	h->nconns  = nconns;
+	h->depth   = cfg->depth ? cfg->depth : 8u;
+	h->timeout = (uint64_t)(cfg->timeout_ms ? cfg->timeout_ms : 10000u) *
+	             1000000u;
+	h->host    = http_strdup(host);
+	for(i = 0u; i < ATMI_HTTP_NENDPOINTS; i++)
+		h->paths[i] = http_strdup(cfg->paths[i] ? cfg->paths[i] :
+		                          http_default_paths[i]);
+	for(i = 0u; i < nconns; i++)
+		h->conns[i].fd = -1;
+	h->epfd = epoll_create1(EPOLL_CLOEXEC);
+
+	if(h->epfd < 0 || !h->host || !h->paths[ATMI_HTTP_ACT] ||
+	   !h->paths[ATMI_HTTP_VAL] || !h->paths[ATMI_HTTP_REP] ||
+	   !h->paths[ATMI_HTTP_REP_MULTI]) {
+		ATMIhttp_destroy(h);
+		return NULL;
+	}
+
+	return h;
+}
+
+
+void ATMIhttp_destroy(atmi_http_t *h)
+{
+	http_req_t  *rq, *next;
+	http_conn_t *c;
+	unsigned     i;
+
+	if(!h)
+		return;
+
+	for(i = 0u; i < h->nconns; i++) {
+		c = &h->conns[i];
+		if(c->state != CONN_CLOSED)
+			(void)close(c->fd);
+		for(rq = c->head; rq; rq = next) {
+			next = rq->next;
+			ATMIpriv_free(rq);
+		}
+	}
+	for(rq = h->qhead; rq; rq = next) {
+		next = rq->next;
+		ATMIpriv_free(rq);
+	}
+	for(rq = h->spare; rq; rq = next) {
+		next = rq->next;
+		ATMIpriv_free(rq);
+	}
+
+	if(h->epfd >= 0)
+		(void)close(h->epfd);
+	for(i = 0u; i < ATMI_HTTP_NENDPOINTS; i++)
+		ATMIpriv_free(h->paths[i]);
+	ATMIpriv_free(h->host);
+	ATMIpriv_free(h);
+}
+
+
+static void http_enqueue(atmi_http_t *h, http_req_t *rq,
+                         atmi_http_done_fn done, void *arg)
+{
+	rq->done     = done;
+	rq->arg      = arg;
+	rq->next     = NULL;
+	rq->t0       = http_now();
+	rq->deadline = rq->t0 + h->timeout;
+	rq->retried  = 0;
+
+	if(h->qtail)
+		h->qtail->next = rq;
+	else
+		h->qhead = rq;
+	h->qtail = rq;
+	h->noutstanding++;
+}
+
+
+int ATMIhttp_put(atmi_http_t *h, unsigned ep, const void *pkt, size_t npkt,
+                 atmi_http_done_fn done, void *arg)
+{
+	http_req_t  *rq;
+	int          off;
+
+	if(!h || ep >= ATMI_HTTP_NENDPOINTS || !pkt || !npkt || !done)
+		return -EINVAL;
+
+	rq = ATMIpriv_malloc(sizeof(*rq) + HTTP_HDR_MAX + npkt);
+	if(!rq)
+		return -ENOMEM;
+
+	off = ATMIframe_http_put(rq->buf, HTTP_HDR_MAX, npkt,
+	                         h->host, h->paths[ep]);
+	if(off < 0) {
+		ATMIpriv_free(rq);
+		return -EINVAL;
+	}
+
+	memcpy(rq->buf + HTTP_HDR_MAX, pkt, npkt);
+	rq->borrowed = 0;
+	rq->frame    = rq->buf + off;
+	rq->len      = HTTP_HDR_MAX - (size_t)off + npkt;
+
+	http_enqueue(h, rq, done, arg);
+	return 0;
+}
+
+
+int ATMIhttp_put_into(atmi_http_t *h, unsigned ep, uint8_t *buf,
+                      size_t headroom, size_t npkt,
+                      atmi_http_done_fn done, void *arg)
+{
+	http_req_t  *rq;
+	int          off;
+
+	if(!h || ep >= ATMI_HTTP_NENDPOINTS || !buf || !npkt || !done)
+		return -EINVAL;
+
+	off = ATMIframe_http_put(buf, headroom, npkt, h->host, h->paths[ep]);
+	if(off < 0)
+		return off;
+
+	if( (rq = h->spare) != NULL )
+		h->spare = rq->next;
+	else if( (rq = ATMIpriv_malloc(sizeof(*rq))) == NULL )
+		return -ENOMEM;
+
+	rq->borrowed = 1;
+	rq->frame    = buf + off;
+	rq->len      = headroom - (size_t)off + npkt;
+
+	http_enqueue(h, rq, done, arg);
+	return 0;
+}
+
+
+int ATMIhttp_poll(atmi_http_t *h, int timeout_ms)
+{
+	struct epoll_event  evs[HTTP_MAX_EVENTS];
+	uint64_t            next, now;
+	int                 n, i, ncomplete;
+
+	if(!h)
+		return -EINVAL;
+
+	http_dispatch(h);
+	ncomplete = http_expire(h, &next);
+	if(h->noutstanding == 0u)
+		return ncomplete;
+
+	/* Wake for the next deadline, rounding up to whole milliseconds. */
+	now = http_now();
+	if(next != UINT64_MAX) {
+		next = (next > now) ? (next - now + 999999u) / 1000000u : 0u;
+		if(timeout_ms < 0 || (uint64_t)timeout_ms > next)
+			timeout_ms = (next < INT_MAX) ? (int)next : INT_MAX;
+	}
+
+	n = epoll_wait(h->epfd, evs, HTTP_MAX_EVENTS, timeout_ms);
+	for(i = 0; i < n; i++)
+		ncomplete += conn_event(h, evs[i].data.ptr, evs[i].events);
+	ncomplete += http_expire(h, &next);
+
+	/* Refill connections freed up by completed requests. */
+	http_dispatch(h);
+	return ncomplete;
+}
+
+
+size_t ATMIhttp_outstanding(const atmi_http_t *h)
+{
+	return h ? h->noutstanding : 0u;
+}
+
+#endif /*__linux__ && !ATMI_NO_HEAP*/
@@ -0,0 +1,182 @@
+/*
+ * Atonomi Device SDK: Precomputed Key Exchange
+ *
+ * Copyright (C) 2018 Atonomi
+ *
+ * Table of shared keys. Lookups are made by the link-time wrapper in
+ * atmi_keyx_wrap.c, which is only linked in when ATMI_KEYX_LDFLAGS redirect
+ * calls to it.
+ *
+ * Each slot is published under its own sequence count, odd while the slot
+ * is being written: readers copy a slot and discard the copy if the count
+ * changed meanwhile, so they never wait on or see a partial update.
+ */
+#include <string.h>
+#include "atmi_errno.h"
+#include "atmi_keyx.h"
+#include "atmi_priv.h"
+
+
+/* Defined by atmi_keyx_wrap.c; null unless that is linked. */
+extern const int ATMIpriv_keyx_linked __attribute__((weak));
+
+
+typedef struct {
+	uint32_t  seq;
+	uint32_t  used;
+	uint8_t   pk[32];
+	uint8_t   sk[32];
+	uint8_t   k[32];
+} keyx_slot_t;
+
+static keyx_slot_t  keyx_slots[ATMI_KEYX_SLOTS];
+static uint32_t     keyx_busy;      /* Serializes writers.            */
+static unsigned     keyx_next;      /* Slot to replace when all used.  */
+
+
+static void keyx_lock(void)
+{
+	while(__atomic_exchange_n(&keyx_busy, 1u, __ATOMIC_ACQUIRE))
+		;
+}
+
+static void keyx_unlock(void)
+{
+	__atomic_store_n(&keyx_busy, 0u, __ATOMIC_RELEASE);
+}
+
+
+/* Fill a slot, or empty it if k is NULL. Call with the writer lock held. */
+static void keyx_store(keyx_slot_t *s, const uint8_t *pk, const uint8_t *sk,
+                       const uint8_t *k)
+{
+	__atomic_store_n(&s->seq, s->seq + 1u, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	if(k) {
+		memcpy(s->pk, pk, sizeof(s->pk));
+		memcpy(s->sk, sk, sizeof(s->sk));
+		memcpy(s->k, k, sizeof(s->k));
+		s->used = 1u;
+	} else {
+		ATMIpriv_memzero(s->pk, sizeof(s->pk) + sizeof(s->sk) +
+		                        sizeof(s->k));
+		s->used = 0u;
+	}
+
+	__atomic_store_n(&s->seq, s->seq + 1u, __ATOMIC_RELEASE);
+}
+
+
+int ATMIpriv_keyx_lookup(uint8_t k[32], const uint8_t pk[32],
+                         const uint8_t sk[32])
+{
+	const keyx_slot_t *s;
+	keyx_slot_t        copy;
+	uint32_t           seq;
+	unsigned           i;
+
+	for(i = 0u; i < ATMI_KEYX_SLOTS; i++) {
+		s   = &keyx_slots[i];
+		seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+		if(seq & 1u)
+			continue;
+
+		memcpy(&copy, s, sizeof(copy));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if(__atomic_load_n(&s->seq, __ATOMIC_RELAXED) != seq)
+			continue;
+
+		if(copy.used && !memcmp(copy.pk, pk, sizeof(copy.pk)) &&
+		   !crypto_verify_32(copy.sk, sk)) {
+			memcpy(k, copy.k, sizeof(copy.k));
+			ATMIpriv_memzero(&copy, sizeof(copy));
+			return 0;
+		}
+	}
+
+	ATMIpriv_memzero(&copy, sizeof(copy));
+	return -1;
+}
+
+
+int ATMIpriv_keyx_hold(const uint8_t sk[32], const uint8_t k[32])
+{
+	keyx_slot_t  *s = NULL;
+	unsigned      i;
+
+	if(!&ATMIpriv_keyx_linked)
+		return -ENODEV;
+
+	keyx_lock();
+	for(i = 0u; i < ATMI_KEYX_SLOTS; i++) {
+		if(keyx_slots[i].used &&
+		   !crypto_verify_32(keyx_slots[i].sk, sk)) {
+			s = &keyx_slots[i];
+			break;
+		}
+		if(!s && !keyx_slots[i].used)
+			s = &keyx_slots[i];
+	}
+	if(!s) {
+		s = &keyx_slots[keyx_next];
+		keyx_next = (keyx_next + 1u) % ATMI_KEYX_SLOTS;
+	}
+	keyx_store(s, ATMIpriv_server_pubkey, sk, k);
+	keyx_unlock();
+
+	return 0;
+}
+
+
+int ATMIkeyx_precompute(const atmi_context_t *ctx)
+{
+	uint8_t  k[32];
+	int      r;
+
+	if(!ctx)
+		return -EINVAL;
+	if(!&ATMIpriv_keyx_linked)
+		return -ENODEV;
+
+	/* Computed outside the lock; a miss here does the multiplication. */
+	if(!!crypto_box_curve25519xsalsa20poly1305_beforenm(k,
+	                         ATMIpriv_server_pubkey, ctx->privateKey)) {
+		ATMIpriv_memzero(k, sizeof(k));
+		return -EFAULT;
+	}
+
+	r = ATMIpriv_keyx_hold(ctx->privateKey, k);
+	ATMIpriv_memzero(k, sizeof(k));
+	return r;
+}
+
+
+void ATMIkeyx_forget(const atmi_context_t *ctx)
+{
+	unsigned i;
+
+	if(!ctx)
+		return;
+
+	keyx_lock();
+	for(i = 0u; i < ATMI_KEYX_SLOTS; i++) {
+		if(keyx_slots[i].used &&
+		   !crypto_verify_32(keyx_slots[i].sk, ctx->privateKey))
+			keyx_store(&keyx_slots[i], NULL, NULL, NULL);
+	}
+	keyx_unlock();
+}
+
+
+void ATMIkeyx_clear(void)
+{
+	unsigned i;
+
+	keyx_lock();
+	for(i = 0u; i < ATMI_KEYX_SLOTS; i++)
+		if(keyx_slots[i].used)
+			keyx_store(&keyx_slots[i], NULL, NULL, NULL);
+	keyx_next = 0u;
+	keyx_unlock();
+}
@@ -0,0 +1,33 @@
+/*
+ * Atonomi Device SDK: Precomputed Key Exchange Wrapper
+ *
+ * Copyright (C) 2018 Atonomi
+ *
+ * Link-time wrapper (GNU ld --wrap) around the shared key derivation made
+ * by the prebuilt library's boxes. Nothing refers to this file's symbols
+ * unless the program is linked with ATMI_KEYX_LDFLAGS, so it is otherwise
+ * left out of the link altogether.
+ */
+#include "atmi_keyx.h"
+#include "atmi_priv.h"
+
+
+const int ATMIpriv_keyx_linked = 1;
+
+
+int __real_crypto_box_curve25519xsalsa20poly1305_beforenm(unsigned char *k,
+                                                const unsigned char *pk,
+                                                const unsigned char *sk);
+int __wrap_crypto_box_curve25519xsalsa20poly1305_beforenm(unsigned char *k,
+                                                const unsigned char *pk,
+                                                const unsigned char *sk);
+
+
+int __wrap_crypto_box_curve25519xsalsa20poly1305_beforenm(unsigned char *k,
+                                                const unsigned char *pk,
+                                                const unsigned char *sk)
+{
+	if(ATMIpriv_keyx_lookup(k, pk, sk) == 0)
+		return 0;
+	return __real_crypto_box_curve25519xsalsa20poly1305_beforenm(k, pk, sk);
+}
@@ -0,0 +1,173 @@
+/*
+ * Atonomi Device SDK: Multi-buffer XSalsa20
+ *
+ * Copyright (C) 2018 Atonomi
+ *
+ * Cross-signed Device IDs are sealed with XSalsa20-Poly1305 under a key
+ * fixed per device (see atmi_prep.c), and each consumes exactly one 64-byte
+ * keystream block: an HSalsa20 call to derive the per-nonce subkey, then
+ * one Salsa20 block. The bundled libsodium computes these one message at
+ * a time; here, on x86-64 hosts supporting AVX2, eight messages are taken
+ * at once, one per 32-bit lane. Other hosts, and builds with ATMI_NO_SIMD
+ * defined, use the bundled scalar code.
+ */
+#include <string.h>
+#include "atmi_priv.h"
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(ATMI_NO_SIMD)
+#define ATMI_MB_AVX2
+#include <immintrin.h>
+#endif
+
+
+#define MB_LANES    (8u)
+
+
+static const uint8_t mb_sigma[16] = "expand 32-byte k";
+
+
+static void mb_block0_scalar(uint8_t ks[64], const uint8_t key[32],
+                             const uint8_t nonce[24])
+{
+	uint8_t  subkey[32];
+	uint8_t  in[16];
+
+	(void)crypto_core_hsalsa20(subkey, nonce, key, mb_sigma);
+
+	memcpy(in, nonce + 16, 8u);
+	memset(in + 8, 0, 8u);
+	(void)crypto_core_salsa20(ks, in, subkey, mb_sigma);
+
+	ATMIpriv_memzero(subkey, sizeof(subkey));
+}
+
+
+
+#ifdef ATMI_MB_AVX2
+
+#define MB_ROTL(v, c) \
+	_mm256_or_si256(_mm256_slli_epi32((v), (c)), _mm256_srli_epi32((v), 32 - (c)))
+
+#define MB_QR(a, b, c, d)                                               \
+	do {                                                            \
+		b = _mm256_xor_si256(b, MB_ROTL(_mm256_add_epi32(a, d),  7)); \
+		c = _mm256_xor_si256(c, MB_ROTL(_mm256_add_epi32(b, a),  9)); \
+		d = _mm256_xor_si256(d, MB_ROTL(_mm256_add_epi32(c, b), 13)); \
+		a = _mm256_xor_si256(a, MB_ROTL(_mm256_add_epi32(d, c), 18)); \
+	} while(0)
+
+/* One little-endian word, broadcast to all lanes. */
+#define MB_SPLAT32(p)   _mm256_set1_epi32((int)ATMIpriv_load32(p))
+
+
+/* Twenty Salsa20 rounds over eight states held word-sliced in x[]. */
+__attribute__((target("avx2")))
+static void mb_rounds(__m256i x[16])
+{
+	int i;
+
+	for(i = 0; i < 20; i += 2) {
+		MB_QR(x[ 0], x[ 4], x[ 8], x[12]);
+		MB_QR(x[ 5], x[ 9], x[13], x[ 1]);
+		MB_QR(x[10], x[14], x[ 2], x[ 6]);
+		MB_QR(x[15], x[ 3], x[ 7], x[11]);
+
+		MB_QR(x[ 0], x[ 1], x[ 2], x[ 3]);
+		MB_QR(x[ 5], x[ 6], x[ 7], x[ 4]);
+		MB_QR(x[10], x[11], x[ 8], x[ 9]);
+		MB_QR(x[15], x[12], x[13], x[14]);
+	}
+}
+
+
+/*
+ * Lane j of state word i is w[i][j]. Constants sit on the diagonal; words
+ * 1-4 and 11-14 hold the key, and words 6-9 the 16-byte input.
+ */
+__attribute__((target("avx2")))
+static void mb_block0_avx2(uint8_t (*ks)[64], const uint8_t key[32],
+                           const uint8_t *nonces, size_t stride)
+{
+	static const unsigned  kw[8] = { 1, 2, 3, 4, 11, 12, 13, 14 };
+	static const unsigned  hw[8] = { 0, 5, 10, 15, 6, 7, 8, 9 };
+	uint32_t  w[16][MB_LANES] __attribute__((aligned(32)));
+	uint32_t  sub[8][MB_LANES] __attribute__((aligned(32)));
+	__m256i   x[16], s[16];
+	unsigned  i, j;
+
+	/* HSalsa20: key fixed, input is nonce bytes 0-15 of each lane. */
+	for(i = 0u; i < 4u; i++) {
+		x[i*5u]       = MB_SPLAT32(mb_sigma + 4u*i);
+		x[kw[i]]      = MB_SPLAT32(key + 4u*i);
+		x[kw[i + 4u]] = MB_SPLAT32(key + 16u + 4u*i);
+	}
+	for(j = 0u; j < MB_LANES; j++)
+		for(i = 0u; i < 4u; i++)
+			w[6u + i][j] = ATMIpriv_load32(nonces + j*stride +
+			                               4u*i);
+	for(i = 6u; i < 10u; i++)
+		x[i] = _mm256_load_si256((const __m256i *)w[i]);
+
+	mb_rounds(x);
+	for(i = 0u; i < 8u; i++)
+		_mm256_store_si256((__m256i *)sub[i], x[hw[i]]);
+
+	/* Salsa20 block 0: per-lane subkey, input is nonce bytes 16-23. */
+	for(i = 0u; i < 4u; i++) {
+		x[i*5u]       = MB_SPLAT32(mb_sigma + 4u*i);
+		x[kw[i]]      = _mm256_load_si256((const __m256i *)sub[i]);
+		x[kw[i + 4u]] = _mm256_load_si256((const __m256i *)sub[i + 4u]);
+	}
+	for(j = 0u; j < MB_LANES; j++) {
+		w[6][j] = ATMIpriv_load32(nonces + j*stride + 16u);
+		w[7][j] = ATMIpriv_load32(nonces + j*stride + 20u);
+	}
+	x[6] = _mm256_load_si256((const __m256i *)w[6]);
+	x[7] = _mm256_load_si256((const __m256i *)w[7]);
+	x[8] = _mm256_setzero_si256();
+	x[9] = _mm256_setzero_si256();
+
+	memcpy(s, x, sizeof(s));
+	mb_rounds(x);
+	for(i = 0u; i < 16u; i++)
+		_mm256_store_si256((__m256i *)w[i], _mm256_add_epi32(x[i], s[i]));
+
+	for(j = 0u; j < MB_LANES; j++)
+		for(i = 0u; i < 16u; i++)
+			ATMIpriv_store32(ks[j] + 4u*i, w[i][j]);
+
+	/* The keystream and subkeys also linger in the vector copies. */
+	ATMIpriv_memzero(w, sizeof(w));
+	ATMIpriv_memzero(sub, sizeof(sub));
+	ATMIpriv_memzero(x, sizeof(x));
+	ATMIpriv_memzero(s, sizeof(s));
+}
+
+
+static int mb_have_avx2(void)
+{
+	static int have = -1;
+
+	if(have < 0)
+		have = !!__builtin_cpu_supports("avx2");
+	return have;
+}
+
+#endif /*ATMI_MB_AVX2*/
+
+
+
+void ATMIpriv_xsalsa20_block0(uint8_t (*ks)[64], const uint8_t key[32],
+                              const uint8_t *nonces, size_t stride, size_t n)
+{
+	size_t i = 0u;
+
+#ifdef ATMI_MB_AVX2
+	if(mb_have_avx2())
+		for(; n - i >= MB_LANES; i += MB_LANES)
+			mb_block0_avx2(ks + i, key, nonces + i*stride, stride);
+#endif
+
+	for(; i < n; i++)
+		mb_block0_scalar(ks[i], key, nonces + i*stride);
+}
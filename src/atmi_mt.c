@@ -0,0 +1,37 @@
+/*
+ * Atonomi Device SDK: Multi-threaded Use
+ *
+ * Copyright (C) 2018 Atonomi
+ *
+ * The lock-free sodium_init() is the link-time wrapper in atmi_mt_wrap.c,
+ * which is only linked in when ATMI_MT_LDFLAGS redirect calls to it.
+ */
+#include "atmi_errno.h"
+#include "atmi_mt.h"
+
+#if !defined(__ARM_ARCH_6M__) && !defined(__ARM_ARCH_7M__)
+
+/* Defined by atmi_mt_wrap.c; null unless that is linked. */
+extern const int ATMIpriv_mt_linked __attribute__((weak));
+
+/* No header ships with lib/. */
+int sodium_init(void);
+
+
+int ATMImt_init(void)
+{
+	/* Reaches the wrapper, when linked, which then remembers success. */
+	if(sodium_init() < 0)
+		return -EFAULT;
+
+	return !!&ATMIpriv_mt_linked;
+}
+
+#else
+
+int ATMImt_init(void)
+{
+	return 1;
+}
+
+#endif
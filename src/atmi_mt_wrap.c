@@ -0,0 +1,38 @@
+/*
+ * Atonomi Device SDK: Multi-threaded Use, sodium_init() Wrapper
+ *
+ * Copyright (C) 2018 Atonomi
+ *
+ * Link-time wrapper (GNU ld --wrap) around the libsodium initialization
+ * made before each draw of entropy by the prebuilt library. Nothing refers
+ * to this file's symbols unless the program is linked with ATMI_MT_LDFLAGS,
+ * so it is otherwise left out of the link altogether.
+ *
+ * Once libsodium has been initialized, every later call returns at once.
+ * Initialization itself still goes through the real sodium_init(), under
+ * its lock; the release store publishes what it set up to threads that
+ * then skip it.
+ */
+#include "atmi_mt.h"
+
+
+const int ATMIpriv_mt_linked = 1;
+
+static int mt_ready;
+
+
+int __real_sodium_init(void);
+int __wrap_sodium_init(void);
+
+
+int __wrap_sodium_init(void)
+{
+	int r;
+
+	if(__atomic_load_n(&mt_ready, __ATOMIC_ACQUIRE))
+		return 1;
+
+	if( (r = __real_sodium_init()) >= 0 )
+		__atomic_store_n(&mt_ready, 1, __ATOMIC_RELEASE);
+	return r;
+}
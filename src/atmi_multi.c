@@ -0,0 +1,135 @@
+/*
+ * Atonomi Device SDK: Aggregated Reputation Amendments
+ *
+ * Copyright (C) 2018 Atonomi
+ *
+ * Request message, one per greeting: entry count (1), requestor's Device ID
+ * (32), then per entry the subject's Device ID (32), reputation token (16)
+ * and the two comms flags (1 each), as in atmi_rep_request_t.
+ *
+ * Response message, one per packet: entry count (1), then per entry its
+ * success code as in atmi_rep_response_t (4).
+ */
+#include <string.h>
+#include "atmi_errno.h"
+#include "atmi_multi.h"
+#include "atmi_priv.h"
+
+
+#define MULTI_ENTRY_REQ     (ATMI_MSGLEN_REP_REQ - 32u)
+#define MULTI_ENTRY_RESP    (ATMI_MSGLEN_REP_RESP)
+
+
+static atmi_session_state_t *sst_state(atmi_ssnstate_t *sst)
+{
+	return (atmi_session_state_t *)(void *)sst->state;
+}
+
+
+/* Length of the packet at the start of p, or zero if it does not fit in n. */
+static size_t multi_pktlen(const uint8_t *p, size_t n)
+{
+	size_t len;
+
+	if(n <= ATMI_PKT_HDR_SIZE + 2u)
+		return 0u;
+
+	len = ATMI_PKT_HDR_SIZE + ATMIpriv_load16(p + 5);
+	return (len <= n) ? len : 0u;
+}
+
+
+int ATMIpack_rep_request_multi(const atmi_context_t *ctx,
+                               atmi_ssnstate_t ssts[],
+                               const atmi_rep_request_t reps[], size_t n,
+                               uint8_t *buf, size_t nbuf, size_t headroom)
+{
+	uint8_t  msg[ATMI_MSGLEN_REP_MULTI_REQ(ATMI_MULTI_PER_PKG)];
+	uint8_t *p;
+	size_t   i, k, m, off;
+	int      r;
+
+	if(!ctx || !ssts || !reps || !buf || n == 0u || n > ATMI_MULTI_MAX)
+		return -EINVAL;
+
+	for(i = 1u; i < n; i++)
+		if(memcmp(reps[i].id_requestor, reps[0].id_requestor,
+		          sizeof(reps[i].id_requestor)))
+			return -EINVAL;
+
+	/* CENTRI reports a short output buffer only as a generic failure. */
+	if(headroom >= nbuf || nbuf - headroom < ATMI_PKTLEN_REP_MULTI_REQ(n))
+		return -ENOSPC;
+
+	memcpy(msg + 1, reps[0].id_requestor, sizeof(reps[0].id_requestor));
+
+	for(off = headroom, k = 0u; k < n; k += m, ssts++) {
+		m = (n - k < ATMI_MULTI_PER_PKG) ? n - k : ATMI_MULTI_PER_PKG;
+
+		msg[0] = (uint8_t)m;
+		for(p = msg + 33, i = k; i < k + m; i++, p += MULTI_ENTRY_REQ) {
+			memcpy(p, reps[i].id_subject, sizeof(reps[i].id_subject));
+			memcpy(p + 32, reps[i].reputation_token,
+			       sizeof(reps[i].reputation_token));
+			p[48] = reps[i].comms_replyreceived;
+			p[49] = reps[i].comms_successful;
+		}
+
+		r = ATMIpriv_pack_greeting(ctx, sst_state(ssts), buf + off,
+		                           nbuf - off,
+		                           ATMI_PKT_TYPE_REP_MULTI_REQ,
+		                           msg, ATMI_MSGLEN_REP_MULTI_REQ(m));
+		if(r < 0)
+			return r;
+		off += (size_t)r;
+	}
+
+	return (int)(off - headroom);
+}
+
+
+int ATMIunpack_rep_response_multi(const atmi_context_t *ctx,
+                                  atmi_ssnstate_t ssts[],
+                                  const void *pinbuf, size_t nin,
+                                  atmi_rep_response_t reps[], size_t n)
+{
+	const uint8_t *pin = pinbuf;
+	uint8_t        work[ATMI_SESSBUF_SIZE];
+	uint8_t        msg[ATMI_MSGLEN_REP_MULTI_RESP(ATMI_MULTI_PER_PKG)];
+	size_t         i, k, m, off, len;
+	int            r, count;
+
+	if(!ctx || !ssts || !pin || !reps || n == 0u || n > ATMI_MULTI_MAX)
+		return -EINVAL;
+
+	/* Check the framing of the whole run before unpacking any of it. */
+	for(off = 0u, k = 0u; k < ATMI_MULTI_NPKG(n); k++, off += len)
+		if( (len = multi_pktlen(pin + off, nin - off)) == 0u )
+			return -EBADF;
+	if(off != nin)
+		return -EBADF;
+
+	for(off = 0u, count = 0, k = 0u; k < n; k += m, ssts++, off += len) {
+		m   = (n - k < ATMI_MULTI_PER_PKG) ? n - k : ATMI_MULTI_PER_PKG;
+		len = multi_pktlen(pin + off, nin - off);
+
+		r = ATMIpriv_unpack(ctx, sst_state(ssts), pin + off, len,
+		                    ATMI_PKT_TYPE_REP_MULTI_RESP, work, sizeof(work),
+		                    msg, ATMI_MSGLEN_REP_MULTI_RESP(m));
+		if(r == 0 && msg[0] != m)
+			r = -EBADF;
+
+		for(i = 0u; i < m; i++) {
+			if(r == 0)
+				memcpy(&reps[k + i].success,
+				       msg + 1 + MULTI_ENTRY_RESP*i,
+				       MULTI_ENTRY_RESP);
+			else
+				reps[k + i].success = r;
+		}
+		if(r == 0)
+			count += (int)m;
+	}
+
+	return count;
+}
@@ -0,0 +1,94 @@
+/*
+ * Atonomi Device SDK: Response Inspection
+ *
+ * Copyright (C) 2018 Atonomi
+ *
+ * The CENTRI envelope following the ATMI header opens with a short
+ * cleartext frame:
+ *
+ *   [0..1]    Envelope length, little-endian.
+ *   [2]       Format version, 0x23 in this release.
+ *   [3]       Package type (ATMI_PKG_*).
+ *   [4..]     Attributes: a tag byte and a little-endian 16-bit field,
+ *             followed by that many bytes of value except where noted.
+ *
+ * Of the attributes, only those below are interpreted. The first unknown
+ * tag ends parsing without error, as everything from there on is left to
+ * the library.
+ *
+ * This layout is that of the packets the library packs. No IRN response
+ * has been available to confirm that responses share the version byte or
+ * the exact envelope length, and the library itself rejects a packet only
+ * once decryption fails, so neither is checked: only a declared length
+ * beyond the data received, or attributes overrunning it.
+ */
+#include <string.h>
+#include "atmi_errno.h"
+#include "atmi_peek.h"
+#include "atmi_priv.h"
+
+
+#define PEEK_TAG_BODY       (0x04u)     /* Encrypted body.                 */
+#define PEEK_TAG_SID        (0x07u)     /* Session ID.                     */
+#define PEEK_TAG_PLAINLEN   (0x0au)     /* Decrypted length; no value.     */
+
+
+int ATMIpeek_response(const void *pinbuf, size_t nin, atmi_peek_t *out)
+{
+	const uint8_t *pin = pinbuf;
+	const uint8_t *p, *end;
+	atmi_peek_t    pk;
+	unsigned       tag, len;
+
+	/* The same bound as the ATMIunpack_* routines. */
+	if(!pin || nin <= ATMI_PKT_HDR_SIZE ||
+	   nin - ATMI_PKT_HDR_SIZE > ATMI_SESSBUF_SIZE)
+		return -EINVAL;
+
+	if(pin[0] != ATMI_PKT_TAG0 || pin[1] != ATMI_PKT_TAG1 ||
+	   pin[2] != ATMI_PKT_TAG2)
+		return -ENOENT;
+	if(pin[3] != ATMI_PKT_TYPE_ACT_RESP &&
+	   pin[3] != ATMI_PKT_TYPE_VAL_RESP &&
+	   pin[3] != ATMI_PKT_TYPE_REP_RESP && pin[3] != ATMI_PKT_TYPE_STOP)
+		return -ENOENT;
+
+	p   = pin + ATMI_PKT_HDR_SIZE;
+	end = pin + nin;
+	if(end - p < 4 || ATMIpriv_load16(p) > (size_t)(end - p))
+		return -EBADF;
+
+	memset(&pk, 0, sizeof(pk));
+	pk.type    = pin[3];
+	pk.pkgtype = p[3];
+
+	for(p += 4; end - p >= 3; p += len) {
+		tag = p[0];
+		len = ATMIpriv_load16(p + 1);
+		p  += 3;
+
+		if(tag == PEEK_TAG_PLAINLEN) {
+			/* Must fit the buffer the envelope decrypts into. */
+			if(len > ATMI_PKT_ENVELOPE_SIZE)
+				return -EBADF;
+			pk.nplain = len;
+			len = 0u;
+			continue;
+		}
+		if(tag != PEEK_TAG_BODY && tag != PEEK_TAG_SID)
+			break;
+		if(len > (size_t)(end - p))
+			return -EBADF;
+
+		if(tag == PEEK_TAG_BODY) {
+			pk.nbody = len;
+		} else {
+			pk.sid  = len ? p : NULL;
+			pk.nsid = len;
+		}
+	}
+
+	if(out)
+		*out = pk;
+	return 0;
+}
@@ -0,0 +1,95 @@
+/*
+ * Atonomi Device SDK: Persistent Sessions
+ *
+ * Copyright (C) 2018 Atonomi
+ */
+#include "atmi_errno.h"
+#include "atmi_persist.h"
+#include "atmi_priv.h"
+
+
+static atmi_session_state_t *ssn_state(atmi_session_t *ssn)
+{
+	return (atmi_session_state_t *)(void *)ssn->state;
+}
+
+
+static int pack_data(const atmi_context_t *ctx, atmi_session_t *ssn,
+                     uint8_t type, const void *msg, size_t nmsg)
+{
+	if(!ctx || !ssn || !msg)
+		return -EINVAL;
+
+	return ATMIpriv_pack_data(ctx, ssn_state(ssn), ssn->packet,
+	                          sizeof(ssn->packet), type, msg, nmsg);
+}
+
+static int unpack_data(const atmi_context_t *ctx, atmi_session_t *ssn,
+                       const void *pinbuf, size_t nin, uint8_t type,
+                       void *out, size_t nout)
+{
+	if(!ctx || !ssn || !pinbuf || !out)
+		return -EINVAL;
+
+	return ATMIpriv_unpack(ctx, ssn_state(ssn), pinbuf, nin, type,
+	                       ssn->packet, sizeof(ssn->packet), out, nout);
+}
+
+
+
+int ATMIpack_act_data(const atmi_context_t *ctx, atmi_session_t *ssn,
+                      const atmi_act_request_t *act)
+{
+	return pack_data(ctx, ssn, ATMI_PKT_TYPE_ACT_REQ,
+	                 act, ATMI_MSGLEN_ACT_REQ);
+}
+
+int ATMIpack_val_data(const atmi_context_t *ctx, atmi_session_t *ssn,
+                      const atmi_val_request_t *val)
+{
+	return pack_data(ctx, ssn, ATMI_PKT_TYPE_VAL_REQ,
+	                 val, ATMI_MSGLEN_VAL_REQ);
+}
+
+int ATMIpack_rep_data(const atmi_context_t *ctx, atmi_session_t *ssn,
+                      const atmi_rep_request_t *rep)
+{
+	return pack_data(ctx, ssn, ATMI_PKT_TYPE_REP_REQ,
+	                 rep, ATMI_MSGLEN_REP_REQ);
+}
+
+
+int ATMIunpack_act_data(const atmi_context_t *ctx, atmi_session_t *ssn,
+                        const void *pinbuf, size_t nin,
+                        atmi_act_response_t *act)
+{
+	return unpack_data(ctx, ssn, pinbuf, nin, ATMI_PKT_TYPE_ACT_RESP,
+	                   act, ATMI_MSGLEN_ACT_RESP);
+}
+
+int ATMIunpack_val_data(const atmi_context_t *ctx, atmi_session_t *ssn,
+                        const void *pinbuf, size_t nin,
+                        atmi_val_response_t *val)
+{
+	return unpack_data(ctx, ssn, pinbuf, nin, ATMI_PKT_TYPE_VAL_RESP,
+	                   val, ATMI_MSGLEN_VAL_RESP);
+}
+
+int ATMIunpack_rep_data(const atmi_context_t *ctx, atmi_session_t *ssn,
+                        const void *pinbuf, size_t nin,
+                        atmi_rep_response_t *rep)
+{
+	return unpack_data(ctx, ssn, pinbuf, nin, ATMI_PKT_TYPE_REP_RESP,
+	                   rep, ATMI_MSGLEN_REP_RESP);
+}
+
+
+int ATMIpack_stop(const atmi_context_t *ctx, atmi_session_t *ssn,
+                  uint8_t reason)
+{
+	if(!ctx || !ssn)
+		return -EINVAL;
+
+	return ATMIpriv_pack_stop(ctx, ssn_state(ssn), ssn->packet,
+	                          sizeof(ssn->packet), reason);
+}
@@ -0,0 +1,243 @@
+/*
+ * Atonomi Device SDK: Packet Helpers
+ *
+ * Copyright (C) 2018 Atonomi
+ */
+#include <string.h>
+#include "atmi_errno.h"
+#include "atmi_zc.h"
+#include "atmi_priv.h"
+
+
+/* Per-call state handed to the CENTRI callbacks via the handler context. */
+typedef struct {
+	atmi_session_state_t *st;
+	uint8_t              *work;
+	size_t                nwork;
+	int                   stopped;
+	int                   nospace;
+} pkt_cbctx_t;
+
+
+static int pkt_on_message(const PSEPackageHandler *h, PSCallbackInfo *ci)
+{
+	pkt_cbctx_t *cb = h->context;
+
+	cb->st->rsp    = ci->buffer;
+	cb->st->rsplen = ci->bufferLen;
+	return PS_ERR_OK;
+}
+
+static int pkt_on_stop(const PSEPackageHandler *h, PSCallbackInfo *ci,
+                       PSStopInfo *si)
+{
+	pkt_cbctx_t *cb = h->context;
+
+	(void)ci;
+	(void)si;
+	cb->stopped = 1;
+	return PS_ERR_OK;
+}
+
+static int pkt_on_alloc(PSOutputBuffer *ob, void *ctx)
+{
+	pkt_cbctx_t *cb = ctx;
+
+	if(ob->bufferRequired > cb->nwork) {
+		cb->nospace = 1;
+		return PS_ERR_OUTPUT_TOO_SMALL;
+	}
+
+	ob->buffer    = cb->work;
+	ob->bufferLen = cb->nwork;
+	return PS_ERR_OK;
+}
+
+static int pkt_on_free(PSOutputBuffer *ob, void *ctx)
+{
+	(void)ob;
+	(void)ctx;
+	return PS_ERR_OK;
+}
+
+static const PSECallbacks pkt_cbfns = {
+	.on_session_established = pkt_on_message,
+	.on_session_stop        = pkt_on_stop,
+	.on_session_data        = pkt_on_message,
+	.on_get_output_buffer   = pkt_on_alloc,
+	.on_free_output_buffer  = pkt_on_free,
+};
+
+
+static void pkt_keys(PSKeys *keys, const atmi_context_t *ctx)
+{
+	keys->publicKey      = ctx->publicKey;
+	keys->publicKeySize  = sizeof(ctx->publicKey);
+	keys->privateKey     = ctx->privateKey;
+	keys->privateKeySize = sizeof(ctx->privateKey);
+}
+
+
+
+static void pkt_prepare(const atmi_context_t *ctx, atmi_session_state_t *st,
+                        uint8_t *pkt, size_t npkt,
+                        const void *msg, size_t nmsg)
+{
+	st->ctx               = ctx;
+	st->rsp               = NULL;
+	st->rsplen            = 0u;
+	st->pkg.payload       = msg;
+	st->pkg.payloadLen    = nmsg;
+	st->pkg.outBuf        = pkt + ATMI_PKT_HDR_SIZE;
+	st->pkg.outBufLen     = npkt - ATMI_PKT_HDR_SIZE;
+	st->pkg.outBufWritten = 0u;
+}
+
+static int pkt_finish(atmi_session_state_t *st, uint8_t *pkt, uint8_t type,
+                      const void *msg, size_t nmsg)
+{
+	st->pkg.payload = NULL;
+
+	pkt[0] = ATMI_PKT_TAG0;
+	pkt[1] = ATMI_PKT_TAG1;
+	pkt[2] = ATMI_PKT_TAG2;
+	pkt[3] = type;
+	pkt[4] = ATMIpriv_crc8(msg, nmsg);
+
+	return (int)(st->pkg.outBufWritten + ATMI_PKT_HDR_SIZE);
+}
+
+
+/* Exact packet length of a request greeting, or zero if not known. */
+static size_t pkt_greeting_len(uint8_t type)
+{
+	switch(type) {
+	case ATMI_PKT_TYPE_ACT_REQ: return ATMI_PKTLEN_ACT_REQ;
+	case ATMI_PKT_TYPE_VAL_REQ: return ATMI_PKTLEN_VAL_REQ;
+	case ATMI_PKT_TYPE_REP_REQ: return ATMI_PKTLEN_REP_REQ;
+	default:                    return 0u;
+	}
+}
+
+
+int ATMIpriv_pack_greeting(const atmi_context_t *ctx,
+                           atmi_session_state_t *st,
+                           uint8_t *pkt, size_t npkt, uint8_t type,
+                           const void *msg, size_t nmsg)
+{
+	PSGreetingInfo  gi = { .destPubKey = ATMIpriv_server_pubkey };
+	PSKeys          keys;
+	int             r;
+
+	if(!ctx || !st || !pkt || !msg || npkt <= ATMI_PKT_HDR_SIZE)
+		return -EINVAL;
+
+	/* CENTRI reports a short output buffer only as a generic failure. */
+	if(npkt < pkt_greeting_len(type))
+		return -ENOSPC;
+
+	pkt_keys(&keys, ctx);
+	memset(&st->pkg, 0, sizeof(st->pkg));
+	pkt_prepare(ctx, st, pkt, npkt, msg, nmsg);
+
+	r = pse_generate_greeting(&keys, &st->pkg, &gi);
+	if(r == PS_ERR_OUTPUT_TOO_SMALL)
+		return -ENOSPC;
+	if(r != PS_ERR_OK)
+		return -EFAULT;
+
+	return pkt_finish(st, pkt, type, msg, nmsg);
+}
+
+
+int ATMIpriv_pack_data(const atmi_context_t *ctx, atmi_session_state_t *st,
+                       uint8_t *pkt, size_t npkt, uint8_t type,
+                       const void *msg, size_t nmsg)
+{
+	PSKeys  keys;
+	int     r;
+
+	if(!ctx || !st || !pkt || !msg || npkt <= ATMI_PKT_HDR_SIZE)
+		return -EINVAL;
+
+	pkt_keys(&keys, ctx);
+	pkt_prepare(ctx, st, pkt, npkt, msg, nmsg);
+
+	r = pse_generate_data_package(&keys, &st->pkg);
+
+	/* Data packages may only follow a reply establishing the session. */
+	if(r == PS_ERR_WRONG_STATE)
+		return -EPIPE;
+	if(r == PS_ERR_OUTPUT_TOO_SMALL)
+		return -ENOSPC;
+	if(r != PS_ERR_OK)
+		return -EFAULT;
+
+	return pkt_finish(st, pkt, type, msg, nmsg);
+}
+
+
+int ATMIpriv_pack_stop(const atmi_context_t *ctx, atmi_session_state_t *st,
+                       uint8_t *pkt, size_t npkt, uint8_t reason)
+{
+	PSKeys  keys;
+	int     r;
+
+	if(!ctx || !st || !pkt || npkt <= ATMI_PKT_HDR_SIZE)
+		return -EINVAL;
+
+	pkt_keys(&keys, ctx);
+	pkt_prepare(ctx, st, pkt, npkt, NULL, 0u);
+
+	/* A session which was never opened is rejected as an argument. */
+	r = pse_generate_stop_package(&keys, &st->pkg, reason);
+	if(r == PS_ERR_WRONG_STATE || r == PS_ERR_ARGUMENT)
+		return -EPIPE;
+	if(r == PS_ERR_OUTPUT_TOO_SMALL)
+		return -ENOSPC;
+	if(r != PS_ERR_OK)
+		return -EFAULT;
+
+	return pkt_finish(st, pkt, ATMI_PKT_TYPE_STOP, NULL, 0u);
+}
+
+
+int ATMIpriv_unpack(const atmi_context_t *ctx, atmi_session_state_t *st,
+                    const uint8_t *pin, size_t nin, uint8_t type,
+                    uint8_t *work, size_t nwork, void *out, size_t nout)
+{
+	PSKeys             keys;
+	pkt_cbctx_t        cb = { .st = st, .work = work, .nwork = nwork };
+	PSEPackageHandler  h  = { .callbacks = &pkt_cbfns, .keys = &keys,
+	                          .context = &cb };
+
+	if(!ctx || !st || !pin || !work || !out)
+		return -EINVAL;
+	if(nin <= ATMI_PKT_HDR_SIZE || nin - ATMI_PKT_HDR_SIZE > ATMI_SESSBUF_SIZE)
+		return -EINVAL;
+
+	if(pin[0] != ATMI_PKT_TAG0 || pin[1] != ATMI_PKT_TAG1 ||
+	   pin[2] != ATMI_PKT_TAG2 || pin[3] != type)
+		return -ENOENT;
+
+	pkt_keys(&keys, ctx);
+	st->ctx    = ctx;
+	st->rsp    = NULL;
+	st->rsplen = 0u;
+
+	if(pse_process_incoming_package(&h, pin + ATMI_PKT_HDR_SIZE,
+	                                nin - ATMI_PKT_HDR_SIZE,
+	                                &st->pkg.sessionInfo) != PS_ERR_OK)
+		return cb.nospace ? -ENOSPC : -EFAULT;
+
+	/* The IRN closed the session rather than answering. */
+	if(cb.stopped)
+		return -EPIPE;
+
+	if(!st->rsp || st->rsplen != nout ||
+	   ATMIpriv_crc8(st->rsp, st->rsplen) != pin[4])
+		return -EBADF;
+
+	memcpy(out, st->rsp, nout);
+	return 0;
+}
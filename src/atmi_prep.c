@@ -0,0 +1,220 @@
+/*
+ * Atonomi Device SDK: Prepared Contexts
+ *
+ * Copyright (C) 2018 Atonomi
+ */
+#include <string.h>
+#include "atmi_errno.h"
+#include "atmi_prep.h"
+#include "atmi_keyx.h"
+#include "atmi_rng.h"
+#include "atmi_priv.h"
+
+
+int ATMIcontext_prepare(atmi_prepared_context_t *pctx,
+                        const atmi_context_t *ctx)
+{
+	if(!pctx || !ctx)
+		return -EINVAL;
+
+	memcpy(&pctx->ctx, ctx, sizeof(pctx->ctx));
+	pctx->prepared = 0u;
+
+	if(!!crypto_box_curve25519xsalsa20poly1305_beforenm(pctx->boxkey,
+	                         ATMIpriv_server_pubkey, ctx->privateKey)) {
+		ATMIpriv_memzero(pctx, sizeof(*pctx));
+		return -EFAULT;
+	}
+
+	/* Spares ATMIpack* and ATMIunpack* the multiplication, if linked. */
+	(void)ATMIpriv_keyx_hold(ctx->privateKey, pctx->boxkey);
+
+	pctx->prepared = 1u;
+	return 0;
+}
+
+
+void ATMIcontext_release(atmi_prepared_context_t *pctx)
+{
+	if(!pctx)
+		return;
+
+	if(pctx->prepared)
+		ATMIkeyx_forget(&pctx->ctx);
+	ATMIpriv_memzero(pctx, sizeof(*pctx));
+}
+
+
+int ATMIsign_device_id_prepared(const atmi_prepared_context_t *pctx,
+                                uint8_t       idsgn_out[72],
+                                const uint8_t devid_in [32])
+{
+	uint8_t  m[ATMI_NACL_ZEROBYTES + 32u];
+	uint8_t  c[ATMI_NACL_ZEROBYTES + 32u];
+	int      r;
+
+	if(!pctx || !pctx->prepared || !idsgn_out || !devid_in)
+		return -EINVAL;
+
+	/*
+	 * Same layout as produced by ps_encrypt_box(): nonce, then MAC and
+	 * ciphertext. The classic NaCl interface wants zero padding ahead of
+	 * the message and leaves zero padding ahead of the MAC.
+	 */
+	memset(m, 0, ATMI_NACL_ZEROBYTES);
+	memcpy(m + ATMI_NACL_ZEROBYTES, devid_in, 32u);
+
+	ATMIrng_fill(idsgn_out, ATMI_XSIGN_NONCE_SIZE);
+
+	r = crypto_box_curve25519xsalsa20poly1305_afternm(c, m, sizeof(m),
+	                                                 idsgn_out, pctx->boxkey);
+	if(!r)
+		memcpy(idsgn_out + ATMI_XSIGN_NONCE_SIZE,
+		       c + ATMI_NACL_BOXZEROBYTES,
+		       ATMI_XSIGN_SIZE - ATMI_XSIGN_NONCE_SIZE);
+
+	ATMIpriv_memzero(m, sizeof(m));
+	ATMIpriv_memzero(c, sizeof(c));
+	return r ? -EFAULT : 0;
+}
+
+
+static int check_boxkey(const uint8_t boxkey[32], const uint8_t idsgn[72],
+                        const uint8_t devid[32])
+{
+	uint8_t  c[ATMI_NACL_ZEROBYTES + 32u];
+	uint8_t  m[ATMI_NACL_ZEROBYTES + 32u];
+	int      r;
+
+	/* Undo the layout of ATMIsign_device_id_prepared(). */
+	memset(c, 0, ATMI_NACL_BOXZEROBYTES);
+	memcpy(c + ATMI_NACL_BOXZEROBYTES, idsgn + ATMI_XSIGN_NONCE_SIZE,
+	       ATMI_XSIGN_SIZE - ATMI_XSIGN_NONCE_SIZE);
+
+	r = crypto_box_curve25519xsalsa20poly1305_open_afternm(m, c, sizeof(c),
+	                                                      idsgn, boxkey);
+	if(!r)
+		r = crypto_verify_32(m + ATMI_NACL_ZEROBYTES, devid);
+
+	ATMIpriv_memzero(m, sizeof(m));
+	return r ? -EBADF : 0;
+}
+
+
+int ATMIcheck_own_device_id(const atmi_context_t *ctx,
+                            const uint8_t idsgn_in[72],
+                            const uint8_t devid_in[32])
+{
+	uint8_t  boxkey[32];
+	int      r;
+
+	if(!ctx || !idsgn_in || !devid_in)
+		return -EINVAL;
+
+	if(!!crypto_box_curve25519xsalsa20poly1305_beforenm(boxkey,
+	                         ATMIpriv_server_pubkey, ctx->privateKey))
+		r = -EFAULT;
+	else
+		r = check_boxkey(boxkey, idsgn_in, devid_in);
+
+	ATMIpriv_memzero(boxkey, sizeof(boxkey));
+	return r;
+}
+
+
+int ATMIcheck_own_device_id_prepared(const atmi_prepared_context_t *pctx,
+                                     const uint8_t idsgn_in[72],
+                                     const uint8_t devid_in[32])
+{
+	if(!pctx || !pctx->prepared || !idsgn_in || !devid_in)
+		return -EINVAL;
+
+	return check_boxkey(pctx->boxkey, idsgn_in, devid_in);
+}
+
+
+/* Elements sealed or opened per multi-buffer keystream call. */
+#define PREP_CHUNK  (8u)
+
+
+int ATMIsign_device_id_batch(const atmi_prepared_context_t *pctx,
+                             uint8_t       idsgns_out[][72],
+                             const uint8_t devids_in[][32], size_t n)
+{
+	uint8_t  ks[PREP_CHUNK][64];
+	size_t   i, j, k;
+
+	if(!pctx || !pctx->prepared || (n > 0u && (!idsgns_out || !devids_in)))
+		return -EINVAL;
+
+	for(i = 0u; i < n; i += k) {
+		k = (n - i < PREP_CHUNK) ? n - i : PREP_CHUNK;
+
+		for(j = 0u; j < k; j++)
+			ATMIrng_fill(idsgns_out[i + j], ATMI_XSIGN_NONCE_SIZE);
+
+		ATMIpriv_xsalsa20_block0(ks, pctx->boxkey, idsgns_out[i],
+		                         ATMI_XSIGN_SIZE, k);
+
+		/* Same layout as ATMIsign_device_id_prepared(). */
+		for(j = 0u; j < k; j++) {
+			uint8_t *out = idsgns_out[i + j];
+			uint8_t *c   = out + ATMI_XSIGN_NONCE_SIZE + 16u;
+			unsigned b;
+
+			for(b = 0u; b < 32u; b++)
+				c[b] = devids_in[i + j][b] ^ ks[j][32u + b];
+			(void)crypto_onetimeauth_poly1305(out + ATMI_XSIGN_NONCE_SIZE,
+			                                  c, 32u, ks[j]);
+		}
+	}
+
+	ATMIpriv_memzero(ks, sizeof(ks));
+	return 0;
+}
+
+
+int ATMIcheck_own_device_id_batch(const atmi_prepared_context_t *pctx,
+                                  const uint8_t idsgns_in[][72],
+                                  const uint8_t devids_in[][32],
+                                  size_t n, int status[])
+{
+	uint8_t  ks[PREP_CHUNK][64];
+	uint8_t  m[32];
+	size_t   i, j, k;
+	int      count = 0;
+
+	if(!pctx || !pctx->prepared || (n > 0u &&
+	   (!idsgns_in || !devids_in || !status)))
+		return -EINVAL;
+
+	for(i = 0u; i < n; i += k) {
+		k = (n - i < PREP_CHUNK) ? n - i : PREP_CHUNK;
+
+		ATMIpriv_xsalsa20_block0(ks, pctx->boxkey, idsgns_in[i],
+		                         ATMI_XSIGN_SIZE, k);
+
+		for(j = 0u; j < k; j++) {
+			const uint8_t *in = idsgns_in[i + j];
+			const uint8_t *c  = in + ATMI_XSIGN_NONCE_SIZE + 16u;
+			unsigned       b;
+
+			status[i + j] = -EBADF;
+			if(crypto_onetimeauth_poly1305_verify(in + ATMI_XSIGN_NONCE_SIZE,
+			                                      c, 32u, ks[j]) != 0)
+				continue;
+
+			for(b = 0u; b < 32u; b++)
+				m[b] = c[b] ^ ks[j][32u + b];
+			if(crypto_verify_32(m, devids_in[i + j]) != 0)
+				continue;
+
+			status[i + j] = 0;
+			count++;
+		}
+	}
+
+	ATMIpriv_memzero(ks, sizeof(ks));
+	ATMIpriv_memzero(m, sizeof(m));
+	return count;
+}
@@ -0,0 +1,14 @@
+/*
+ * Atonomi Device SDK: Private Definitions
+ *
+ * Copyright (C) 2018 Atonomi
+ */
+#include "atmi_priv.h"
+
+
+const uint8_t ATMIpriv_server_pubkey[32] = {
+	0x6d, 0x44, 0x54, 0x04, 0xc1, 0x94, 0x8c, 0x93,
+	0x56, 0x94, 0x1f, 0x8d, 0x42, 0xd7, 0x96, 0x3f,
+	0xfe, 0x16, 0xf0, 0x9e, 0x46, 0x73, 0x2a, 0xeb,
+	0x11, 0x24, 0x35, 0xc0, 0xfe, 0x2a, 0x1f, 0x78
+};
@@ -0,0 +1,257 @@
+/*
+ * Atonomi Device SDK: Private Definitions
+ *
+ * Copyright (C) 2018 Atonomi
+ *
+ * Definitions shared between the SDK extension sources. These mirror the
+ * packet and session state layout used by the prebuilt atmi.o contained
+ * in each lib/libatmi-*.a archive and must be kept in sync with it. None
+ * of this is part of the public API.
+ */
+#ifndef ATMI_PRIV_H_
+#define ATMI_PRIV_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "atmi.h"
+
+
+/*
+ * Every Atonomi packet is prefixed with a five byte header: a three byte
+ * protocol tag and version, one byte of message type, and a CRC-8 of the
+ * plaintext message. The CENTRI envelope follows immediately afterwards.
+ */
+#define ATMI_PKT_TAG0               ((uint8_t)'a')
+#define ATMI_PKT_TAG1               ((uint8_t)'0')
+#define ATMI_PKT_TAG2               ((uint8_t)'2')
+#define ATMI_PKT_HDR_SIZE           (5u)
+#define ATMI_PKT_ENVELOPE_SIZE      (ATMI_SESSBUF_SIZE - ATMI_PKT_HDR_SIZE)
+
+/* Message type bytes. Requests are upper case; responses lower case. */
+#define ATMI_PKT_TYPE_ACT_REQ       ((uint8_t)'A')
+#define ATMI_PKT_TYPE_VAL_REQ       ((uint8_t)'V')
+#define ATMI_PKT_TYPE_REP_REQ       ((uint8_t)'R')
+#define ATMI_PKT_TYPE_ACT_RESP      ((uint8_t)'a')
+#define ATMI_PKT_TYPE_VAL_RESP      ((uint8_t)'v')
+#define ATMI_PKT_TYPE_REP_RESP      ((uint8_t)'r')
+/* Unconfirmed extension for stop packages; see atmi_persist.h. */
+#define ATMI_PKT_TYPE_STOP          ((uint8_t)'S')
+
+/* Aggregated reputation amendments (atmi_multi.h). */
+#define ATMI_PKT_TYPE_REP_MULTI_REQ     ((uint8_t)'M')
+#define ATMI_PKT_TYPE_REP_MULTI_RESP    ((uint8_t)'m')
+
+/* Length of each plaintext message as sent over the wire. */
+#define ATMI_MSGLEN_ACT_REQ         (32u)
+#define ATMI_MSGLEN_VAL_REQ         (32u + 72u + 32u)
+#define ATMI_MSGLEN_REP_REQ         (32u + 32u + 16u + 1u + 1u)
+#define ATMI_MSGLEN_ACT_RESP        (4u)
+#define ATMI_MSGLEN_VAL_RESP        (32u)
+#define ATMI_MSGLEN_REP_RESP        (4u)
+#define ATMI_MSGLEN_REP_MULTI_REQ(n)    (1u + 32u + 50u * (n))
+#define ATMI_MSGLEN_REP_MULTI_RESP(n)   (1u + ATMI_MSGLEN_REP_RESP * (n))
+
+/* Cross-signed Device ID: nonce, followed by an authenticated box. */
+#define ATMI_XSIGN_NONCE_SIZE       (24u)
+#define ATMI_XSIGN_SIZE             (ATMI_XSIGN_NONCE_SIZE + 16u + 32u)
+
+
+/*
+ * Layout of atmi_session_t.state. The decrypted response pointer and
+ * length are filled in by the library's response callback; the package
+ * carries the CENTRI session across from pack to unpack.
+ */
+typedef struct {
+	const atmi_context_t *ctx;
+	const uint8_t        *rsp;
+	size_t                rsplen;
+	PSPackage             pkg;
+} atmi_session_state_t;
+
+typedef char atmi_session_state_size_check[
+	(sizeof(atmi_session_state_t) == ATMI_SESSBUF_STATE_SIZE) ? 1 : -1];
+
+
+/* The IRN session manager's public key, as built into atmi.o. */
+extern const uint8_t ATMIpriv_server_pubkey[32];
+
+
+/*
+ * Packet helpers (atmi_pkt.c), complementing those within atmi.o.
+ *
+ * ATMIpriv_pack_greeting() frames and encrypts a message as a CENTRI
+ * greeting, opening a new session in st, exactly as ATMIpack_* do but
+ * writing the packet to pkt. ATMIpriv_pack_data() does likewise as a data
+ * package on the established session held in st, and ATMIpriv_pack_stop()
+ * as a stop package closing it, with an empty message. All return the
+ * packet length or a negative error code as per ATMIpack_*, with -ENOSPC if
+ * npkt is too small, and -EPIPE from the latter two if st holds no session.
+ *
+ * ATMIpriv_unpack() checks the header of the packet in pin, decrypts its
+ * envelope into work (which must not overlap pin) and, after checking the
+ * length and CRC of the message, copies it to out. Unlike the routine in
+ * atmi.o, both session replies and data packages are accepted. Returns zero
+ * or a negative error code as per ATMIunpack_*, with -ENOSPC if nwork is too
+ * small for the envelope.
+ */
+int ATMIpriv_pack_greeting(const atmi_context_t *ctx,
+                           atmi_session_state_t *st,
+                           uint8_t *pkt, size_t npkt, uint8_t type,
+                           const void *msg, size_t nmsg);
+
+int ATMIpriv_pack_data(const atmi_context_t *ctx, atmi_session_state_t *st,
+                       uint8_t *pkt, size_t npkt, uint8_t type,
+                       const void *msg, size_t nmsg);
+
+int ATMIpriv_pack_stop(const atmi_context_t *ctx, atmi_session_state_t *st,
+                       uint8_t *pkt, size_t npkt, uint8_t reason);
+
+int ATMIpriv_unpack(const atmi_context_t *ctx, atmi_session_state_t *st,
+                    const uint8_t *pin, size_t nin, uint8_t type,
+                    uint8_t *work, size_t nwork, void *out, size_t nout);
+
+
+/*
+ * CRC-8 over the plaintext message carried in the packet header.
+ * Polynomial 0x2F, initial value 0xFF, final XOR 0xFF.
+ */
+static inline uint8_t ATMIpriv_crc8(const void *p, size_t n)
+{
+	const uint8_t *b = p;
+	uint8_t        c = 0xffu;
+	unsigned       i;
+
+	for(; n > 0u; n--) {
+		c ^= *b++;
+		for(i = 0u; i < 8u; i++)
+			c = (uint8_t)((c << 1) ^ ((c & 0x80u) ? 0x2fu : 0x00u));
+	}
+
+	return (uint8_t)~c;
+}
+
+/* Little-endian loads and stores. */
+static inline unsigned ATMIpriv_load16(const uint8_t *p)
+{
+	return (unsigned)p[0] | (unsigned)p[1] << 8;
+}
+
+static inline uint32_t ATMIpriv_load32(const uint8_t *p)
+{
+	return (uint32_t)p[0]        | (uint32_t)p[1] <<  8 |
+	       (uint32_t)p[2] << 16  | (uint32_t)p[3] << 24;
+}
+
+static inline void ATMIpriv_store16(uint8_t *p, unsigned v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+}
+
+static inline void ATMIpriv_store32(uint8_t *p, uint32_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >>  8);
+	p[2] = (uint8_t)(v >> 16);
+	p[3] = (uint8_t)(v >> 24);
+}
+
+/* Clear secrets, in a way the compiler may not optimize away. */
+static inline void ATMIpriv_memzero(void *p, size_t n)
+{
+	volatile uint8_t *b = p;
+
+	while(n--)
+		*b++ = 0u;
+}
+
+
+/*
+ * Allocation by the SDK's own modules. The pool of atmi_heap.c is too small
+ * for the tables allocated with these, so the modules using them are left
+ * out of ATMI_NO_HEAP builds, and these are left undefined there.
+ */
+#ifndef ATMI_NO_HEAP
+#define ATMIpriv_malloc             malloc
+#define ATMIpriv_calloc             calloc
+#define ATMIpriv_free               free
+#endif
+
+
+/*
+ * Snapshot encoding (atmi_snap.c) of the CENTRI session data alone, as used
+ * by ATMIsession_export() and ATMIsession_import(). Return values are as
+ * for those routines; pointers are not checked.
+ */
+int ATMIpriv_snap_export(const PSSession *sess, uint8_t *out, size_t nout);
+int ATMIpriv_snap_import(PSSession *sess, const uint8_t *in, size_t nin);
+
+
+/*
+ * Instrumentation (atmi_stats.c). Accounts one call of the given phase,
+ * then calls any registered tracer.
+ */
+void ATMIpriv_stats_record(unsigned phase, uint64_t cycles);
+
+
+/*
+ * NaCl primitives bundled within every lib/libatmi-*.a archive. No headers
+ * are shipped for these, so they are declared here. The classic NaCl API
+ * is used rather than libsodium's *_easy() variants since only the former
+ * is available in the Cortex-M builds.
+ */
+#define ATMI_NACL_ZEROBYTES         (32u)
+#define ATMI_NACL_BOXZEROBYTES      (16u)
+
+int crypto_box_curve25519xsalsa20poly1305_beforenm(unsigned char *k,
+                                                   const unsigned char *pk,
+                                                   const unsigned char *sk);
+int crypto_box_curve25519xsalsa20poly1305_afternm(unsigned char *c,
+                                                  const unsigned char *m,
+                                                  unsigned long long mlen,
+                                                  const unsigned char *n,
+                                                  const unsigned char *k);
+int crypto_box_curve25519xsalsa20poly1305_open_afternm(unsigned char *m,
+                                                       const unsigned char *c,
+                                                       unsigned long long clen,
+                                                       const unsigned char *n,
+                                                       const unsigned char *k);
+int crypto_verify_32(const unsigned char *x, const unsigned char *y);
+int crypto_core_hsalsa20(unsigned char *out, const unsigned char *in,
+                         const unsigned char *k, const unsigned char *c);
+int crypto_core_salsa20(unsigned char *out, const unsigned char *in,
+                        const unsigned char *k, const unsigned char *c);
+int crypto_onetimeauth_poly1305(unsigned char *out, const unsigned char *in,
+                                unsigned long long inlen,
+                                const unsigned char *k);
+int crypto_onetimeauth_poly1305_verify(const unsigned char *h,
+                                       const unsigned char *in,
+                                       unsigned long long inlen,
+                                       const unsigned char *k);
+
+
+/*
+ * Multi-buffer XSalsa20 (atmi_mb.c). Writes to ks[i] the first 64-byte
+ * XSalsa20 keystream block under key for each of n 24-byte nonces, the
+ * first found at nonces and the rest at intervals of stride bytes. Sealing
+ * a cross-signed Device ID uses bytes 0-31 as its Poly1305 key and bytes
+ * 32-63 to encrypt the ID.
+ */
+void ATMIpriv_xsalsa20_block0(uint8_t (*ks)[64], const uint8_t key[32],
+                              const uint8_t *nonces, size_t stride, size_t n);
+
+/*
+ * Precomputed key exchanges (atmi_keyx.c). Writes to k the shared key held
+ * for the key pair (pk, sk) and returns 0, or returns -1 if none is held.
+ */
+int ATMIpriv_keyx_lookup(uint8_t k[32], const uint8_t pk[32],
+                         const uint8_t sk[32]);
+
+/*
+ * Hold k as the shared key between private key sk and the IRN, as does
+ * ATMIkeyx_precompute(). Returns -ENODEV if not linked with
+ * ATMI_KEYX_LDFLAGS, else 0.
+ */
+int ATMIpriv_keyx_hold(const uint8_t sk[32], const uint8_t k[32]);
+
+#endif /*ATMI_PRIV_H_*/
@@ -0,0 +1,425 @@
+/*
+ * Atonomi Device SDK: Store-and-Forward Queue
+ *
+ * Copyright (C) 2018 Atonomi
+ *
+ * Pages are numbered by a sequence number that increases by one for each
+ * page started; page seq lives at index seq % npages. Each page begins with
+ * a header: its sequence number (4, little-endian), QUEUE_MAGIC (2), a
+ * check byte over those, and a state byte left erased while the page is in
+ * use.
+ * The state byte is programmed to zero before the page is erased, so that
+ * a page whose erase is torn by a reset is not mistaken for a live one.
+ * Records follow back to back, each a type byte, its payload and a check
+ * byte over both, up to the first erased or invalid byte; a record that
+ * does not fit starts the next page.
+ *
+ * Check bytes are a CRC-8 with the top bit cleared, so that one never
+ * programmed, and so still 0xff, never matches: as bytes are programmed in
+ * order, a header or record torn by a reset is always detected.
+ *
+ *   'A'  Activation: requestor's Device ID (32).
+ *   'R'  Reputation: requestor's and subject's Device IDs (32 each),
+ *        reputation token (16), comms flags (1; bit 0 reply received,
+ *        bit 1 successful).
+ *   'K'  Checkpoint: sequence number (4) and offset (4) of the oldest
+ *        pending request, little-endian.
+ *
+ * Sequence numbers are compared modulo 2^32.
+ */
+#include <string.h>
+#include "atmi_errno.h"
+#include "atmi_queue.h"
+#include "atmi_priv.h"
+
+
+#define QUEUE_HDR_SIZE      (8u)
+#define QUEUE_CKPT          ('K')
+#define QUEUE_REC_MAX       (83u)
+
+#define QUEUE_FLAG_REPLY    (0x01u)
+#define QUEUE_FLAG_SUCCESS  (0x02u)
+
+#define QUEUE_HDR_CHECK       (6u)
+#define QUEUE_HDR_STATE     (7u)
+
+static const uint8_t QUEUE_MAGIC[2] = { 'A', 'Q' };
+
+
+static uint8_t q_check(const uint8_t *p, size_t n)
+{
+	return ATMIpriv_crc8(p, n) & 0x7fu;
+}
+
+
+/* Length of a whole record of the given type, or zero if unknown. */
+static uint32_t q_reclen(uint8_t type)
+{
+	switch(type) {
+	case ATMI_QUEUE_ACT: return 1u + 32u + 1u;
+	case ATMI_QUEUE_REP: return 1u + 81u + 1u;
+	case QUEUE_CKPT:     return 1u + 8u + 1u;
+	default:             return 0u;
+	}
+}
+
+
+/* 1 and the page's sequence number if it holds a valid header, else 0. */
+static int q_read_hdr(const atmi_queue_t *q, uint32_t page, uint32_t *seq)
+{
+	uint8_t hdr[QUEUE_HDR_SIZE];
+	int     r;
+
+	if( (r = q->m.read(q->m.arg, page, 0u, hdr, sizeof(hdr))) < 0 )
+		return r;
+
+	*seq = ATMIpriv_load32(hdr);
+	return (!memcmp(hdr + 4, QUEUE_MAGIC, sizeof(QUEUE_MAGIC)) &&
+	        hdr[QUEUE_HDR_CHECK] == q_check(hdr, QUEUE_HDR_CHECK) &&
+	        hdr[QUEUE_HDR_STATE] == 0xffu && *seq % q->m.npages == page);
+}
+
+/* Length of the valid record at seq/off, or zero if its page ends there. */
+static int q_read_rec(const atmi_queue_t *q, uint32_t seq, uint32_t off,
+                      uint8_t rec[QUEUE_REC_MAX])
+{
+	uint32_t page = seq % q->m.npages;
+	uint32_t len;
+	int      r;
+
+	if(off >= q->m.page_size)
+		return 0;
+	if( (r = q->m.read(q->m.arg, page, off, rec, 1u)) < 0 )
+		return r;
+
+	len = q_reclen(rec[0]);
+	if(len == 0u || len > q->m.page_size - off)
+		return 0;
+	if( (r = q->m.read(q->m.arg, page, off + 1u, rec + 1, len - 1u)) < 0 )
+		return r;
+
+	return (q_check(rec, len - 1u) == rec[len - 1u]) ? (int)len : 0;
+}
+
+/*
+ * Read the record at seq/off, moving on to later pages past the end of
+ * each, and advance past it. Returns its length, or zero at the tail.
+ */
+static int q_next(const atmi_queue_t *q, uint32_t *seq, uint32_t *off,
+                  uint8_t rec[QUEUE_REC_MAX])
+{
+	int r;
+
+	for(;;) {
+		if(*seq == q->tail_seq && *off >= q->tail_off)
+			return 0;
+
+		if( (r = q_read_rec(q, *seq, *off, rec)) != 0 ) {
+			if(r > 0)
+				*off += (uint32_t)r;
+			return r;
+		}
+
+		if(*seq == q->tail_seq)
+			return 0;
+		(*seq)++;
+		*off = QUEUE_HDR_SIZE;
+	}
+}
+
+
+/* Erase a page for reuse as page seq, and program its header. */
+static int q_start_page(atmi_queue_t *q, uint32_t seq)
+{
+	uint8_t  hdr[QUEUE_HDR_SIZE];
+	uint32_t page = seq % q->m.npages;
+	int      r;
+
+	if( (r = q->m.read(q->m.arg, page, QUEUE_HDR_STATE, hdr, 1u)) < 0 )
+		return r;
+	if(hdr[0] == 0xffu) {
+		hdr[0] = 0x00u;
+		if( (r = q->m.prog(q->m.arg, page, QUEUE_HDR_STATE, hdr, 1u)) < 0 )
+			return r;
+	}
+
+	if( (r = q->m.erase(q->m.arg, page)) < 0 )
+		return r;
+
+	/* The state byte is left erased. */
+	ATMIpriv_store32(hdr, seq);
+	memcpy(hdr + 4, QUEUE_MAGIC, sizeof(QUEUE_MAGIC));
+	hdr[QUEUE_HDR_CHECK] = q_check(hdr, QUEUE_HDR_CHECK);
+	return q->m.prog(q->m.arg, page, 0u, hdr, QUEUE_HDR_STATE);
+}
+
+/* Append a record, starting a new page if need be, but leaving reserve. */
+static int q_append(atmi_queue_t *q, uint8_t *rec, uint32_t reserve)
+{
+	uint32_t len = q_reclen(rec[0]);
+	uint32_t seq;
+	int      r;
+
+	rec[len - 1u] = q_check(rec, len - 1u);
+
+	if(len > q->m.page_size - q->tail_off) {
+		/* The page reused must hold nothing still pending. */
+		seq = q->tail_seq + 1u;
+		if(seq - q->head_seq >= q->m.npages - reserve)
+			return -ENOSPC;
+
+		if( (r = q_start_page(q, seq)) < 0 )
+			return r;
+
+		q->tail_seq = seq;
+		q->tail_off = QUEUE_HDR_SIZE;
+	}
+
+	r = q->m.prog(q->m.arg, q->tail_seq % q->m.npages, q->tail_off, rec,
+	              len);
+	/* On failure the page may hold part of the record; write no more. */
+	q->tail_off = (r < 0) ? q->m.page_size : q->tail_off + len;
+	return r;
+}
+
+static int q_put(atmi_queue_t *q, uint8_t *rec)
+{
+	int r;
+
+	/* Nothing before the tail is pending, so all of it may be reused. */
+	if(q->npending == 0u) {
+		q->head_seq = q->tail_seq;
+		q->head_off = q->tail_off;
+	}
+
+	if( (r = q_append(q, rec, 1u)) < 0 )
+		return r;
+
+	q->npending++;
+	return 0;
+}
+
+
+int ATMIqueue_open(atmi_queue_t *q, const atmi_queue_media_t *m)
+{
+	uint8_t  rec[QUEUE_REC_MAX];
+	uint32_t i, seq, off, top = 0u, oldest, kseq, koff;
+	int      r, found = 0, ckpt = 0;
+
+	if(!q || !m || !m->read || !m->prog || !m->erase ||
+	   m->npages < ATMI_QUEUE_MIN_PAGES ||
+	   m->page_size < ATMI_QUEUE_MIN_PAGE_SIZE)
+		return -EINVAL;
+
+	q->m        = *m;
+	q->npending = 0u;
+
+	/* The tail is in the page started last. */
+	for(i = 0u; i < m->npages; i++) {
+		if( (r = q_read_hdr(q, i, &seq)) < 0 )
+			return r;
+		if(r && (!found || (int32_t)(seq - top) > 0)) {
+			top   = seq;
+			found = 1;
+		}
+	}
+
+	if(!found) {
+		q->head_seq = q->tail_seq = (uint32_t)-1;
+		q->head_off = q->tail_off = m->page_size;
+		return 0;
+	}
+
+	/* Its records end at the first erased byte, or are torn there. */
+	for(off = QUEUE_HDR_SIZE; (r = q_read_rec(q, top, off, rec)) > 0; )
+		off += (uint32_t)r;
+	if(r < 0)
+		return r;
+	if(off < m->page_size &&
+	   (r = m->read(m->arg, top % m->npages, off, rec, 1u)) < 0)
+		return r;
+
+	q->tail_seq = top;
+	q->tail_off = (off < m->page_size && rec[0] == 0xffu) ? off
+	                                                      : m->page_size;
+
+	/* The log runs back from there through consecutive pages. */
+	for(oldest = top; top - oldest + 1u < m->npages; oldest--) {
+		if( (r = q_read_hdr(q, (oldest - 1u) % m->npages, &seq)) < 0 )
+			return r;
+		if(!r || seq != oldest - 1u)
+			break;
+	}
+
+	/* Pending requests start at the last checkpoint still in the log. */
+	kseq = oldest;
+	koff = QUEUE_HDR_SIZE;
+	for(seq = oldest, off = QUEUE_HDR_SIZE;
+	    (r = q_next(q, &seq, &off, rec)) > 0; )
+		if(rec[0] == QUEUE_CKPT) {
+			kseq = ATMIpriv_load32(rec + 1);
+			koff = ATMIpriv_load32(rec + 5);
+			ckpt = 1;
+		}
+	if(r < 0)
+		return r;
+
+	if(!ckpt || (int32_t)(kseq - oldest) < 0 || (int32_t)(top - kseq) < 0 ||
+	   koff < QUEUE_HDR_SIZE || koff > m->page_size) {
+		kseq = oldest;
+		koff = QUEUE_HDR_SIZE;
+	}
+	q->head_seq = kseq;
+	q->head_off = koff;
+
+	for(seq = kseq, off = koff; (r = q_next(q, &seq, &off, rec)) > 0; )
+		if(rec[0] != QUEUE_CKPT)
+			q->npending++;
+	if(r < 0)
+		return r;
+
+	return (int)q->npending;
+}
+
+
+int ATMIqueue_put_act(atmi_queue_t *q, const atmi_act_request_t *act)
+{
+	uint8_t rec[QUEUE_REC_MAX];
+
+	if(!q || !act)
+		return -EINVAL;
+
+	rec[0] = ATMI_QUEUE_ACT;
+	memcpy(rec + 1, act->id_requestor, sizeof(act->id_requestor));
+	return q_put(q, rec);
+}
+
+
+int ATMIqueue_put_rep(atmi_queue_t *q, const atmi_rep_request_t *rep)
+{
+	uint8_t rec[QUEUE_REC_MAX];
+
+	if(!q || !rep)
+		return -EINVAL;
+
+	rec[0] = ATMI_QUEUE_REP;
+	memcpy(rec + 1, rep->id_requestor, sizeof(rep->id_requestor));
+	memcpy(rec + 33, rep->id_subject, sizeof(rep->id_subject));
+	memcpy(rec + 65, rep->reputation_token, sizeof(rep->reputation_token));
+	rec[81] = (uint8_t)((rep->comms_replyreceived ? QUEUE_FLAG_REPLY : 0u) |
+	                    (rep->comms_successful ? QUEUE_FLAG_SUCCESS : 0u));
+	return q_put(q, rec);
+}
+
+
+int ATMIqueue_peek(atmi_queue_t *q, atmi_queue_item_t items[], size_t n)
+{
+	uint8_t            rec[QUEUE_REC_MAX];
+	atmi_rep_request_t *rep;
+	uint32_t           seq, off;
+	size_t             k;
+	int                r;
+
+	if(!q || (!items && n > 0u))
+		return -EINVAL;
+
+	seq = q->head_seq;
+	off = q->head_off;
+	for(k = 0u; k < n && k < q->npending; ) {
+		if( (r = q_next(q, &seq, &off, rec)) <= 0 )
+			return (r < 0) ? r : (int)k;
+
+		switch(rec[0]) {
+		case ATMI_QUEUE_ACT:
+			memcpy(items[k].req.act.id_requestor, rec + 1,
+			       sizeof(items[k].req.act.id_requestor));
+			break;
+
+		case ATMI_QUEUE_REP:
+			rep = &items[k].req.rep;
+			memcpy(rep->id_requestor, rec + 1, sizeof(rep->id_requestor));
+			memcpy(rep->id_subject, rec + 33, sizeof(rep->id_subject));
+			memcpy(rep->reputation_token, rec + 65,
+			       sizeof(rep->reputation_token));
+			rep->comms_replyreceived = !!(rec[81] & QUEUE_FLAG_REPLY);
+			rep->comms_successful    = !!(rec[81] & QUEUE_FLAG_SUCCESS);
+			break;
+
+		default:
+			continue;
+		}
+
+		items[k++].type = rec[0];
+	}
+
+	return (int)k;
+}
+
+
+int ATMIqueue_commit(atmi_queue_t *q, size_t n)
+{
+	uint8_t  rec[QUEUE_REC_MAX];
+	uint32_t seq, off;
+	size_t   k;
+	int      r;
+
+	if(!q || n > q->npending)
+		return -EINVAL;
+	if(n == 0u)
+		return 0;
+
+	/*
+	 * The head moves on to the next request, past any checkpoints and page
+	 * ends, so that each page is freed as soon as it is drained and
+	 * checkpoints cannot fill the reserve page.
+	 */
+	seq = q->head_seq;
+	off = q->head_off;
+	for(k = 0u; ; ) {
+		if( (r = q_next(q, &seq, &off, rec)) < 0 )
+			return r;
+		if(r == 0) {
+			if(k < n)
+				return -EFAULT;
+			break;
+		}
+		if(rec[0] == QUEUE_CKPT)
+			continue;
+		if(k++ == n) {
+			off -= (uint32_t)r;
+			break;
+		}
+	}
+
+	q->head_seq  = seq;
+	q->head_off  = off;
+	q->npending -= (uint32_t)n;
+
+	/*
+	 * The reserve page leaves room for the checkpoint, unless a record torn
+	 * there by a reset has used it up; the checkpoint then waits for a later
+	 * commit to free a page.
+	 */
+	rec[0] = QUEUE_CKPT;
+	ATMIpriv_store32(rec + 1, seq);
+	ATMIpriv_store32(rec + 5, off);
+	if( (r = q_append(q, rec, 0u)) < 0 && r != -ENOSPC )
+		return r;
+
+	return ATMIqueue_sync(q);
+}
+
+
+int ATMIqueue_sync(atmi_queue_t *q)
+{
+	if(!q)
+		return -EINVAL;
+
+	return q->m.sync ? q->m.sync(q->m.arg) : 0;
+}
+
+
+size_t ATMIqueue_pending(const atmi_queue_t *q)
+{
+	return q ? q->npending : 0u;
+}
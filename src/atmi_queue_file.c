@@ -0,0 +1,145 @@
+/*
+ * Atonomi Device SDK: Store-and-Forward Queue, file-backed media
+ *
+ * Copyright (C) 2018 Atonomi
+ *
+ * The pages are a shared mapping of the file, so programmed data reaches
+ * the page cache at once, and the file by msync(). Programming is checked
+ * against the flash rules, so that a queue tested here behaves the same on
+ * an MCU.
+ */
+#include "atmi_errno.h"
+#include "atmi_queue.h"
+#include "atmi_priv.h"
+
+#if defined(__linux__) && !defined(ATMI_NO_HEAP)
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+typedef struct {
+	uint8_t  *map;
+	size_t    len;
+	uint32_t  page_size;
+	int       fd;
+} qf_media_t;
+
+
+static int qf_read(void *arg, uint32_t page, uint32_t off, void *p, size_t n)
+{
+	qf_media_t *f = arg;
+
+	memcpy(p, f->map + (size_t)page * f->page_size + off, n);
+	return 0;
+}
+
+static int qf_prog(void *arg, uint32_t page, uint32_t off, const void *p,
+                   size_t n)
+{
+	qf_media_t    *f   = arg;
+	uint8_t       *dst = f->map + (size_t)page * f->page_size + off;
+	const uint8_t *src = p;
+	size_t         i;
+
+	for(i = 0u; i < n; i++)
+		if(dst[i] != 0xffu)
+			return -EIO;
+
+	memcpy(dst, src, n);
+	return 0;
+}
+
+static int qf_erase(void *arg, uint32_t page)
+{
+	qf_media_t *f = arg;
+
+	memset(f->map + (size_t)page * f->page_size, 0xff, f->page_size);
+	return 0;
+}
+
+static int qf_sync(void *arg)
+{
+	qf_media_t *f = arg;
+
+	return msync(f->map, f->len, MS_SYNC) ? -EIO : 0;
+}
+
+
+int ATMIqueue_media_file(atmi_queue_media_t *m, const char *path,
+                         uint32_t page_size, uint32_t npages)
+{
+	qf_media_t  *f;
+	struct stat  st;
+
+	if(!m || !path || npages < ATMI_QUEUE_MIN_PAGES ||
+	   page_size < ATMI_QUEUE_MIN_PAGE_SIZE ||
+	   (size_t)npages > SIZE_MAX / page_size)
+		return -EINVAL;
+
+	if( (f = ATMIpriv_malloc(sizeof(*f))) == NULL )
+		return -ENOMEM;
+
+	f->page_size = page_size;
+	f->len       = (size_t)npages * page_size;
+	f->map       = MAP_FAILED;
+
+	/* A new file reads as zeros, which no page header matches. */
+	if( (f->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600)) < 0 ||
+	    fstat(f->fd, &st) ||
+	    ((size_t)st.st_size != f->len && ftruncate(f->fd, (off_t)f->len)) ||
+	    (f->map = mmap(NULL, f->len, PROT_READ | PROT_WRITE, MAP_SHARED,
+	                   f->fd, 0)) == MAP_FAILED) {
+		if(f->fd >= 0)
+			close(f->fd);
+		ATMIpriv_free(f);
+		return -EIO;
+	}
+
+	m->read      = qf_read;
+	m->prog      = qf_prog;
+	m->erase     = qf_erase;
+	m->sync      = qf_sync;
+	m->arg       = f;
+	m->page_size = page_size;
+	m->npages    = npages;
+	return 0;
+}
+
+
+void ATMIqueue_media_file_close(atmi_queue_media_t *m)
+{
+	qf_media_t *f;
+
+	if(!m || !(f = m->arg))
+		return;
+
+	munmap(f->map, f->len);
+	close(f->fd);
+	ATMIpriv_free(f);
+	m->arg = NULL;
+}
+
+#else
+
+int ATMIqueue_media_file(atmi_queue_media_t *m, const char *path,
+                         uint32_t page_size, uint32_t npages)
+{
+	(void)m;
+	(void)path;
+	(void)page_size;
+	(void)npages;
+	return -ENODEV;
+}
+
+
+void ATMIqueue_media_file_close(atmi_queue_media_t *m)
+{
+	(void)m;
+}
+
+#endif /*__linux__ && !ATMI_NO_HEAP*/
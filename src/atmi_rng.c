@@ -0,0 +1,313 @@
+/*
+ * Atonomi Device SDK: Entropy Sources
+ *
+ * Copyright (C) 2018 Atonomi
+ *
+ * The DRBG is ChaCha20 with fast key erasure: each refill generates
+ * RNG_BLOCKS keystream blocks under the current key, of which the first 32
+ * bytes immediately replace the key and the rest are handed out, each
+ * byte cleared as it is. Output already returned therefore cannot be
+ * recovered from the state left behind. Reseeding XORs fresh source output
+ * into the key before the next refill.
+ *
+ * A forked child inherits its parent's generators, and would repeat their
+ * output. On hosts, a fork handler therefore moves the child on to a new
+ * generation, so that it reseeds before drawing; without threads, where no
+ * handler is registered, the process ID is checked on each draw instead.
+ */
+#include <string.h>
+#include "atmi_errno.h"
+#include "atmi_rng.h"
+#include "atmi_priv.h"
+
+#ifndef ATMI_NO_THREADS
+#define RNG_TLS     __thread
+#else
+#define RNG_TLS
+#endif
+
+#if !defined(__ARM_ARCH_6M__) && !defined(__ARM_ARCH_7M__)
+#define RNG_HAVE_SODIUM
+#ifndef ATMI_NO_THREADS
+#define RNG_ATFORK
+#include <pthread.h>
+#else
+#define RNG_GETPID
+#include <unistd.h>
+#endif
+#endif
+
+
+#define RNG_BLOCKS  (8u)
+#define RNG_KEYLEN  (32u)
+#define RNG_BUFLEN  (RNG_BLOCKS * 64u)
+
+
+typedef struct {
+	uint32_t  key[8];
+	uint8_t   buf[RNG_BUFLEN];
+	size_t    pos;          /* Next unused byte of buf.              */
+	size_t    since;        /* Bytes output since last seeded.       */
+	uint32_t  gen;          /* rng_gen when seeded; zero if never.   */
+} rng_drbg_t;
+
+
+static atmi_rng_fn  rng_fn;
+static void        *rng_arg;
+static unsigned     rng_flags;
+static uint32_t     rng_gen = 1u;
+
+#ifdef RNG_ATFORK
+static pthread_once_t  rng_atfork_once = PTHREAD_ONCE_INIT;
+#endif
+#ifdef RNG_GETPID
+static pid_t           rng_pid;
+#endif
+
+static RNG_TLS atmi_rng_fn  rng_thread_fn;
+static RNG_TLS void        *rng_thread_arg;
+static RNG_TLS rng_drbg_t   rng_drbg;
+
+
+#define RNG_ROTL(v, c)  (((v) << (c)) | ((v) >> (32 - (c))))
+
+#define RNG_QR(a, b, c, d)                                              \
+	do {                                                            \
+		a += b; d ^= a; d = RNG_ROTL(d, 16);                    \
+		c += d; b ^= c; b = RNG_ROTL(b, 12);                    \
+		a += b; d ^= a; d = RNG_ROTL(d,  8);                    \
+		c += d; b ^= c; b = RNG_ROTL(b,  7);                    \
+	} while(0)
+
+/* One ChaCha20 block under key, with a zero nonce and the given counter. */
+static void rng_chacha20_block(uint8_t out[64], const uint32_t key[8],
+                               uint32_t ctr)
+{
+	uint32_t  in[16], x[16];
+	unsigned  i;
+
+	in[0]  = 0x61707865u;
+	in[1]  = 0x3320646eu;
+	in[2]  = 0x79622d32u;
+	in[3]  = 0x6b206574u;
+	for(i = 0u; i < 8u; i++)
+		in[4 + i] = key[i];
+	in[12] = ctr;
+	in[13] = 0u;
+	in[14] = 0u;
+	in[15] = 0u;
+
+	memcpy(x, in, sizeof(x));
+	for(i = 0u; i < 10u; i++) {
+		RNG_QR(x[0], x[4], x[ 8], x[12]);
+		RNG_QR(x[1], x[5], x[ 9], x[13]);
+		RNG_QR(x[2], x[6], x[10], x[14]);
+		RNG_QR(x[3], x[7], x[11], x[15]);
+		RNG_QR(x[0], x[5], x[10], x[15]);
+		RNG_QR(x[1], x[6], x[11], x[12]);
+		RNG_QR(x[2], x[7], x[ 8], x[13]);
+		RNG_QR(x[3], x[4], x[ 9], x[14]);
+	}
+
+	for(i = 0u; i < 16u; i++)
+		ATMIpriv_store32(out + 4u*i, x[i] + in[i]);
+
+	ATMIpriv_memzero(x, sizeof(x));
+	ATMIpriv_memzero(in, sizeof(in));
+}
+
+
+static void rng_refill(rng_drbg_t *d)
+{
+	unsigned i;
+
+	for(i = 0u; i < RNG_BLOCKS; i++)
+		rng_chacha20_block(d->buf + 64u*i, d->key, i);
+
+	for(i = 0u; i < 8u; i++)
+		d->key[i] = ATMIpriv_load32(d->buf + 4u*i);
+	ATMIpriv_memzero(d->buf, RNG_KEYLEN);
+	d->pos = RNG_KEYLEN;
+}
+
+static void rng_reseed(rng_drbg_t *d, atmi_rng_fn fn, void *arg,
+                       uint32_t gen)
+{
+	uint8_t   seed[RNG_KEYLEN];
+	unsigned  i;
+
+	fn(arg, seed, sizeof(seed));
+	for(i = 0u; i < 8u; i++)
+		d->key[i] ^= ATMIpriv_load32(seed + 4u*i);
+	ATMIpriv_memzero(seed, sizeof(seed));
+
+	d->since = 0u;
+	d->gen   = gen;
+	rng_refill(d);
+}
+
+static void rng_drbg_read(rng_drbg_t *d, uint8_t *p, size_t n,
+                          atmi_rng_fn fn, void *arg, uint32_t gen)
+{
+	size_t k;
+
+	if(d->gen != gen || d->since >= ATMI_RNG_RESEED_BYTES)
+		rng_reseed(d, fn, arg, gen);
+
+	while(n > 0u) {
+		if(d->pos == RNG_BUFLEN)
+			rng_refill(d);
+
+		k = RNG_BUFLEN - d->pos;
+		if(k > n)
+			k = n;
+		memcpy(p, d->buf + d->pos, k);
+		ATMIpriv_memzero(d->buf + d->pos, k);
+
+		d->pos   += k;
+		d->since += k;
+		p        += k;
+		n        -= k;
+	}
+}
+
+
+static void rng_memrand(void *arg, void *p, size_t n)
+{
+	(void)arg;
+	ATMI_memrand(p, n);
+}
+
+
+/* Have every generator reseed before its next output. */
+static void rng_next_gen(void)
+{
+	uint32_t gen;
+
+	/* Skip zero, which marks a generator that was never seeded. */
+	gen = __atomic_load_n(&rng_gen, __ATOMIC_RELAXED) + 1u;
+	__atomic_store_n(&rng_gen, gen ? gen : 1u, __ATOMIC_RELEASE);
+}
+
+#ifdef RNG_ATFORK
+static void rng_atfork(void)
+{
+	(void)pthread_atfork(NULL, NULL, rng_next_gen);
+}
+#endif
+
+
+void ATMIrng_fill(void *p, size_t n)
+{
+	atmi_rng_fn fn;
+
+	if(!p || n == 0u)
+		return;
+
+	if(rng_thread_fn) {
+		rng_thread_fn(rng_thread_arg, p, n);
+		return;
+	}
+
+	fn = rng_fn ? rng_fn : rng_memrand;
+#ifdef RNG_GETPID
+	if((rng_flags & ATMI_RNG_DRBG) && rng_pid != getpid()) {
+		rng_pid = getpid();
+		rng_next_gen();
+	}
+#endif
+	if(rng_flags & ATMI_RNG_DRBG)
+		rng_drbg_read(&rng_drbg, p, n, fn, rng_arg,
+		              __atomic_load_n(&rng_gen, __ATOMIC_ACQUIRE));
+	else
+		fn(rng_arg, p, n);
+}
+
+
+int ATMIrng_set_source(atmi_rng_fn fn, void *arg, unsigned flags)
+{
+	if(flags & ~ATMI_RNG_DRBG)
+		return -EINVAL;
+
+#ifdef RNG_ATFORK
+	if(flags & ATMI_RNG_DRBG)
+		(void)pthread_once(&rng_atfork_once, rng_atfork);
+#endif
+#ifdef RNG_GETPID
+	rng_pid = getpid();
+#endif
+
+	rng_fn    = fn;
+	rng_arg   = arg;
+	rng_flags = flags;
+	rng_next_gen();
+	return 0;
+}
+
+
+void ATMIrng_set_thread(atmi_rng_fn fn, void *arg)
+{
+	rng_thread_fn  = fn;
+	rng_thread_arg = arg;
+}
+
+
+void ATMIrng_wipe_thread(void)
+{
+	ATMIpriv_memzero(&rng_drbg, sizeof(rng_drbg));
+}
+
+
+
+#ifdef RNG_HAVE_SODIUM
+
+/* libsodium's randombytes_implementation; no header ships with lib/. */
+typedef struct {
+	const char *(*implementation_name)(void);
+	uint32_t    (*random)(void);
+	void        (*stir)(void);
+	uint32_t    (*uniform)(const uint32_t upper_bound);
+	void        (*buf)(void *const buf, const size_t size);
+	int         (*close)(void);
+} rng_sodium_impl_t;
+
+int randombytes_set_implementation(rng_sodium_impl_t *impl);
+
+static const char *rng_sodium_name(void)
+{
+	return "atmi_rng";
+}
+
+static uint32_t rng_sodium_random(void)
+{
+	uint8_t b[4];
+
+	ATMIrng_fill(b, sizeof(b));
+	return ATMIpriv_load32(b);
+}
+
+static void rng_sodium_buf(void *const buf, const size_t size)
+{
+	ATMIrng_fill(buf, size);
+}
+
+static rng_sodium_impl_t rng_sodium = {
+	.implementation_name = rng_sodium_name,
+	.random              = rng_sodium_random,
+	.buf                 = rng_sodium_buf,
+};
+
+int ATMIrng_install(void)
+{
+	(void)randombytes_set_implementation(&rng_sodium);
+	return 0;
+}
+
+#else
+
+int ATMIrng_install(void)
+{
+	return -ENODEV;
+}
+
+#endif
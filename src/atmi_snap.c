@@ -0,0 +1,222 @@
+/*
+ * Atonomi Device SDK: Session Snapshots
+ *
+ * Copyright (C) 2018 Atonomi
+ */
+#include <string.h>
+#include "atmi_errno.h"
+#include "atmi_snap.h"
+#include "atmi_priv.h"
+
+
+/*
+ * Snapshot layout:
+ *
+ *   [0]       Format: ATMI_SNAP_V1_SPARSE or ATMI_SNAP_V1_DENSE.
+ *   [1..n-1)  Body.
+ *   [n-1]     CRC-8 of all preceding bytes.
+ *
+ * A dense body is the PSSession verbatim. A sparse body is a sequence of
+ * runs, each a gap byte (bytes left as in the reference since the previous
+ * run), a length byte, then that many bytes of session data. Runs closer
+ * than three bytes apart are merged, as splitting them would cost more.
+ */
+#define ATMI_SNAP_V1_SPARSE     (0x01u)
+#define ATMI_SNAP_V1_DENSE      (0x81u)
+#define ATMI_SNAP_MERGE_GAP     (3u)
+#define ATMI_SNAP_RUN_MAX       (255u)
+
+
+static atmi_session_state_t *ssn_state(atmi_session_t *ssn)
+{
+	return (atmi_session_state_t *)(void *)ssn->state;
+}
+
+
+/*
+ * Reference session: as left by pse_generate_greeting() on every request.
+ * Only the per-session secret and, once established, the session ID and
+ * keys differ from this.
+ */
+static void snap_reference(PSSession *ref)
+{
+	static const uint8_t hdr[] = { 0x43, 0x50, 0x10, 0x01,
+	                               0x00, 0x00, 0x00, 0x00, 0x02, 0x03 };
+
+	memset(ref, 0, sizeof(*ref));
+	memcpy(ref->privateData, hdr, sizeof(hdr));
+	memcpy(ref->privateData + 24, ATMIpriv_server_pubkey,
+	       sizeof(ATMIpriv_server_pubkey));
+}
+
+
+static int snap_run_ends(const uint8_t *cur, const uint8_t *ref,
+                         size_t i, size_t n)
+{
+	size_t k;
+
+	for(k = 0u; k < ATMI_SNAP_MERGE_GAP && i + k < n; k++)
+		if(cur[i + k] != ref[i + k])
+			return 0;
+	return 1;
+}
+
+
+/* Returns body length, or -1 if it would not fit within nbody. */
+static int snap_encode(uint8_t *body, size_t nbody,
+                       const uint8_t *cur, const uint8_t *ref, size_t n)
+{
+	size_t  i = 0u, j, end = 0u, o = 0u, gap, len;
+
+	while(i < n) {
+		if(cur[i] == ref[i]) {
+			i++;
+			continue;
+		}
+
+		for(j = i + 1u; j < n && !snap_run_ends(cur, ref, j, n); j++)
+			;
+
+		for(gap = i - end; gap > ATMI_SNAP_RUN_MAX;
+		    gap -= ATMI_SNAP_RUN_MAX) {
+			if(o + 2u > nbody)
+				return -1;
+			body[o++] = ATMI_SNAP_RUN_MAX;
+			body[o++] = 0u;
+		}
+
+		for(; i < j; i += len, gap = 0u) {
+			len = j - i;
+			if(len > ATMI_SNAP_RUN_MAX)
+				len = ATMI_SNAP_RUN_MAX;
+			if(o + 2u + len > nbody)
+				return -1;
+			body[o++] = (uint8_t)gap;
+			body[o++] = (uint8_t)len;
+			memcpy(body + o, cur + i, len);
+			o += len;
+		}
+
+		end = j;
+	}
+
+	return (int)o;
+}
+
+
+static int snap_decode(uint8_t *cur, size_t n,
+                       const uint8_t *body, size_t nbody)
+{
+	size_t  o = 0u, pos = 0u, len;
+
+	while(o < nbody) {
+		if(o + 2u > nbody)
+			return -EBADF;
+
+		pos += body[o++];
+		len  = body[o++];
+
+		if(pos + len > n || o + len > nbody)
+			return -EBADF;
+
+		memcpy(cur + pos, body + o, len);
+		o   += len;
+		pos += len;
+	}
+
+	return 0;
+}
+
+
+
+int ATMIpriv_snap_export(const PSSession *sess, uint8_t *out, size_t nout)
+{
+	PSSession  ref;
+	size_t     cap;
+	int        n;
+
+	if(nout < 2u)
+		return -ENOSPC;
+
+	snap_reference(&ref);
+
+	cap = (nout < ATMI_SNAPSHOT_MAX_SIZE) ? nout : ATMI_SNAPSHOT_MAX_SIZE;
+	cap -= 2u;
+	n   = snap_encode(out + 1, cap, (const uint8_t *)sess,
+	                  (const uint8_t *)&ref, sizeof(ref));
+
+	if(n >= 0) {
+		out[0] = ATMI_SNAP_V1_SPARSE;
+	} else if(nout >= ATMI_SNAPSHOT_MAX_SIZE) {
+		out[0] = ATMI_SNAP_V1_DENSE;
+		n = (int)sizeof(*sess);
+		memcpy(out + 1, sess, (size_t)n);
+	} else {
+		return -ENOSPC;
+	}
+
+	out[1 + n] = ATMIpriv_crc8(out, (size_t)(1 + n));
+	return 2 + n;
+}
+
+
+int ATMIpriv_snap_import(PSSession *sess, const uint8_t *in, size_t nin)
+{
+	PSSession  tmp;
+	int        r;
+
+	if(nin < 2u || nin > ATMI_SNAPSHOT_MAX_SIZE)
+		return -EINVAL;
+
+	if(in[0] != ATMI_SNAP_V1_SPARSE && in[0] != ATMI_SNAP_V1_DENSE)
+		return -ENOENT;
+	if(ATMIpriv_crc8(in, nin - 1u) != in[nin - 1u])
+		return -EBADF;
+
+	if(in[0] == ATMI_SNAP_V1_DENSE) {
+		if(nin != ATMI_SNAPSHOT_MAX_SIZE)
+			return -EBADF;
+		memcpy(&tmp, in + 1, sizeof(tmp));
+	} else {
+		snap_reference(&tmp);
+		r = snap_decode((uint8_t *)&tmp, sizeof(tmp), in + 1, nin - 2u);
+		if(r)
+			return r;
+	}
+
+	memcpy(sess, &tmp, sizeof(tmp));
+	return 0;
+}
+
+
+
+int ATMIsession_export(const atmi_session_t *ssn, uint8_t *out, size_t nout)
+{
+	const atmi_session_state_t *st;
+
+	if(!ssn || !out)
+		return -EINVAL;
+
+	st = (const atmi_session_state_t *)(const void *)ssn->state;
+	return ATMIpriv_snap_export(&st->pkg.sessionInfo, out, nout);
+}
+
+
+int ATMIsession_import(atmi_session_t *ssn, const uint8_t *in, size_t nin)
+{
+	atmi_session_state_t *st;
+	PSSession             sess;
+	int                   r;
+
+	if(!ssn || !in)
+		return -EINVAL;
+
+	r = ATMIpriv_snap_import(&sess, in, nin);
+	if(r)
+		return r;
+
+	st = ssn_state(ssn);
+	memset(st, 0, sizeof(*st));
+	memcpy(&st->pkg.sessionInfo, &sess, sizeof(sess));
+	return 0;
+}
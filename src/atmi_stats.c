@@ -0,0 +1,204 @@
+/*
+ * Atonomi Device SDK: Instrumentation
+ *
+ * Copyright (C) 2018 Atonomi
+ *
+ * Counters and queries. The interception of library calls that feeds them
+ * lives in atmi_trace.c, which is only linked in when ATMI_TRACE_LDFLAGS
+ * redirect calls to its wrappers.
+ *
+ * On hosts the 64-bit counters are updated with atomic operations. Cortex-M
+ * has none wider than 32 bits (and ARMv6-M none at all), so there they are
+ * plain updates within ATMI_STATS_LOCK(), as for the pool of atmi_heap.c.
+ *
+ * The tracer and its argument are published under a sequence count, odd
+ * while they are being changed. A call racing with a change skips the
+ * tracer rather than wait, so it never pairs one tracer with another's
+ * argument, nor spins in an interrupt handler.
+ */
+#include <string.h>
+#include <time.h>
+#include "atmi_errno.h"
+#include "atmi_stats.h"
+#include "atmi_priv.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#if !defined(__ARM_ARCH_6M__) && !defined(__ARM_ARCH_7M__)
+#define STATS_ATOMIC
+#define STATS_LOCK()            do { } while(0)
+#define STATS_UNLOCK()          do { } while(0)
+#define STATS_ADD(x, v)         __atomic_fetch_add(&(x), (v), __ATOMIC_RELAXED)
+#define STATS_GET(x)            __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define STATS_SET(x, v)         __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+#else
+#ifndef ATMI_STATS_LOCK
+#define ATMI_STATS_LOCK()       do { } while(0)
+#define ATMI_STATS_UNLOCK()     do { } while(0)
+#endif
+#define STATS_LOCK()            ATMI_STATS_LOCK()
+#define STATS_UNLOCK()          ATMI_STATS_UNLOCK()
+#define STATS_ADD(x, v)         ((x) += (v))
+#define STATS_GET(x)            (x)
+#define STATS_SET(x, v)         ((x) = (v))
+#endif
+
+
+/* Defined by atmi_trace.c; null unless that is linked. */
+extern const int ATMIpriv_trace_linked __attribute__((weak));
+
+
+static atmi_stats_t    stats_counters;
+static uint32_t        stats_tracer_seq;
+static atmi_tracer_fn  stats_tracer;
+static void           *stats_tracer_arg;
+
+static const char *const stats_names[ATMI_NPHASES] = {
+	[ATMI_PHASE_GREETING] = "greeting",
+	[ATMI_PHASE_DATA]     = "data",
+	[ATMI_PHASE_INCOMING] = "incoming",
+	[ATMI_PHASE_KEYGEN]   = "keygen",
+	[ATMI_PHASE_KEYX]     = "keyx",
+	[ATMI_PHASE_BOX]      = "box",
+	[ATMI_PHASE_RNG]      = "rng",
+	[ATMI_PHASE_CODEC]    = "codec",
+};
+
+
+__attribute__((weak))
+uint64_t ATMIstats_clock(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return (uint64_t)__rdtsc();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+
+/* Lower *p to v if v is less, or *p is zero. */
+static void stats_min(uint64_t *p, uint64_t v)
+{
+#ifdef STATS_ATOMIC
+	uint64_t cur = __atomic_load_n(p, __ATOMIC_RELAXED);
+
+	while((cur == 0u || v < cur) &&
+	      !__atomic_compare_exchange_n(p, &cur, v, 1,
+	                                   __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+#else
+	if(*p == 0u || v < *p)
+		*p = v;
+#endif
+}
+
+/* Raise *p to v if v is greater. */
+static void stats_max(uint64_t *p, uint64_t v)
+{
+#ifdef STATS_ATOMIC
+	uint64_t cur = __atomic_load_n(p, __ATOMIC_RELAXED);
+
+	while(v > cur &&
+	      !__atomic_compare_exchange_n(p, &cur, v, 1,
+	                                   __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+#else
+	if(v > *p)
+		*p = v;
+#endif
+}
+
+
+void ATMIpriv_stats_record(unsigned phase, uint64_t cycles)
+{
+	atmi_phase_stats_t *p = &stats_counters.phase[phase];
+	atmi_tracer_fn      fn;
+	void               *arg;
+	uint32_t            seq;
+	unsigned            b;
+
+	b = cycles ? 63u - (unsigned)__builtin_clzll(cycles) : 0u;
+	if(b >= ATMI_STATS_BUCKETS)
+		b = ATMI_STATS_BUCKETS - 1u;
+
+	STATS_LOCK();
+	STATS_ADD(p->calls, 1u);
+	STATS_ADD(p->cycles, cycles);
+	STATS_ADD(p->hist[b], 1u);
+	/* min is held plus one, so that zero means no calls yet. */
+	stats_min(&p->min, cycles + 1u);
+	stats_max(&p->max, cycles);
+	STATS_UNLOCK();
+
+	seq = __atomic_load_n(&stats_tracer_seq, __ATOMIC_ACQUIRE);
+	fn  = __atomic_load_n(&stats_tracer, __ATOMIC_RELAXED);
+	arg = __atomic_load_n(&stats_tracer_arg, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if(fn && !(seq & 1u) &&
+	   __atomic_load_n(&stats_tracer_seq, __ATOMIC_RELAXED) == seq)
+		fn(arg, phase, cycles);
+}
+
+
+int ATMIstats_get(atmi_stats_t *out)
+{
+	unsigned i, b;
+
+	if(!out)
+		return -EINVAL;
+	if(!&ATMIpriv_trace_linked)
+		return -ENODEV;
+
+	for(i = 0u; i < ATMI_NPHASES; i++) {
+		const atmi_phase_stats_t *p = &stats_counters.phase[i];
+		atmi_phase_stats_t       *q = &out->phase[i];
+
+		STATS_LOCK();
+		q->calls  = STATS_GET(p->calls);
+		q->cycles = STATS_GET(p->cycles);
+		q->min    = STATS_GET(p->min);
+		q->max    = STATS_GET(p->max);
+		for(b = 0u; b < ATMI_STATS_BUCKETS; b++)
+			q->hist[b] = STATS_GET(p->hist[b]);
+		STATS_UNLOCK();
+
+		q->min = q->min ? q->min - 1u : 0u;
+	}
+
+	return 0;
+}
+
+
+void ATMIstats_reset(void)
+{
+	unsigned  i;
+	uint64_t *w = (uint64_t *)(void *)&stats_counters;
+
+	STATS_LOCK();
+	for(i = 0u; i < sizeof(stats_counters)/sizeof(*w); i++)
+		STATS_SET(w[i], 0u);
+	STATS_UNLOCK();
+}
+
+
+void ATMIstats_set_tracer(atmi_tracer_fn fn, void *arg)
+{
+	uint32_t seq = __atomic_load_n(&stats_tracer_seq, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&stats_tracer_seq, seq + 1u, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&stats_tracer, fn, __ATOMIC_RELAXED);
+	__atomic_store_n(&stats_tracer_arg, arg, __ATOMIC_RELAXED);
+	__atomic_store_n(&stats_tracer_seq, seq + 2u, __ATOMIC_RELEASE);
+}
+
+
+const char *ATMIstats_phase_name(unsigned phase)
+{
+	return (phase < ATMI_NPHASES) ? stats_names[phase] : NULL;
+}
@@ -0,0 +1,261 @@
+/*
+ * Atonomi Device SDK: Instrumentation Wrappers
+ *
+ * Copyright (C) 2018 Atonomi
+ *
+ * Link-time wrappers (GNU ld --wrap) around calls made by and into the
+ * prebuilt libraries. Nothing refers to this file's symbols unless the
+ * program is linked with ATMI_TRACE_LDFLAGS, so it is otherwise left out
+ * of the link altogether.
+ *
+ * The Cortex-M libraries make their key pairs with TweetNaCl's
+ * crypto_scalarmult_curve25519_base(), and have no libsodium entry points
+ * to wrap (see atmi_stats.h).
+ */
+#include "atmi_stats.h"
+#include "atmi_priv.h"
+
+#ifndef ATMI_NO_THREADS
+#define TRACE_TLS   __thread
+#else
+#define TRACE_TLS
+#endif
+
+#if defined(__ARM_ARCH_6M__) || defined(__ARM_ARCH_7M__)
+#define TRACE_TWEETNACL
+#endif
+
+
+const int ATMIpriv_trace_linked = 1;
+
+/* Cycles spent in phases nested directly within the current one. */
+static TRACE_TLS uint64_t trace_inner;
+
+
+typedef struct {
+	uint64_t  t0;
+	uint64_t  outer;
+} trace_frame_t;
+
+
+static void trace_enter(trace_frame_t *f)
+{
+	f->outer    = trace_inner;
+	trace_inner = 0u;
+	f->t0       = ATMIstats_clock();
+}
+
+/* Returns the duration of the phase, less that of phases nested within. */
+static uint64_t trace_leave(trace_frame_t *f, unsigned phase)
+{
+	uint64_t dt    = ATMIstats_clock() - f->t0;
+	uint64_t inner = trace_inner;
+
+	trace_inner = f->outer + dt;
+	ATMIpriv_stats_record(phase, dt);
+	return (inner < dt) ? dt - inner : 0u;
+}
+
+static void trace_leave_pse(trace_frame_t *f, unsigned phase)
+{
+	ATMIpriv_stats_record(ATMI_PHASE_CODEC, trace_leave(f, phase));
+}
+
+
+int __real_pse_generate_greeting(const PSKeys *k, PSPackage *p,
+                                 PSGreetingInfo *gi);
+int __real_pse_generate_data_package(const PSKeys *k, PSPackage *p);
+int __real_pse_generate_stop_package(const PSKeys *k, PSPackage *p,
+                                     uint8_t reason);
+int __real_pse_process_incoming_package(const PSEPackageHandler *h,
+                                        const uint8_t *in, size_t nin,
+                                        PSSession *sess);
+int __real_crypto_box_easy(unsigned char *c, const unsigned char *m,
+                           unsigned long long mlen, const unsigned char *n,
+                           const unsigned char *pk, const unsigned char *sk);
+int __real_crypto_box_open_easy(unsigned char *m, const unsigned char *c,
+                                unsigned long long clen,
+                                const unsigned char *n,
+                                const unsigned char *pk,
+                                const unsigned char *sk);
+void __real_ATMI_memrand(void *p, size_t n);
+
+int __wrap_pse_generate_greeting(const PSKeys *k, PSPackage *p,
+                                 PSGreetingInfo *gi);
+int __wrap_pse_generate_data_package(const PSKeys *k, PSPackage *p);
+int __wrap_pse_generate_stop_package(const PSKeys *k, PSPackage *p,
+                                     uint8_t reason);
+int __wrap_pse_process_incoming_package(const PSEPackageHandler *h,
+                                        const uint8_t *in, size_t nin,
+                                        PSSession *sess);
+int __wrap_crypto_box_easy(unsigned char *c, const unsigned char *m,
+                           unsigned long long mlen, const unsigned char *n,
+                           const unsigned char *pk, const unsigned char *sk);
+int __wrap_crypto_box_open_easy(unsigned char *m, const unsigned char *c,
+                                unsigned long long clen,
+                                const unsigned char *n,
+                                const unsigned char *pk,
+                                const unsigned char *sk);
+void __wrap_ATMI_memrand(void *p, size_t n);
+
+#ifndef TRACE_TWEETNACL
+int __real_crypto_scalarmult_base(unsigned char *q, const unsigned char *n);
+int __real_crypto_scalarmult_curve25519(unsigned char *q,
+                                        const unsigned char *n,
+                                        const unsigned char *p);
+void __real_randombytes_buf(void *buf, size_t n);
+
+int __wrap_crypto_scalarmult_base(unsigned char *q, const unsigned char *n);
+int __wrap_crypto_scalarmult_curve25519(unsigned char *q,
+                                        const unsigned char *n,
+                                        const unsigned char *p);
+void __wrap_randombytes_buf(void *buf, size_t n);
+#else
+int __real_crypto_scalarmult_curve25519_base(unsigned char *q,
+                                             const unsigned char *n);
+
+int __wrap_crypto_scalarmult_curve25519_base(unsigned char *q,
+                                             const unsigned char *n);
+#endif
+
+
+
+int __wrap_pse_generate_greeting(const PSKeys *k, PSPackage *p,
+                                 PSGreetingInfo *gi)
+{
+	trace_frame_t  f;
+	int            r;
+
+	trace_enter(&f);
+	r = __real_pse_generate_greeting(k, p, gi);
+	trace_leave_pse(&f, ATMI_PHASE_GREETING);
+	return r;
+}
+
+int __wrap_pse_generate_data_package(const PSKeys *k, PSPackage *p)
+{
+	trace_frame_t  f;
+	int            r;
+
+	trace_enter(&f);
+	r = __real_pse_generate_data_package(k, p);
+	trace_leave_pse(&f, ATMI_PHASE_DATA);
+	return r;
+}
+
+int __wrap_pse_generate_stop_package(const PSKeys *k, PSPackage *p,
+                                     uint8_t reason)
+{
+	trace_frame_t  f;
+	int            r;
+
+	trace_enter(&f);
+	r = __real_pse_generate_stop_package(k, p, reason);
+	trace_leave_pse(&f, ATMI_PHASE_DATA);
+	return r;
+}
+
+int __wrap_pse_process_incoming_package(const PSEPackageHandler *h,
+                                        const uint8_t *in, size_t nin,
+                                        PSSession *sess)
+{
+	trace_frame_t  f;
+	int            r;
+
+	trace_enter(&f);
+	r = __real_pse_process_incoming_package(h, in, nin, sess);
+	trace_leave_pse(&f, ATMI_PHASE_INCOMING);
+	return r;
+}
+
+
+#ifndef TRACE_TWEETNACL
+
+int __wrap_crypto_scalarmult_base(unsigned char *q, const unsigned char *n)
+{
+	trace_frame_t  f;
+	int            r;
+
+	trace_enter(&f);
+	r = __real_crypto_scalarmult_base(q, n);
+	(void)trace_leave(&f, ATMI_PHASE_KEYGEN);
+	return r;
+}
+
+int __wrap_crypto_scalarmult_curve25519(unsigned char *q,
+                                        const unsigned char *n,
+                                        const unsigned char *p)
+{
+	trace_frame_t  f;
+	int            r;
+
+	trace_enter(&f);
+	r = __real_crypto_scalarmult_curve25519(q, n, p);
+	(void)trace_leave(&f, ATMI_PHASE_KEYX);
+	return r;
+}
+
+#else
+
+int __wrap_crypto_scalarmult_curve25519_base(unsigned char *q,
+                                             const unsigned char *n)
+{
+	trace_frame_t  f;
+	int            r;
+
+	trace_enter(&f);
+	r = __real_crypto_scalarmult_curve25519_base(q, n);
+	(void)trace_leave(&f, ATMI_PHASE_KEYGEN);
+	return r;
+}
+
+#endif /*TRACE_TWEETNACL*/
+
+int __wrap_crypto_box_easy(unsigned char *c, const unsigned char *m,
+                           unsigned long long mlen, const unsigned char *n,
+                           const unsigned char *pk, const unsigned char *sk)
+{
+	trace_frame_t  f;
+	int            r;
+
+	trace_enter(&f);
+	r = __real_crypto_box_easy(c, m, mlen, n, pk, sk);
+	(void)trace_leave(&f, ATMI_PHASE_BOX);
+	return r;
+}
+
+int __wrap_crypto_box_open_easy(unsigned char *m, const unsigned char *c,
+                                unsigned long long clen,
+                                const unsigned char *n,
+                                const unsigned char *pk,
+                                const unsigned char *sk)
+{
+	trace_frame_t  f;
+	int            r;
+
+	trace_enter(&f);
+	r = __real_crypto_box_open_easy(m, c, clen, n, pk, sk);
+	(void)trace_leave(&f, ATMI_PHASE_BOX);
+	return r;
+}
+
+
+#ifndef TRACE_TWEETNACL
+void __wrap_randombytes_buf(void *buf, size_t n)
+{
+	trace_frame_t f;
+
+	trace_enter(&f);
+	__real_randombytes_buf(buf, n);
+	(void)trace_leave(&f, ATMI_PHASE_RNG);
+}
+#endif
+
+void __wrap_ATMI_memrand(void *p, size_t n)
+{
+	trace_frame_t f;
+
+	trace_enter(&f);
+	__real_ATMI_memrand(p, n);
+	(void)trace_leave(&f, ATMI_PHASE_RNG);
+}
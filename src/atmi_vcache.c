@@ -0,0 +1,232 @@
+/*
+ * Atonomi Device SDK: Validation Result Cache
+ *
+ * Copyright (C) 2018 Atonomi
+ *
+ * Linear probing, with deletion by backward shift so that no tombstones
+ * accumulate. Live entries are also threaded, by slot index, on a doubly
+ * linked list in order of use; entries moved by a deletion are relinked.
+ */
+#include <string.h>
+#include "atmi_errno.h"
+#include "atmi_vcache.h"
+
+
+#define VC_NIL      (0xffffu)
+
+
+typedef struct {
+	uint8_t              id[32];
+	atmi_val_response_t  val;
+	uint32_t             hash;
+	uint32_t             expires;
+	uint16_t             prev, next;
+	uint16_t             used;
+} vc_entry_t;
+
+typedef char vc_entry_size_check[
+	(sizeof(vc_entry_t) == ATMI_VCACHE_ENTRY_SIZE) ? 1 : -1];
+
+
+static uint32_t vc_hash(const uint8_t id[32])
+{
+	uint32_t  w, h = 0u;
+	unsigned  i;
+
+	for(i = 0u; i < 32u; i += 4u) {
+		memcpy(&w, id + i, sizeof(w));
+		h ^= w;
+	}
+
+	/* MurmurHash3 finalizer. */
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+	return h;
+}
+
+
+static void vc_unlink(atmi_vcache_t *vc, vc_entry_t *s, uint16_t i)
+{
+	if(s[i].prev != VC_NIL)
+		s[s[i].prev].next = s[i].next;
+	else
+		vc->head = s[i].next;
+
+	if(s[i].next != VC_NIL)
+		s[s[i].next].prev = s[i].prev;
+	else
+		vc->tail = s[i].prev;
+}
+
+static void vc_link_head(atmi_vcache_t *vc, vc_entry_t *s, uint16_t i)
+{
+	s[i].prev = VC_NIL;
+	s[i].next = vc->head;
+	if(vc->head != VC_NIL)
+		s[vc->head].prev = i;
+	else
+		vc->tail = i;
+	vc->head = i;
+}
+
+
+/* Slot holding id, or VC_NIL; *pfree is set to the slot ending the probe. */
+static uint16_t vc_find(const atmi_vcache_t *vc, const uint8_t id[32],
+                        uint32_t h, uint16_t *pfree)
+{
+	const vc_entry_t *s = vc->slots;
+	uint16_t          i;
+
+	for(i = (uint16_t)(h & vc->mask); s[i].used;
+	    i = (uint16_t)((i + 1u) & vc->mask))
+		if(s[i].hash == h && !memcmp(s[i].id, id, sizeof(s[i].id)))
+			return i;
+
+	if(pfree)
+		*pfree = i;
+	return VC_NIL;
+}
+
+static void vc_delete(atmi_vcache_t *vc, uint16_t i)
+{
+	vc_entry_t *s = vc->slots;
+	uint16_t    j, home;
+
+	vc_unlink(vc, s, i);
+
+	/* Pull back any later entry of the run that may now sit at i. */
+	for(j = i; ; ) {
+		j = (uint16_t)((j + 1u) & vc->mask);
+		if(!s[j].used)
+			break;
+
+		home = (uint16_t)(s[j].hash & vc->mask);
+		if(((unsigned)(j - home) & vc->mask) <
+		   ((unsigned)(j - i) & vc->mask))
+			continue;
+
+		s[i] = s[j];
+		if(s[i].prev != VC_NIL)
+			s[s[i].prev].next = i;
+		else
+			vc->head = i;
+		if(s[i].next != VC_NIL)
+			s[s[i].next].prev = i;
+		else
+			vc->tail = i;
+		i = j;
+	}
+
+	s[i].used = 0u;
+	vc->nlive--;
+}
+
+
+int ATMIvcache_init(atmi_vcache_t *vc, void *mem, size_t nmem,
+                    uint32_t ttl, uint32_t neg_ttl)
+{
+	uintptr_t  pad;
+	size_t     nslots;
+
+	if(!vc || !mem || ttl == 0u)
+		return -EINVAL;
+
+	pad = (uintptr_t)-(uintptr_t)mem & 3u;
+	if(nmem < pad)
+		return -EINVAL;
+
+	nslots = (nmem - pad) / sizeof(vc_entry_t);
+	if(nslots > ATMI_VCACHE_MAX_SLOTS)
+		nslots = ATMI_VCACHE_MAX_SLOTS;
+	while(nslots & (nslots - 1u))
+		nslots &= nslots - 1u;
+	if(nslots < 4u)
+		return -EINVAL;
+
+	vc->slots   = (uint8_t *)mem + pad;
+	vc->ttl     = ttl;
+	vc->neg_ttl = neg_ttl;
+	vc->mask    = (uint16_t)(nslots - 1u);
+	vc->nlive   = 0u;
+	vc->nmax    = (uint16_t)(nslots - nslots/4u);
+	vc->head    = VC_NIL;
+	vc->tail    = VC_NIL;
+	memset(vc->slots, 0, nslots * sizeof(vc_entry_t));
+
+	return (int)vc->nmax;
+}
+
+
+int ATMIvcache_lookup(atmi_vcache_t *vc, const uint8_t id[32], uint32_t now,
+                      atmi_val_response_t *val)
+{
+	vc_entry_t *s;
+	uint16_t    i;
+
+	if(!vc || !id || !val)
+		return -EINVAL;
+
+	s = vc->slots;
+	if( (i = vc_find(vc, id, vc_hash(id), NULL)) == VC_NIL )
+		return -ENOENT;
+
+	if((int32_t)(s[i].expires - now) <= 0) {
+		vc_delete(vc, i);
+		return -ENOENT;
+	}
+
+	vc_unlink(vc, s, i);
+	vc_link_head(vc, s, i);
+	*val = s[i].val;
+	return 0;
+}
+
+
+int ATMIvcache_store(atmi_vcache_t *vc, const uint8_t id[32], uint32_t now,
+                     const atmi_val_response_t *val)
+{
+	vc_entry_t *s;
+	uint32_t    h;
+	uint16_t    i;
+
+	if(!vc || !id || !val)
+		return -EINVAL;
+
+	s = vc->slots;
+	h = vc_hash(id);
+	if( (i = vc_find(vc, id, h, NULL)) != VC_NIL )
+		vc_delete(vc, i);
+
+	if(val->success < 0 && vc->neg_ttl == 0u)
+		return 0;
+
+	if(vc->nlive == vc->nmax)
+		vc_delete(vc, vc->tail);
+	(void)vc_find(vc, id, h, &i);
+
+	memcpy(s[i].id, id, sizeof(s[i].id));
+	s[i].val     = *val;
+	s[i].hash    = h;
+	s[i].expires = now + ((val->success < 0) ? vc->neg_ttl : vc->ttl);
+	s[i].used    = 1u;
+	memset(s[i].val.reputation_token, 0, sizeof(s[i].val.reputation_token));
+
+	vc_link_head(vc, s, i);
+	vc->nlive++;
+	return 0;
+}
+
+
+void ATMIvcache_forget(atmi_vcache_t *vc, const uint8_t id[32])
+{
+	uint16_t i;
+
+	if(!vc || !id)
+		return;
+
+	if( (i = vc_find(vc, id, vc_hash(id), NULL)) != VC_NIL )
+		vc_delete(vc, i);
+}
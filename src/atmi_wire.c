@@ -0,0 +1,144 @@
+/*
+ * Atonomi Device SDK: Compact Wire Encoding
+ *
+ * Copyright (C) 2018 Atonomi
+ *
+ * Standard layout, as produced by pse_generate_greeting() after the ATMI
+ * header (offsets from the start of the packet):
+ *
+ *   5    Envelope length (2), little-endian.
+ *   7    Format version, WIRE_VERSION.
+ *   8    Package type.
+ *   9    Attribute: declared decrypted length (tag, 2-byte value).
+ *   12   Attribute: body (tag, 2-byte length), holding:
+ *   15     Nonce (tag, length, 24 bytes).
+ *   41     Public key (tag, length, 32 bytes).
+ *   75     Ciphertext, to the end of the packet.
+ */
+#include <string.h>
+#include "atmi_errno.h"
+#include "atmi_wire.h"
+#include "atmi_priv.h"
+
+
+#define WIRE_VERSION        (0x23u)
+#define WIRE_TAG_PLAINLEN   (0x0au)
+#define WIRE_TAG_BODY       (0x04u)
+#define WIRE_TAG_NONCE      (0x82u)
+#define WIRE_TAG_PUBKEY     (0x80u)
+
+#define WIRE_NONCE_LEN      (24u)
+#define WIRE_PUBKEY_LEN     (32u)
+
+/* Offsets within the standard and compact layouts. */
+#define WIRE_STD_NONCE      (17u)
+#define WIRE_STD_PUBKEY     (43u)
+#define WIRE_STD_CIPHER     (75u)
+#define WIRE_CMP_NONCE      (6u)
+#define WIRE_CMP_PUBKEY     (30u)
+
+
+int ATMIwire_is_compact(const void *pinbuf, size_t nin)
+{
+	const uint8_t *pin = pinbuf;
+
+	return (pin && nin > 0u && (pin[0] & 0xf0u) == ATMI_WIRE_COMPACT);
+}
+
+
+int ATMIwire_compact(const void *pinbuf, size_t nin,
+                     void *poutbuf, size_t nout, unsigned flags)
+{
+	const uint8_t *pin  = pinbuf;
+	uint8_t       *pout = poutbuf;
+	uint8_t        hdr[WIRE_CMP_PUBKEY];
+	size_t         nkey, ncipher, ncmp;
+
+	if(!pin || !pout || (flags & ~ATMI_WIRE_NOKEY))
+		return -EINVAL;
+
+	if(nin <= WIRE_STD_CIPHER || nin > ATMI_SESSBUF_SIZE ||
+	   pin[0] != ATMI_PKT_TAG0 || pin[1] != ATMI_PKT_TAG1 ||
+	   pin[2] != ATMI_PKT_TAG2 ||
+	   ATMIpriv_load16(pin + 5) != nin - ATMI_PKT_HDR_SIZE ||
+	   pin[7] != WIRE_VERSION || pin[9] != WIRE_TAG_PLAINLEN ||
+	   pin[12] != WIRE_TAG_BODY || ATMIpriv_load16(pin + 13) != nin - 15u ||
+	   pin[15] != WIRE_TAG_NONCE || pin[16] != WIRE_NONCE_LEN ||
+	   pin[41] != WIRE_TAG_PUBKEY || pin[42] != WIRE_PUBKEY_LEN)
+		return -EBADF;
+
+	nkey    = (flags & ATMI_WIRE_NOKEY) ? 0u : WIRE_PUBKEY_LEN;
+	ncipher = nin - WIRE_STD_CIPHER;
+	ncmp    = WIRE_CMP_PUBKEY + nkey + ncipher;
+	if(nout < ncmp)
+		return -ENOSPC;
+
+	/* Gathered first, as pout may be pin. */
+	hdr[0] = (uint8_t)(ATMI_WIRE_COMPACT | flags);
+	hdr[1] = pin[3];
+	hdr[2] = pin[4];
+	hdr[3] = pin[8];
+	hdr[4] = pin[10];
+	hdr[5] = pin[11];
+	memcpy(hdr + WIRE_CMP_NONCE, pin + WIRE_STD_NONCE, WIRE_NONCE_LEN);
+
+	/* Everything kept moves towards the start, so copy front to back. */
+	memcpy(pout, hdr, sizeof(hdr));
+	memmove(pout + WIRE_CMP_PUBKEY, pin + WIRE_STD_PUBKEY, nkey);
+	memmove(pout + WIRE_CMP_PUBKEY + nkey, pin + WIRE_STD_CIPHER, ncipher);
+
+	return (int)ncmp;
+}
+
+
+int ATMIwire_expand(const void *pinbuf, size_t nin, const uint8_t pubkey[32],
+                    void *poutbuf, size_t nout)
+{
+	const uint8_t *pin  = pinbuf;
+	uint8_t       *pout = poutbuf;
+	size_t         nkey, ncipher, nstd;
+
+	if(!pin || !pout)
+		return -EINVAL;
+	if(!ATMIwire_is_compact(pin, nin))
+		return -ENOENT;
+	if(pin[0] & ~(ATMI_WIRE_COMPACT | ATMI_WIRE_NOKEY))
+		return -EBADF;
+	if((pin[0] & ATMI_WIRE_NOKEY) && !pubkey)
+		return -EINVAL;
+
+	nkey = (pin[0] & ATMI_WIRE_NOKEY) ? 0u : WIRE_PUBKEY_LEN;
+	if(nin <= WIRE_CMP_PUBKEY + nkey)
+		return -EBADF;
+
+	ncipher = nin - WIRE_CMP_PUBKEY - nkey;
+	nstd    = WIRE_STD_CIPHER + ncipher;
+	if(nstd > ATMI_SESSBUF_SIZE)
+		return -EBADF;
+	if(nout < nstd)
+		return -ENOSPC;
+
+	pout[0]  = ATMI_PKT_TAG0;
+	pout[1]  = ATMI_PKT_TAG1;
+	pout[2]  = ATMI_PKT_TAG2;
+	pout[3]  = pin[1];
+	pout[4]  = pin[2];
+	ATMIpriv_store16(pout + 5, nstd - ATMI_PKT_HDR_SIZE);
+	pout[7]  = WIRE_VERSION;
+	pout[8]  = pin[3];
+	pout[9]  = WIRE_TAG_PLAINLEN;
+	pout[10] = pin[4];
+	pout[11] = pin[5];
+	pout[12] = WIRE_TAG_BODY;
+	ATMIpriv_store16(pout + 13, nstd - 15u);
+	pout[15] = WIRE_TAG_NONCE;
+	pout[16] = WIRE_NONCE_LEN;
+	memcpy(pout + WIRE_STD_NONCE, pin + WIRE_CMP_NONCE, WIRE_NONCE_LEN);
+	pout[41] = WIRE_TAG_PUBKEY;
+	pout[42] = WIRE_PUBKEY_LEN;
+	memcpy(pout + WIRE_STD_PUBKEY, nkey ? pin + WIRE_CMP_PUBKEY : pubkey,
+	       WIRE_PUBKEY_LEN);
+	memcpy(pout + WIRE_STD_CIPHER, pin + WIRE_CMP_PUBKEY + nkey, ncipher);
+
+	return (int)nstd;
+}
@@ -0,0 +1,250 @@
+/*
+ * Atonomi Device SDK: Caller-supplied Workspaces
+ *
+ * Copyright (C) 2018 Atonomi
+ */
+#include <string.h>
+#include "atmi_errno.h"
+#include "atmi_ws.h"
+
+
+#define ATMI_WS_FILL    (0xa5u)
+
+
+/*
+ * Call fn(arg) with the stack pointer set to stack_top, restoring the
+ * caller's stack pointer afterwards. stack_top must be suitably aligned
+ * (16 bytes covers every supported ABI).
+ *
+ * The CFI directives take the canonical frame address from the saved stack
+ * pointer (rbp or r4) for the duration of the call, so debuggers, profilers
+ * and backtrace() can unwind from within the library through the switch
+ * and into the caller.
+ */
+int ATMIpriv_ws_switch(void *arg, int (*fn)(void *), void *stack_top);
+
+#if defined(__x86_64__)
+__asm__(
+	".text\n"
+	".globl  ATMIpriv_ws_switch\n"
+	".hidden ATMIpriv_ws_switch\n"
+	".type   ATMIpriv_ws_switch, @function\n"
+	"ATMIpriv_ws_switch:\n"
+	"	.cfi_startproc\n"
+	"	pushq  %rbp\n"
+	"	.cfi_def_cfa_offset 16\n"
+	"	.cfi_offset %rbp, -16\n"
+	"	movq   %rsp, %rbp\n"
+	"	.cfi_def_cfa_register %rbp\n"
+	"	movq   %rdx, %rsp\n"
+	"	callq  *%rsi\n"
+	"	movq   %rbp, %rsp\n"
+	"	popq   %rbp\n"
+	"	.cfi_def_cfa %rsp, 8\n"
+	"	retq\n"
+	"	.cfi_endproc\n"
+	".size   ATMIpriv_ws_switch, .-ATMIpriv_ws_switch\n"
+);
+#define ATMI_WS_SWITCH  1
+
+#elif defined(__arm__)
+/* Thumb encoding, valid from ARMv6-M upwards. */
+__asm__(
+	".text\n"
+	".syntax unified\n"
+	".thumb\n"
+	".align  2\n"
+	".globl  ATMIpriv_ws_switch\n"
+	".hidden ATMIpriv_ws_switch\n"
+	".type   ATMIpriv_ws_switch, %function\n"
+	".thumb_func\n"
+	"ATMIpriv_ws_switch:\n"
+	"	.cfi_startproc\n"
+	"	push   {r4, lr}\n"
+	"	.cfi_def_cfa_offset 8\n"
+	"	.cfi_offset r4, -8\n"
+	"	.cfi_offset lr, -4\n"
+	"	mov    r4, sp\n"
+	"	.cfi_def_cfa_register r4\n"
+	"	mov    sp, r2\n"
+	"	blx    r1\n"
+	"	mov    sp, r4\n"
+	"	.cfi_def_cfa_register sp\n"
+	"	pop    {r4, pc}\n"
+	"	.cfi_endproc\n"
+	".size   ATMIpriv_ws_switch, .-ATMIpriv_ws_switch\n"
+);
+#define ATMI_WS_SWITCH  1
+
+#else
+#define ATMI_WS_SWITCH  0
+#endif
+
+
+static int ws_call(atmi_workspace_t *ws, int (*fn)(void *), void *arg)
+{
+	if(!ws)
+		return -EINVAL;
+
+#if ATMI_WS_SWITCH
+	return ATMIpriv_ws_switch(arg, fn, ws->stack + sizeof(ws->stack));
+#else
+	return fn(arg);
+#endif
+}
+
+
+void ATMIworkspace_init(atmi_workspace_t *ws)
+{
+	if(ws)
+		memset(ws->stack, ATMI_WS_FILL, sizeof(ws->stack));
+}
+
+
+size_t ATMIworkspace_used(const atmi_workspace_t *ws)
+{
+	size_t i = 0u;
+
+	if(!ws)
+		return 0u;
+
+	/* Stacks grow downwards on every supported target. */
+	while(i < sizeof(ws->stack) && ws->stack[i] == ATMI_WS_FILL)
+		i++;
+
+	return sizeof(ws->stack) - i;
+}
+
+
+
+/* Arguments for all calls, marshalled across the stack switch. */
+typedef struct {
+	const atmi_context_t *ctx;
+	atmi_session_t       *ssn;
+	const void           *in;
+	size_t                nin;
+	void                 *out;
+} ws_args_t;
+
+
+static int thunk_pack_act(void *p)
+{
+	ws_args_t *a = p;
+
+	return ATMIpack_act_request(a->ctx, a->ssn, a->in);
+}
+
+static int thunk_pack_val(void *p)
+{
+	ws_args_t *a = p;
+
+	return ATMIpack_val_request(a->ctx, a->ssn, a->in);
+}
+
+static int thunk_pack_rep(void *p)
+{
+	ws_args_t *a = p;
+
+	return ATMIpack_rep_request(a->ctx, a->ssn, a->out);
+}
+
+static int thunk_unpack_act(void *p)
+{
+	ws_args_t *a = p;
+
+	return ATMIunpack_act_response(a->ctx, a->ssn, a->in, a->nin, a->out);
+}
+
+static int thunk_unpack_val(void *p)
+{
+	ws_args_t *a = p;
+
+	return ATMIunpack_val_response(a->ctx, a->ssn, a->in, a->nin, a->out);
+}
+
+static int thunk_unpack_rep(void *p)
+{
+	ws_args_t *a = p;
+
+	return ATMIunpack_rep_response(a->ctx, a->ssn, a->in, a->nin, a->out);
+}
+
+static int thunk_sign(void *p)
+{
+	ws_args_t *a = p;
+
+	return ATMIsign_device_id(a->ctx, a->ssn, a->out, a->in);
+}
+
+
+
+int ATMIpack_act_request_ws(atmi_workspace_t *ws,
+                            const atmi_context_t *ctx, atmi_session_t *ssn,
+                            const atmi_act_request_t *act)
+{
+	ws_args_t a = { .ctx = ctx, .ssn = ssn, .in = act };
+
+	return ws_call(ws, thunk_pack_act, &a);
+}
+
+int ATMIpack_val_request_ws(atmi_workspace_t *ws,
+                            const atmi_context_t *ctx, atmi_session_t *ssn,
+                            const atmi_val_request_t *val)
+{
+	ws_args_t a = { .ctx = ctx, .ssn = ssn, .in = val };
+
+	return ws_call(ws, thunk_pack_val, &a);
+}
+
+int ATMIpack_rep_request_ws(atmi_workspace_t *ws,
+                            const atmi_context_t *ctx, atmi_session_t *ssn,
+                            atmi_rep_request_t *rep)
+{
+	ws_args_t a = { .ctx = ctx, .ssn = ssn, .out = rep };
+
+	return ws_call(ws, thunk_pack_rep, &a);
+}
+
+int ATMIunpack_act_response_ws(atmi_workspace_t *ws,
+                               const atmi_context_t *ctx, atmi_session_t *ssn,
+                               const void *pinbuf, size_t nin,
+                               atmi_act_response_t *act)
+{
+	ws_args_t a = { .ctx = ctx, .ssn = ssn, .in = pinbuf, .nin = nin,
+	                .out = act };
+
+	return ws_call(ws, thunk_unpack_act, &a);
+}
+
+int ATMIunpack_val_response_ws(atmi_workspace_t *ws,
+                               const atmi_context_t *ctx, atmi_session_t *ssn,
+                               const void *pinbuf, size_t nin,
+                               atmi_val_response_t *val)
+{
+	ws_args_t a = { .ctx = ctx, .ssn = ssn, .in = pinbuf, .nin = nin,
+	                .out = val };
+
+	return ws_call(ws, thunk_unpack_val, &a);
+}
+
+int ATMIunpack_rep_response_ws(atmi_workspace_t *ws,
+                               const atmi_context_t *ctx, atmi_session_t *ssn,
+                               const void *pinbuf, size_t nin,
+                               atmi_rep_response_t *rep)
+{
+	ws_args_t a = { .ctx = ctx, .ssn = ssn, .in = pinbuf, .nin = nin,
+	                .out = rep };
+
+	return ws_call(ws, thunk_unpack_rep, &a);
+}
+
+int ATMIsign_device_id_ws(atmi_workspace_t *ws,
+                          const atmi_context_t *ctx, atmi_session_t *ssn,
+                          uint8_t       idsgn_out[72],
+                          const uint8_t devid_in [32])
+{
+	ws_args_t a = { .ctx = ctx, .ssn = ssn, .in = devid_in,
+	                .out = idsgn_out };
+
+	return ws_call(ws, thunk_sign, &a);
+}
@@ -0,0 +1,162 @@
+/*
+ * Atonomi Device SDK: Zero-copy Packing
+ *
+ * Copyright (C) 2018 Atonomi
+ */
+#include <stdio.h>
+#include <string.h>
+#include "atmi_errno.h"
+#include "atmi_zc.h"
+#include "atmi_priv.h"
+
+
+static atmi_session_state_t *sst_state(atmi_ssnstate_t *sst)
+{
+	return (atmi_session_state_t *)(void *)sst->state;
+}
+
+
+static int pack_into(const atmi_context_t *ctx, atmi_ssnstate_t *sst,
+                     uint8_t type, const void *msg, size_t nmsg,
+                     uint8_t *buf, size_t nbuf, size_t headroom)
+{
+	if(!ctx || !sst || !msg || !buf)
+		return -EINVAL;
+	if(headroom >= nbuf)
+		return -ENOSPC;
+
+	return ATMIpriv_pack_greeting(ctx, sst_state(sst), buf + headroom,
+	                              nbuf - headroom, type, msg, nmsg);
+}
+
+static int unpack_state(const atmi_context_t *ctx, atmi_ssnstate_t *sst,
+                        const void *pinbuf, size_t nin, uint8_t type,
+                        void *out, size_t nout)
+{
+	uint8_t work[ATMI_SESSBUF_SIZE];
+
+	if(!ctx || !sst || !pinbuf || !out)
+		return -EINVAL;
+
+	return ATMIpriv_unpack(ctx, sst_state(sst), pinbuf, nin, type,
+	                       work, sizeof(work), out, nout);
+}
+
+static int unpack_inplace(const atmi_context_t *ctx, atmi_ssnstate_t *sst,
+                          void *pinbuf, size_t nin, size_t nbuf, uint8_t type,
+                          void *out, size_t nout)
+{
+	uint8_t *pin = pinbuf;
+
+	if(!ctx || !sst || !pin || !out || nbuf < nin)
+		return -EINVAL;
+	if(nbuf == nin)
+		return -ENOSPC;
+
+	return ATMIpriv_unpack(ctx, sst_state(sst), pin, nin, type,
+	                       pin + nin, nbuf - nin, out, nout);
+}
+
+
+int ATMIpack_act_request_into(const atmi_context_t *ctx, atmi_ssnstate_t *sst,
+                              const atmi_act_request_t *act,
+                              uint8_t *buf, size_t nbuf, size_t headroom)
+{
+	return pack_into(ctx, sst, ATMI_PKT_TYPE_ACT_REQ,
+	                 act, ATMI_MSGLEN_ACT_REQ, buf, nbuf, headroom);
+}
+
+int ATMIpack_val_request_into(const atmi_context_t *ctx, atmi_ssnstate_t *sst,
+                              const atmi_val_request_t *val,
+                              uint8_t *buf, size_t nbuf, size_t headroom)
+{
+	return pack_into(ctx, sst, ATMI_PKT_TYPE_VAL_REQ,
+	                 val, ATMI_MSGLEN_VAL_REQ, buf, nbuf, headroom);
+}
+
+int ATMIpack_rep_request_into(const atmi_context_t *ctx, atmi_ssnstate_t *sst,
+                              const atmi_rep_request_t *rep,
+                              uint8_t *buf, size_t nbuf, size_t headroom)
+{
+	return pack_into(ctx, sst, ATMI_PKT_TYPE_REP_REQ,
+	                 rep, ATMI_MSGLEN_REP_REQ, buf, nbuf, headroom);
+}
+
+
+int ATMIunpack_act_response_state(const atmi_context_t *ctx,
+                                  atmi_ssnstate_t *sst,
+                                  const void *pinbuf, size_t nin,
+                                  atmi_act_response_t *act)
+{
+	return unpack_state(ctx, sst, pinbuf, nin, ATMI_PKT_TYPE_ACT_RESP,
+	                    act, ATMI_MSGLEN_ACT_RESP);
+}
+
+int ATMIunpack_val_response_state(const atmi_context_t *ctx,
+                                  atmi_ssnstate_t *sst,
+                                  const void *pinbuf, size_t nin,
+                                  atmi_val_response_t *val)
+{
+	return unpack_state(ctx, sst, pinbuf, nin, ATMI_PKT_TYPE_VAL_RESP,
+	                    val, ATMI_MSGLEN_VAL_RESP);
+}
+
+int ATMIunpack_rep_response_state(const atmi_context_t *ctx,
+                                  atmi_ssnstate_t *sst,
+                                  const void *pinbuf, size_t nin,
+                                  atmi_rep_response_t *rep)
+{
+	return unpack_state(ctx, sst, pinbuf, nin, ATMI_PKT_TYPE_REP_RESP,
+	                    rep, ATMI_MSGLEN_REP_RESP);
+}
+
+
+int ATMIunpack_act_response_inplace(const atmi_context_t *ctx,
+                                    atmi_ssnstate_t *sst,
+                                    void *pinbuf, size_t nin, size_t nbuf,
+                                    atmi_act_response_t *act)
+{
+	return unpack_inplace(ctx, sst, pinbuf, nin, nbuf,
+	                      ATMI_PKT_TYPE_ACT_RESP, act, ATMI_MSGLEN_ACT_RESP);
+}
+
+int ATMIunpack_val_response_inplace(const atmi_context_t *ctx,
+                                    atmi_ssnstate_t *sst,
+                                    void *pinbuf, size_t nin, size_t nbuf,
+                                    atmi_val_response_t *val)
+{
+	return unpack_inplace(ctx, sst, pinbuf, nin, nbuf,
+	                      ATMI_PKT_TYPE_VAL_RESP, val, ATMI_MSGLEN_VAL_RESP);
+}
+
+int ATMIunpack_rep_response_inplace(const atmi_context_t *ctx,
+                                    atmi_ssnstate_t *sst,
+                                    void *pinbuf, size_t nin, size_t nbuf,
+                                    atmi_rep_response_t *rep)
+{
+	return unpack_inplace(ctx, sst, pinbuf, nin, nbuf,
+	                      ATMI_PKT_TYPE_REP_RESP, rep, ATMI_MSGLEN_REP_RESP);
+}
+
+
+int ATMIframe_http_put(uint8_t *buf, size_t headroom, size_t npkt,
+                       const char *host, const char *path)
+{
+	char  hdr[512];
+	int   n;
+
+	if(!buf || !host || !path)
+		return -EINVAL;
+
+	n = snprintf(hdr, sizeof(hdr),
+	             "PUT %s HTTP/1.1\r\n"
+	             "Host: %s\r\n"
+	             "Content-Type: application/octet-stream\r\n"
+	             "Content-Length: %zu\r\n\r\n",
+	             path, host, npkt);
+	if(n < 0 || (size_t)n >= sizeof(hdr) || (size_t)n > headroom)
+		return -ENOSPC;
+
+	memcpy(buf + headroom - (size_t)n, hdr, (size_t)n);
+	return (int)(headroom - (size_t)n);
+}
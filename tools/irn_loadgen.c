@@ -0,0 +1,324 @@
+/*
+ * Atonomi Device SDK: IRN Load Generator
+ *
+ * Copyright (C) 2018 Atonomi
+ *
+ * Packs a number of requests on behalf of randomly keyed devices, sends
+ * them over the HTTP transport (atmi_http.h) and unpacks each response
+ * through a gateway (atmi_gw.h), reporting throughput and the distribution
+ * of per-request latency. Intended for use against tools/irn_standin.c,
+ * whose reflected responses are expected to fail unpacking with -EFAULT.
+ * With -z, requests are sent in the compact encoding of atmi_wire.h. With
+ * -t M, each request aggregates -m reputation amendments (atmi_multi.h),
+ * packed and unpacked directly rather than through the gateway.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/random.h>
+#include "atmi.h"
+#include "atmi_gw.h"
+#include "atmi_http.h"
+#include "atmi_multi.h"
+#include "atmi_wire.h"
+
+
+typedef struct {
+	atmi_gw_t  *gw;
+	unsigned    ep;
+	size_t      nmulti;
+	uint64_t   *latency;
+	size_t      ndone;
+	size_t      nhttp_ok;
+	size_t      nunpack_ok;
+	size_t      nunpack_fault;
+	size_t      nshed;
+	size_t      nfailed;
+	size_t      nbytes_up;
+	size_t      nbytes_down;
+} loadgen_t;
+
+typedef struct {
+	loadgen_t        *lg;
+	uint8_t           key[ATMI_GW_KEY_SIZE];
+	atmi_context_t    ctx;          /* Aggregated requests only. */
+	atmi_ssnstate_t  *ssts;
+} loadgen_req_t;
+
+
+void ATMI_memrand(void *p, size_t n)
+{
+	uint8_t  *b = p;
+	ssize_t   r;
+
+	while(n > 0u) {
+		r = getrandom(b, n, 0);
+		if(r <= 0)
+			abort();
+		b += r;
+		n -= (size_t)r;
+	}
+}
+
+
+/* Unpack an aggregated response, returning as for a single response. */
+static int unpack_multi(loadgen_req_t *rq, const uint8_t *body, size_t nbody)
+{
+	atmi_rep_response_t  reps[ATMI_MULTI_MAX];
+	size_t               i;
+	int                  r;
+
+	r = ATMIunpack_rep_response_multi(&rq->ctx, rq->ssts, body, nbody,
+	                                  reps, rq->lg->nmulti);
+	if(r < 0 || r == (int)rq->lg->nmulti)
+		return (r < 0) ? r : 0;
+
+	/* Report the first amendment whose packet failed. */
+	for(i = 0u; i < rq->lg->nmulti; i++)
+		if(reps[i].success < 0)
+			break;
+	return (i < rq->lg->nmulti) ? reps[i].success : -EBADF;
+}
+
+
+static void on_done(void *arg, int status, const uint8_t *body, size_t nbody,
+                    uint64_t latency)
+{
+	loadgen_req_t        *rq = arg;
+	loadgen_t            *lg = rq->lg;
+	atmi_act_response_t   act;
+	atmi_val_response_t   val;
+	atmi_rep_response_t   rep;
+	uint8_t               std[ATMI_SESSBUF_SIZE];
+	int                   r;
+
+	lg->latency[lg->ndone++] = latency;
+
+	if(status != 200) {
+		lg->nfailed++;
+		(void)ATMIgw_cancel(lg->gw, rq->key);
+		return;
+	}
+	lg->nhttp_ok++;
+	lg->nbytes_down += nbody;
+
+	if(ATMIwire_is_compact(body, nbody)) {
+		r = ATMIwire_expand(body, nbody, NULL, std, sizeof(std));
+		if(r < 0) {
+			lg->nshed++;
+			(void)ATMIgw_cancel(lg->gw, rq->key);
+			return;
+		}
+		body  = std;
+		nbody = (size_t)r;
+	}
+
+	switch(lg->ep) {
+	case ATMI_HTTP_ACT:
+		r = ATMIgw_unpack_act_response(lg->gw, rq->key, body, nbody, &act);
+		break;
+	case ATMI_HTTP_VAL:
+		r = ATMIgw_unpack_val_response(lg->gw, rq->key, body, nbody, &val);
+		break;
+	case ATMI_HTTP_REP_MULTI:
+		r = unpack_multi(rq, body, nbody);
+		break;
+	default:
+		r = ATMIgw_unpack_rep_response(lg->gw, rq->key, body, nbody, &rep);
+		break;
+	}
+
+	if(r == 0) {
+		lg->nunpack_ok++;
+	} else if(r == -EFAULT) {
+		lg->nunpack_fault++;
+	} else if(r == -ENOENT || r == -EBADF) {
+		/* Rejected before decryption; the request is still in flight. */
+		lg->nshed++;
+		(void)ATMIgw_cancel(lg->gw, rq->key);
+	}
+}
+
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+
+static double now_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr,
+	        "Usage: %s [-H host] [-p port] [-n requests] [-c conns]"
+	        " [-d depth] [-t A|V|R|M] [-m count] [-z]\n"
+	        "  -H host     IRN host (default 127.0.0.1).\n"
+	        "  -p port     IRN port (default 8080).\n"
+	        "  -n requests Number of requests to send (default 1000).\n"
+	        "  -c conns    Persistent connections (default 4).\n"
+	        "  -d depth    Requests pipelined per connection (default 8).\n"
+	        "  -t type     Request type: A, V, R or M, for aggregated"
+	        " reputation\n"
+	        "              (default A).\n"
+	        "  -m count    Amendments per aggregated request (default %u).\n"
+	        "  -z          Send requests in the compact wire encoding.\n",
+	        argv0, ATMI_MULTI_MAX);
+}
+
+
+int main(int argc, char *argv[])
+{
+	atmi_http_config_t   cfg;
+	atmi_http_t         *http;
+	atmi_context_t       ctx;
+	atmi_act_request_t   act;
+	atmi_val_request_t   val;
+	atmi_rep_request_t   rep;
+	loadgen_t            lg;
+	loadgen_req_t       *rqs;
+	atmi_ssnstate_t     *ssts;
+	uint8_t              pkt[ATMI_PKTLEN_REP_MULTI_REQ(ATMI_MULTI_MAX)];
+	atmi_rep_request_t   reps[ATMI_MULTI_MAX];
+	size_t               nreq = 1000u, i;
+	double               t0, t1;
+	int                  opt, r, compact = 0;
+
+	memset(&cfg, 0, sizeof(cfg));
+	memset(&lg, 0, sizeof(lg));
+	cfg.host = "127.0.0.1";
+	cfg.port = 8080u;
+	lg.ep     = ATMI_HTTP_ACT;
+	lg.nmulti = ATMI_MULTI_MAX;
+
+	while( (opt = getopt(argc, argv, "H:p:n:c:d:t:m:zh")) != -1 ) {
+		switch(opt) {
+		case 'H': cfg.host   = optarg;                         break;
+		case 'p': cfg.port   = (uint16_t)atoi(optarg);         break;
+		case 'n': nreq       = strtoul(optarg, NULL, 10);      break;
+		case 'c': cfg.nconns = (unsigned)atoi(optarg);         break;
+		case 'd': cfg.depth  = (unsigned)atoi(optarg);         break;
+		case 't':
+			lg.ep = (optarg[0] == 'V') ? ATMI_HTTP_VAL :
+			        (optarg[0] == 'R') ? ATMI_HTTP_REP :
+			        (optarg[0] == 'M') ? ATMI_HTTP_REP_MULTI : ATMI_HTTP_ACT;
+			break;
+		case 'm': lg.nmulti  = strtoul(optarg, NULL, 10);      break;
+		case 'z': compact    = 1;                              break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	/* Compact packets carry no length, so cannot be run together. */
+	if(nreq == 0u || lg.nmulti == 0u || lg.nmulti > ATMI_MULTI_MAX ||
+	   (compact && lg.ep == ATMI_HTTP_REP_MULTI)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	lg.gw      = ATMIgw_create(nreq);
+	lg.latency = calloc(nreq, sizeof(lg.latency[0]));
+	rqs        = calloc(nreq, sizeof(rqs[0]));
+	ssts       = (lg.ep == ATMI_HTTP_REP_MULTI) ?
+	             calloc(nreq * ATMI_MULTI_NPKG(lg.nmulti), sizeof(ssts[0])) :
+	             NULL;
+	http       = ATMIhttp_create(&cfg);
+	if(!lg.gw || !lg.latency || !rqs || !http ||
+	   (lg.ep == ATMI_HTTP_REP_MULTI && !ssts)) {
+		fprintf(stderr, "Error:Couldn't set up (out of memory, or host"
+		        " '%s' not resolved).\n", cfg.host);
+		return 2;
+	}
+
+	ATMI_memrand(&act, sizeof(act));
+	ATMI_memrand(&val, sizeof(val));
+	ATMI_memrand(&rep, sizeof(rep));
+	ATMI_memrand(reps, sizeof(reps));
+	for(i = 0u; i < lg.nmulti; i++)
+		memcpy(reps[i].id_requestor, rep.id_requestor,
+		       sizeof(rep.id_requestor));
+
+	t0 = now_sec();
+	for(i = 0u; i < nreq; i++) {
+		ATMI_memrand(&ctx, sizeof(ctx));
+		rqs[i].lg = &lg;
+
+		switch(lg.ep) {
+		case ATMI_HTTP_ACT:
+			r = ATMIgw_pack_act_request(lg.gw, &ctx, &act, rqs[i].key,
+			                            pkt, sizeof(pkt));
+			break;
+		case ATMI_HTTP_VAL:
+			r = ATMIgw_pack_val_request(lg.gw, &ctx, &val, rqs[i].key,
+			                            pkt, sizeof(pkt));
+			break;
+		case ATMI_HTTP_REP_MULTI:
+			rqs[i].ctx  = ctx;
+			rqs[i].ssts = ssts + i * ATMI_MULTI_NPKG(lg.nmulti);
+			r = ATMIpack_rep_request_multi(&rqs[i].ctx, rqs[i].ssts,
+			                               reps, lg.nmulti,
+			                               pkt, sizeof(pkt), 0u);
+			break;
+		default:
+			r = ATMIgw_pack_rep_request(lg.gw, &ctx, &rep, rqs[i].key,
+			                            pkt, sizeof(pkt));
+			break;
+		}
+
+		if(r > 0 && compact)
+			r = ATMIwire_compact(pkt, (size_t)r, pkt, sizeof(pkt), 0u);
+		if(r > 0)
+			lg.nbytes_up += (size_t)r;
+
+		if(r < 0 || ATMIhttp_put(http, lg.ep, pkt, (size_t)r,
+		                         on_done, &rqs[i]) < 0) {
+			fprintf(stderr, "Error:Couldn't pack or queue request %zu"
+			        " (%d).\n", i, r);
+			return 3;
+		}
+
+		/* Keep I/O moving while packing. */
+		(void)ATMIhttp_poll(http, 0);
+	}
+
+	while(ATMIhttp_outstanding(http) > 0u)
+		(void)ATMIhttp_poll(http, 1000);
+	t1 = now_sec();
+
+	qsort(lg.latency, lg.ndone, sizeof(lg.latency[0]), cmp_u64);
+
+	printf("requests=%zu http_ok=%zu failed=%zu unpack_ok=%zu"
+	       " unpack_efault=%zu shed=%zu\n",
+	       nreq, lg.nhttp_ok, lg.nfailed, lg.nunpack_ok, lg.nunpack_fault,
+	       lg.nshed);
+	printf("bytes: up=%zu down=%zu\n", lg.nbytes_up, lg.nbytes_down);
+	printf("elapsed=%.3fs rate=%.1f/s\n", t1 - t0, (double)nreq/(t1 - t0));
+	printf("latency_us: p50=%.1f p90=%.1f p99=%.1f max=%.1f\n",
+	       (double)lg.latency[lg.ndone*50u/100u] / 1e3,
+	       (double)lg.latency[lg.ndone*90u/100u] / 1e3,
+	       (double)lg.latency[lg.ndone*99u/100u] / 1e3,
+	       (double)lg.latency[lg.ndone - 1u] / 1e3);
+
+	ATMIhttp_destroy(http);
+	ATMIgw_destroy(lg.gw);
+	free(ssts);
+	free(rqs);
+	free(lg.latency);
+	return (lg.nfailed > 0u) ? 4 : 0;
+}
@@ -0,0 +1,564 @@
+/*
+ * Atonomi Device SDK: Local IRN Stand-in Server
+ *
+ * Copyright (C) 2018 Atonomi
+ *
+ * A multi-threaded HTTP/1.1 server answering PUT requests on the
+ * /activate, /validate, /reputation and /reputation/multi endpoints in the
+ * same manner as device.atonomi.net, intended for offline load and latency
+ * testing of the pack -> HTTP -> unpack path.
+ *
+ * The IRN's private key is not available, and the SDK libraries contain
+ * only the endpoint half of CENTRI Protected Sessions, so responses cannot
+ * be freshly encrypted for each request. Instead, each endpoint either
+ * replays a response body captured from the live servers (see -A, -V and
+ * -R), or reflects the request's own envelope back under the response
+ * message type. A reflected envelope is well-formed, so ATMIunpack_* carries
+ * it through key exchange and decryption before rejecting it (-EFAULT),
+ * keeping client-side cost per response representative. Aggregated
+ * reputation requests (atmi_multi.h) are reflected packet by packet.
+ *
+ * Requests may also arrive in the compact encoding of atmi_wire.h, in which
+ * case they are expanded before being checked and the response is compacted
+ * likewise. No device registry is kept, so a request without its public key
+ * is expanded around a placeholder; its response omits the key again, so
+ * the placeholder never leaves the server.
+ *
+ * Each worker thread owns a listening socket (SO_REUSEPORT) and an epoll
+ * instance; connections are persistent and pipelined requests are served
+ * in order.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include "atmi_multi.h"
+#include "atmi_priv.h"
+#include "atmi_wire.h"
+
+
+#define STANDIN_RXBUF_SIZE  (8192u)
+#define STANDIN_TXBUF_SIZE  (16384u)
+#define STANDIN_MAX_EVENTS  (64)
+#define STANDIN_MAX_WORKERS (256u)
+#define STANDIN_MAXBODY     ATMI_PKTLEN_REP_MULTI_REQ(ATMI_MULTI_MAX)
+
+
+enum { EP_ACT, EP_VAL, EP_REP, EP_REP_MULTI, EP_COUNT };
+
+typedef struct {
+	const char  *path;
+	uint8_t      reqtype;
+	uint8_t      resptype;
+	size_t       maxpkts;         /* Packets per request body.        */
+	uint8_t     *replay;          /* Captured response body, or NULL. */
+	size_t       nreplay;
+	uint64_t     count;           /* Requests served (atomic).        */
+} standin_endpoint_t;
+
+typedef struct {
+	int          fd;
+	size_t       nrx;
+	size_t       ntx;
+	size_t       txoff;
+	uint8_t      rx[STANDIN_RXBUF_SIZE];
+	uint8_t      tx[STANDIN_TXBUF_SIZE];
+} standin_conn_t;
+
+
+static standin_endpoint_t endpoints[EP_COUNT] = {
+	[EP_ACT]       = { "/activate",   ATMI_PKT_TYPE_ACT_REQ,
+	                   ATMI_PKT_TYPE_ACT_RESP, 1u },
+	[EP_VAL]       = { "/validate",   ATMI_PKT_TYPE_VAL_REQ,
+	                   ATMI_PKT_TYPE_VAL_RESP, 1u },
+	[EP_REP]       = { "/reputation", ATMI_PKT_TYPE_REP_REQ,
+	                   ATMI_PKT_TYPE_REP_RESP, 1u },
+	[EP_REP_MULTI] = { "/reputation/multi", ATMI_PKT_TYPE_REP_MULTI_REQ,
+	                   ATMI_PKT_TYPE_REP_MULTI_RESP,
+	                   ATMI_MULTI_NPKG(ATMI_MULTI_MAX) },
+};
+
+static uint16_t        opt_port    = 8080u;
+static const char     *opt_bind    = "127.0.0.1";
+static unsigned        opt_workers = 1u;
+static volatile int    stopping;
+static uint64_t        count_errors;
+
+
+static int load_file(const char *fname, uint8_t **pbuf, size_t *plen)
+{
+	FILE    *fp;
+	uint8_t *buf;
+	size_t   len;
+
+	if( !(fp = fopen(fname, "rb")) ) {
+		fprintf(stderr, "Error:fopen:Couldn't open '%s' for read.\n", fname);
+		return -1;
+	}
+
+	buf = malloc(ATMI_SESSBUF_SIZE + 1u);
+	len = buf ? fread(buf, 1, ATMI_SESSBUF_SIZE + 1u, fp) : 0u;
+	(void)fclose(fp);
+
+	if(len <= ATMI_PKT_HDR_SIZE || len > ATMI_SESSBUF_SIZE) {
+		fprintf(stderr, "Error:fread:'%s' is not an Atonomi packet.\n", fname);
+		free(buf);
+		return -1;
+	}
+
+	*pbuf = buf;
+	*plen = len;
+	return 0;
+}
+
+
+static int tx_append(standin_conn_t *c, const void *p, size_t n)
+{
+	if(n > sizeof(c->tx) - c->ntx)
+		return -1;
+	memcpy(c->tx + c->ntx, p, n);
+	c->ntx += n;
+	return 0;
+}
+
+
+static int tx_status(standin_conn_t *c, int code, const char *reason)
+{
+	char  hdr[128];
+	int   n;
+
+	__atomic_fetch_add(&count_errors, 1u, __ATOMIC_RELAXED);
+	n = snprintf(hdr, sizeof(hdr), "HTTP/1.1 %d %s\r\n"
+	             "Content-Length: 0\r\n\r\n", code, reason);
+	return tx_append(c, hdr, (size_t)n);
+}
+
+
+/*
+ * Take the packet at the start of a request body of n bytes, in either
+ * encoding. Returns it in the standard encoding (possibly expanded into
+ * std), with its length in *pnpkt, the number of body bytes it took up in
+ * *pnused and, in *pwire, the compact encoding flags for its response, or
+ * -1 to respond in the standard encoding. Compact packets carry no length,
+ * so one takes up the rest of the body. Returns NULL if malformed.
+ */
+static const uint8_t *rx_packet(const uint8_t *body, size_t n,
+                                uint8_t std[ATMI_SESSBUF_SIZE],
+                                size_t *pnused, size_t *pnpkt, int *pwire)
+{
+	static const uint8_t placeholder[32];
+	int r;
+
+	*pwire = -1;
+	if(ATMIwire_is_compact(body, n)) {
+		r = ATMIwire_expand(body, n, placeholder, std, ATMI_SESSBUF_SIZE);
+		if(r < 0)
+			return NULL;
+		*pwire  = body[0] & ATMI_WIRE_NOKEY;
+		*pnused = n;
+		*pnpkt  = (size_t)r;
+		body    = std;
+	}
+	else {
+		if(n <= ATMI_PKT_HDR_SIZE + 2u)
+			return NULL;
+		*pnpkt  = ATMI_PKT_HDR_SIZE + ATMIpriv_load16(body + 5);
+		*pnused = *pnpkt;
+		if(*pnpkt > n)
+			return NULL;
+	}
+
+	if(*pnpkt <= ATMI_PKT_HDR_SIZE || *pnpkt > ATMI_SESSBUF_SIZE ||
+	   body[0] != ATMI_PKT_TAG0 || body[1] != ATMI_PKT_TAG1 ||
+	   body[2] != ATMI_PKT_TAG2)
+		return NULL;
+	return body;
+}
+
+
+/*
+ * Check a request body, a run of one to ep->maxpkts packets of the
+ * endpoint's request type, and reflect each packet into out under the
+ * response type. Returns the length written to out, or zero if the body is
+ * malformed.
+ */
+static size_t rx_reflect(const standin_endpoint_t *ep,
+                         const uint8_t *body, size_t nbody,
+                         uint8_t *out, size_t nout)
+{
+	uint8_t        std[ATMI_SESSBUF_SIZE];
+	const uint8_t *pkt;
+	size_t         off, nused, npkt, nrsp, i;
+	int            wire, r;
+
+	for(off = 0u, nrsp = 0u, i = 0u; off < nbody; off += nused, i++) {
+		pkt = rx_packet(body + off, nbody - off, std, &nused, &npkt, &wire);
+		if(i == ep->maxpkts || !pkt || pkt[3] != ep->reqtype ||
+		   npkt > nout - nrsp)
+			return 0u;
+
+		memcpy(out + nrsp, pkt, npkt);
+		out[nrsp + 3u] = ep->resptype;
+
+		/* A response outside the compact layout is sent as it is. */
+		if(wire >= 0) {
+			r = ATMIwire_compact(out + nrsp, npkt, out + nrsp,
+			                     nout - nrsp, (unsigned)wire);
+			if(r > 0)
+				npkt = (size_t)r;
+		}
+		nrsp += npkt;
+	}
+
+	return nrsp;
+}
+
+
+static int tx_response(standin_conn_t *c, standin_endpoint_t *ep,
+                       const uint8_t *body, size_t nbody)
+{
+	char  hdr[128];
+	int   n;
+
+	if(ep->replay) {
+		body  = ep->replay;
+		nbody = ep->nreplay;
+	}
+
+	__atomic_fetch_add(&ep->count, 1u, __ATOMIC_RELAXED);
+	n = snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\n"
+	             "Content-Type: application/octet-stream\r\n"
+	             "Content-Length: %zu\r\n\r\n", nbody);
+
+	if(tx_append(c, hdr, (size_t)n) < 0)
+		return -1;
+	return tx_append(c, body, nbody);
+}
+
+
+/*
+ * Serve complete requests held in the receive buffer, for as long as the
+ * transmit buffer has room for their responses. Returns zero on success,
+ * or negative if the connection should be closed.
+ */
+static int serve_requests(standin_conn_t *c)
+{
+	standin_endpoint_t  *ep;
+	const uint8_t       *body;
+	uint8_t              rsp[STANDIN_MAXBODY];
+	const char          *hdrend;
+	char                 hdr[1024], *line, *save;
+	size_t               hdrlen, clen, nrsp, total;
+	char                 method[8], path[64];
+	int                  i, have_clen;
+
+	while(c->nrx > 0u &&
+	      sizeof(c->tx) - c->ntx >= STANDIN_MAXBODY + sizeof(hdr)) {
+		hdrend = memmem(c->rx, c->nrx, "\r\n\r\n", 4u);
+		if(!hdrend)
+			return (c->nrx < sizeof(hdr)) ? 0 : -1;
+
+		hdrlen = (size_t)(hdrend - (const char *)c->rx) + 4u;
+		if(hdrlen > sizeof(hdr))
+			return -1;
+		memcpy(hdr, c->rx, hdrlen - 4u);
+		hdr[hdrlen - 4u] = '\0';
+
+		if(sscanf(hdr, "%7s %63s", method, path) != 2)
+			return -1;
+
+		clen      = 0u;
+		have_clen = 0;
+		line      = strtok_r(hdr, "\r\n", &save);
+		while( (line = strtok_r(NULL, "\r\n", &save)) ) {
+			if(!strncasecmp(line, "Content-Length:", 15u)) {
+				clen      = strtoul(line + 15, NULL, 10);
+				have_clen = 1;
+			}
+		}
+
+		if(clen > sizeof(c->rx) - hdrlen)
+			return -1;
+
+		total = hdrlen + clen;
+		if(c->nrx < total)
+			return 0;
+		body = c->rx + hdrlen;
+
+		for(ep = NULL, i = 0; i < EP_COUNT; i++)
+			if(!strcmp(path, endpoints[i].path))
+				ep = &endpoints[i];
+
+		if(!ep) {
+			if(tx_status(c, 404, "Not Found") < 0)
+				return -1;
+		}
+		else if(strcmp(method, "PUT")) {
+			if(tx_status(c, 405, "Method Not Allowed") < 0)
+				return -1;
+		}
+		else if(!have_clen ||
+		        !(nrsp = rx_reflect(ep, body, clen, rsp, sizeof(rsp)))) {
+			if(tx_status(c, 400, "Bad Request") < 0)
+				return -1;
+		}
+		else if(tx_response(c, ep, rsp, nrsp) < 0) {
+			return -1;
+		}
+
+		memmove(c->rx, c->rx + total, c->nrx - total);
+		c->nrx -= total;
+	}
+
+	return 0;
+}
+
+
+static int conn_flush(standin_conn_t *c)
+{
+	ssize_t  w;
+
+	while(c->txoff < c->ntx) {
+		w = send(c->fd, c->tx + c->txoff, c->ntx - c->txoff, MSG_NOSIGNAL);
+		if(w < 0)
+			return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+		c->txoff += (size_t)w;
+	}
+
+	c->ntx   = 0u;
+	c->txoff = 0u;
+	return 0;
+}
+
+
+static void conn_close(int epfd, standin_conn_t *c)
+{
+	(void)epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+	(void)close(c->fd);
+	free(c);
+}
+
+
+static void conn_event(int epfd, standin_conn_t *c, uint32_t events)
+{
+	struct epoll_event  ev;
+	size_t              nrx;
+	ssize_t             r;
+
+	if(events & (EPOLLERR | EPOLLHUP)) {
+		conn_close(epfd, c);
+		return;
+	}
+
+	while(c->nrx < sizeof(c->rx)) {
+		r = recv(c->fd, c->rx + c->nrx, sizeof(c->rx) - c->nrx, 0);
+		if(r > 0) {
+			c->nrx += (size_t)r;
+			continue;
+		}
+		if(r == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+			conn_close(epfd, c);
+			return;
+		}
+		break;
+	}
+
+	/* Alternate serving and flushing until blocked on either side. */
+	do {
+		nrx = c->nrx;
+		if(serve_requests(c) < 0 || conn_flush(c) < 0) {
+			conn_close(epfd, c);
+			return;
+		}
+	} while(c->ntx == 0u && c->nrx > 0u && c->nrx != nrx);
+
+	ev.events   = (c->ntx > 0u) ? EPOLLOUT : EPOLLIN;
+	ev.data.ptr = c;
+	(void)epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+
+static int listen_socket(void)
+{
+	struct sockaddr_in  sa;
+	int                 fd, on = 1;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port   = htons(opt_port);
+	if(inet_pton(AF_INET, opt_bind, &sa.sin_addr) != 1)
+		return -1;
+
+	fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	if(fd < 0)
+		return -1;
+
+	(void)setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	if(setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0 ||
+	   bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 ||
+	   listen(fd, SOMAXCONN) < 0) {
+		(void)close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+
+static void *worker(void *arg)
+{
+	struct epoll_event   ev, evs[STANDIN_MAX_EVENTS];
+	standin_conn_t      *c;
+	int                  lfd = (int)(intptr_t)arg;
+	int                  epfd, fd, n, i, on = 1;
+
+	if( (epfd = epoll_create1(0)) < 0 )
+		return NULL;
+
+	ev.events   = EPOLLIN;
+	ev.data.ptr = NULL;
+	(void)epoll_ctl(epfd, EPOLL_CTL_ADD, lfd, &ev);
+
+	while(!stopping) {
+		n = epoll_wait(epfd, evs, STANDIN_MAX_EVENTS, 200);
+
+		for(i = 0; i < n; i++) {
+			if(evs[i].data.ptr) {
+				conn_event(epfd, evs[i].data.ptr, evs[i].events);
+				continue;
+			}
+
+			while( (fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK)) >= 0 ) {
+				if( !(c = malloc(sizeof(*c))) ) {
+					(void)close(fd);
+					continue;
+				}
+				c->fd    = fd;
+				c->nrx   = 0u;
+				c->ntx   = 0u;
+				c->txoff = 0u;
+				(void)setsockopt(fd, IPPROTO_TCP, TCP_NODELAY,
+				                 &on, sizeof(on));
+
+				ev.events   = EPOLLIN;
+				ev.data.ptr = c;
+				if(epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+					(void)close(fd);
+					free(c);
+				}
+			}
+		}
+	}
+
+	(void)close(epfd);
+	return NULL;
+}
+
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stopping = 1;
+}
+
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr,
+	        "Usage: %s [-b addr] [-p port] [-w workers]"
+	        " [-A file] [-V file] [-R file]\n"
+	        "  -b addr     Address to listen on (default 127.0.0.1).\n"
+	        "  -p port     Port to listen on (default 8080).\n"
+	        "  -w workers  Number of worker threads (default 1).\n"
+	        "  -A file     Replay this response body for /activate.\n"
+	        "  -V file     Replay this response body for /validate.\n"
+	        "  -R file     Replay this response body for /reputation.\n",
+	        argv0);
+}
+
+
+int main(int argc, char *argv[])
+{
+	pthread_t  threads[STANDIN_MAX_WORKERS];
+	int        lfds[STANDIN_MAX_WORKERS];
+	unsigned   i;
+	int        opt;
+
+	while( (opt = getopt(argc, argv, "b:p:w:A:V:R:h")) != -1 ) {
+		switch(opt) {
+		case 'b': opt_bind    = optarg;                      break;
+		case 'p': opt_port    = (uint16_t)atoi(optarg);      break;
+		case 'w': opt_workers = (unsigned)atoi(optarg);      break;
+		case 'A':
+			if(load_file(optarg, &endpoints[EP_ACT].replay,
+			             &endpoints[EP_ACT].nreplay) < 0)
+				return 1;
+			break;
+		case 'V':
+			if(load_file(optarg, &endpoints[EP_VAL].replay,
+			             &endpoints[EP_VAL].nreplay) < 0)
+				return 1;
+			break;
+		case 'R':
+			if(load_file(optarg, &endpoints[EP_REP].replay,
+			             &endpoints[EP_REP].nreplay) < 0)
+				return 1;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if(opt_workers == 0u || opt_workers > STANDIN_MAX_WORKERS) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	for(i = 0u; i < opt_workers; i++) {
+		if( (lfds[i] = listen_socket()) < 0 ) {
+			fprintf(stderr, "Error:listen:Couldn't listen on %s:%u.\n",
+			        opt_bind, (unsigned)opt_port);
+			return 2;
+		}
+		if(!!pthread_create(&threads[i], NULL, worker,
+		                    (void *)(intptr_t)lfds[i])) {
+			fprintf(stderr, "Error:pthread_create:Couldn't start"
+			        " worker %u.\n", i);
+			return 3;
+		}
+	}
+
+	printf("Listening on %s:%u with %u worker(s).\n",
+	       opt_bind, (unsigned)opt_port, opt_workers);
+	fflush(stdout);
+
+	for(i = 0u; i < opt_workers; i++) {
+		(void)pthread_join(threads[i], NULL);
+		(void)close(lfds[i]);
+	}
+
+	printf("Served: activation=%llu validation=%llu reputation=%llu"
+	       " reputation_multi=%llu errors=%llu\n",
+	       (unsigned long long)endpoints[EP_ACT].count,
+	       (unsigned long long)endpoints[EP_VAL].count,
+	       (unsigned long long)endpoints[EP_REP].count,
+	       (unsigned long long)endpoints[EP_REP_MULTI].count,
+	       (unsigned long long)count_errors);
+	return 0;
+}